@@ -19,6 +19,7 @@
 #include "include/memlayout.h"
 #include "include/riscv.h"
 #include "include/proc.h"
+#include "include/trap.h"
 #include "include/sbi.h"
 
 #define BACKSPACE 0x100
@@ -53,6 +54,9 @@ consolewrite(int user_src, uint64 src, int n)
 {
   int i;
 
+  // 持有 cons.lock 时不能缺页，先为用户缓冲区补上映射
+  if(user_src)
+    fault_in_range(src, n, 0);
   acquire(&cons.lock);
   for(i = 0; i < n; i++){
     char c;
@@ -79,6 +83,8 @@ consoleread(int user_dst, uint64 dst, int n)
   char cbuf;
 
   target = n;
+  if(user_dst)
+    fault_in_range(dst, n, 1);
   acquire(&cons.lock);
   while(n > 0){
     // wait until interrupt handler has put some
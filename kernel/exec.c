@@ -8,6 +8,7 @@
 #include "include/proc.h"
 #include "include/elf.h"
 #include "include/fat32.h"
+#include "include/file.h"
 #include "include/kalloc.h"
 #include "include/vm.h"
 #include "include/printf.h"
@@ -40,6 +41,58 @@ loadseg(pagetable_t pagetable, uint64 va, struct dirent *ep, uint offset, uint s
   return 0;
 }
 
+#ifdef EXEC_DEMAND_PAGING
+/**
+ * @brief 把程序段中完整来自文件的页映射为私有文件映射，缺页时再读入
+ * @param img 新映像的 VMA 索引，exec 成功后整体交给进程
+ * @param f 可执行文件
+ * @param ph 程序段，vaddr 页对齐
+ * @return 0 成功，-1 内存不足
+ * @note 映射覆盖 [vaddr, vaddr + filesz 向下取整到页)，这些页的内容只取决于文件，读缺页时映射页缓存中的页，
+ *       执行同一文件的进程共用一份；可写段的页按 COW 映射，写入时才复制。文件偏移不必页对齐
+ */
+static int
+mapseg(struct vma_tree *img, struct file *f, struct proghdr *ph)
+{
+  uint64 len = PGROUNDDOWN(ph->filesz);
+  struct vma *v;
+
+  if(len == 0)
+    return 0;
+  if((v = vma_alloc()) == NULL)
+    return -1;
+  v->start = ph->vaddr;
+  v->end = ph->vaddr + len;
+  v->prot = 0;
+  if(ph->flags & ELF_PROG_FLAG_READ)
+    v->prot |= PROT_READ;
+  if(ph->flags & ELF_PROG_FLAG_WRITE)
+    v->prot |= PROT_WRITE;
+  if(ph->flags & ELF_PROG_FLAG_EXEC)
+    v->prot |= PROT_EXEC;
+  v->flags = MAP_PRIVATE;
+  v->offset = ph->off;
+  v->vm_file = filedup(f);
+  if(vma_insert(img, v) < 0){
+    fileclose(v->vm_file);
+    vma_release(v);
+    return -1;
+  }
+  return 0;
+}
+
+// 丢弃尚未交给进程的映像 VMA，其中还没有映射任何页
+static void
+freeimg(struct vma_tree *img)
+{
+  while(img->first){
+    struct vma *v = img->first;
+    vma_remove(img, v);
+    fileclose(v->vm_file);
+    vma_release(v);
+  }
+}
+#endif
 
 int exec(char *path, char **argv)
 {
@@ -50,18 +103,13 @@ int exec(char *path, char **argv)
   struct dirent *ep;
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
-  pagetable_t kpagetable = 0, oldkpagetable;
   struct proc *p = myproc();
+  #ifdef EXEC_DEMAND_PAGING
+  struct vma_tree img;
+  struct file *f = 0;
 
-  // Make a copy of p->kpt without old user space, 
-  // but with the same kstack we are using now, which can't be changed
-  if ((kpagetable = (pagetable_t)kalloc()) == NULL) {
-    return -1;
-  }
-  memmove(kpagetable, p->kpagetable, PGSIZE);
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    kpagetable[i] = 0;
-  }
+  vma_tree_init(&img);
+  #endif
 
   if((ep = ename(path)) == NULL) {
     #ifdef DEBUG
@@ -78,6 +126,15 @@ int exec(char *path, char **argv)
     goto bad;
   if((pagetable = proc_pagetable(p)) == NULL)
     goto bad;
+  #ifdef EXEC_DEMAND_PAGING
+  if((f = filealloc()) == NULL)
+    goto bad;
+  f->type = FD_ENTRY;
+  f->readable = 1;
+  f->writable = 0;
+  f->off = 0;
+  f->ep = edup(ep);
+  #endif
 
   // Load program into memory.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
@@ -89,14 +146,32 @@ int exec(char *path, char **argv)
       goto bad;
     if(ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
+    #ifdef EXEC_DEMAND_PAGING
+    // 程序段不预先分配：完整来自文件的页建立文件映射；文件内容末尾不足一页的部分
+    // 之后紧跟 .bss，必须清零，立即读入一页私有页；其余的 .bss 与堆一样懒分配
+    if(ph.vaddr % PGSIZE != 0)
+      goto bad;
+    if(ph.vaddr + ph.memsz > sz)
+      sz = ph.vaddr + ph.memsz;
+    if(mapseg(&img, f, &ph) < 0)
+      goto bad;
+    if(ph.filesz % PGSIZE != 0){
+      uint64 tail = PGROUNDDOWN(ph.filesz);
+      if(uvmalloc(pagetable, ph.vaddr + tail, ph.vaddr + tail + PGSIZE) == 0)
+        goto bad;
+      if(loadseg(pagetable, ph.vaddr + tail, ep, ph.off + tail, ph.filesz - tail) < 0)
+        goto bad;
+    }
+    #else
     uint64 sz1;
-    if((sz1 = uvmalloc(pagetable, kpagetable, sz, ph.vaddr + ph.memsz)) == 0)
+    if((sz1 = uvmalloc(pagetable, sz, ph.vaddr + ph.memsz)) == 0)
       goto bad;
     sz = sz1;
     if(ph.vaddr % PGSIZE != 0)
       goto bad;
     if(loadseg(pagetable, ph.vaddr, ep, ph.off, ph.filesz) < 0)
       goto bad;
+    #endif
   }
   eunlock(ep);
   eput(ep);
@@ -109,10 +184,11 @@ int exec(char *path, char **argv)
   // Use the second as the user stack.
   sz = PGROUNDUP(sz);
   uint64 sz1;
-  if((sz1 = uvmalloc(pagetable, kpagetable, sz, sz + 2*PGSIZE)) == 0)
+  if((sz1 = uvmalloc(pagetable, sz, sz + 2*PGSIZE)) == 0)
     goto bad;
   sz = sz1;
-  uvmclear(pagetable, sz-2*PGSIZE);
+  if(uvmclear(pagetable, sz-2*PGSIZE) < 0)
+    goto bad;
   sp = sz;
   stackbase = sp - PGSIZE;
 
@@ -149,31 +225,32 @@ int exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
+  // vfork 的子进程把借用的地址空间交还父进程，旧页表中只剩下自己的部分
+  if (p->vm_owner) {
+    vfork_release(p);
+    oldsz = 0;
+  }
+
+  // 在切换到新页表之前，清理所有旧的 VMA：写回共享映射的脏页，并移除旧页表中的映射，
+  // 否则释放旧页表时会遇到残留的叶子页表项
+  vma_free(p);
+  #ifdef EXEC_DEMAND_PAGING
+  p->vmas = img;
+  fileclose(f);
+  #endif
+
   // Commit to the user image.
   oldpagetable = p->pagetable;
-  oldkpagetable = p->kpagetable;
   p->pagetable = pagetable;
-  p->kpagetable = kpagetable;
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
 
-  // 在释放旧页表之前，清理所有旧的 VMA
-  for (i = 0; i < NVMA; i++) {
-    struct vma* v = &p->vmas[i];
-    if (v->valid) {
-      if (v->vm_file) {
-        fileclose(v->vm_file);
-        v->vm_file = NULL;
-      }
-    }
-    v->valid = 0;
-  }
-
+  // 内核正运行在旧页表上，必须先切换到新页表再释放旧页表；
+  // 旧 ASID 直接作废，新页表换用一个本代内未用过的 ASID，无需刷新 TLB
+  p->asid_gen = 0;
+  switchuvm(p);
   proc_freepagetable(oldpagetable, oldsz);
-  w_satp(MAKE_SATP(p->kpagetable));
-  sfence_vma();
-  kvmfree(oldkpagetable, 0);
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -182,11 +259,14 @@ int exec(char *path, char **argv)
   #endif
   if(pagetable)
     proc_freepagetable(pagetable, sz);
-  if(kpagetable)
-    kvmfree(kpagetable, 0);
   if(ep){
     eunlock(ep);
     eput(ep);
   }
+  #ifdef EXEC_DEMAND_PAGING
+  freeimg(&img);
+  if(f)
+    fileclose(f);
+  #endif
   return -1;
 }
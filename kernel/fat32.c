@@ -7,6 +7,8 @@
 #include "include/proc.h"
 #include "include/stat.h"
 #include "include/fat32.h"
+#include "include/slab.h"
+#include "include/pagecache.h"
 #include "include/string.h"
 #include "include/printf.h"
 
@@ -62,9 +64,11 @@ static struct {
 
 } fat;
 
+// 目录项缓存按需从 slab 分配，最多 ENTRY_CACHE_NUM 项，之后按 LRU 复用
 static struct entry_cache {
     struct spinlock lock;
-    struct dirent entries[ENTRY_CACHE_NUM];
+    struct kmem_cache *cache;
+    int nentries;
 } ecache;
 
 static struct dirent root;
@@ -117,18 +121,9 @@ int fat32_init()
     root.valid = 1;
     root.prev = &root;
     root.next = &root;
-    for(struct dirent *de = ecache.entries; de < ecache.entries + ENTRY_CACHE_NUM; de++) {
-        de->dev = 0;
-        de->valid = 0;
-        de->ref = 0;
-        de->dirty = 0;
-        de->parent = 0;
-        de->next = root.next;
-        de->prev = &root;
-        initsleeplock(&de->lock, "entry");
-        root.next->prev = de;
-        root.next = de;
-    }
+    if ((ecache.cache = kmem_cache_create("dirent", sizeof(struct dirent), 0)) == NULL)
+        panic("fat32_init: dirent cache");
+    ecache.nentries = 0;
     return 0;
 }
 
@@ -333,6 +328,24 @@ int eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n)
     return tot;
 }
 
+// Read one page of a file into kernel page `page' for a
+// file mapping. Bytes past the end of the file are zeroed.
+// Returns 0, or -1 if the file could not be read in full.
+// Caller must hold entry->lock.
+int ereadpage(struct dirent *entry, char *page, uint off)
+{
+    uint want = off < entry->file_size ? entry->file_size - off : 0;
+    if (want > PGSIZE) {
+        want = PGSIZE;
+    }
+    int n = eread(entry, 0, (uint64)page, off, want);
+    if (n < 0 || n != want) {
+        return -1;
+    }
+    memset(page + n, 0, PGSIZE - n);
+    return 0;
+}
+
 // Caller must hold entry->lock.
 int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
 {
@@ -345,6 +358,8 @@ int ewrite(struct dirent *entry, int user_src, uint64 src, uint off, uint n)
         entry->clus_cnt = 0;
         entry->dirty = 1;
     }
+    // 私有文件映射缓存的旧内容作废
+    pagecache_invalidate(entry);
     uint tot, m;
     for (tot = 0; tot < n; tot += m, off += m, src += m) {
         reloc_clus(entry, off, 1);
@@ -387,6 +402,21 @@ static struct dirent *eget(struct dirent *parent, char *name)
             }
         }
     }
+    // 缓存未满时优先分配新的目录项，分配失败再退回到 LRU 复用
+    if (ecache.nentries < ENTRY_CACHE_NUM
+        && (ep = kmem_cache_alloc(ecache.cache)) != NULL) {
+        ecache.nentries++;
+        memset(ep, 0, sizeof(*ep));
+        initsleeplock(&ep->lock, "entry");
+        ep->next = root.next;
+        ep->prev = &root;
+        root.next->prev = ep;
+        root.next = ep;
+        ep->ref = 1;
+        ep->dev = parent->dev;
+        release(&ecache.lock);
+        return ep;
+    }
     for (ep = root.prev; ep != &root; ep = ep->prev) {              // LRU algo
         if (ep->ref == 0) {
             ep->ref = 1;
@@ -639,6 +669,7 @@ void eremove(struct dirent *entry)
 // caller must hold entry->lock
 void etrunc(struct dirent *entry)
 {
+    pagecache_invalidate(entry);
     for (uint32 clus = entry->first_clus; clus >= 2 && clus < FAT32_EOC; ) {
         uint32 next = read_fat(clus);
         free_clus(clus);
@@ -0,0 +1,105 @@
+// Minimal flattened device tree (DTB) reader.
+// Only used once at boot, before paging is enabled, to find the
+// physical memory range reported by the firmware.
+
+#include "include/types.h"
+#include "include/fdt.h"
+#include "include/string.h"
+
+// DTB 结构块中的 token
+#define FDT_BEGIN_NODE  1
+#define FDT_END_NODE    2
+#define FDT_PROP        3
+#define FDT_NOP         4
+#define FDT_END         9
+
+// DTB 头部，所有字段都是大端序
+struct fdt_header {
+  uint32 magic;
+  uint32 totalsize;
+  uint32 off_dt_struct;
+  uint32 off_dt_strings;
+  uint32 off_mem_rsvmap;
+  uint32 version;
+  uint32 last_comp_version;
+  uint32 boot_cpuid_phys;
+  uint32 size_dt_strings;
+  uint32 size_dt_struct;
+};
+
+static inline uint32
+fdt32(const void *p)
+{
+  return __builtin_bswap32(*(const uint32 *)p);
+}
+
+/**
+ * @brief 按 cells 个 32 位大端单元读出一个地址或长度
+ */
+static uint64
+fdt_cells(const uint32 *p, int cells)
+{
+  uint64 v = 0;
+  for (int i = 0; i < cells; i++)
+    v = (v << 32) | fdt32(&p[i]);
+  return v;
+}
+
+/**
+ * @brief 从设备树中找出 /memory 节点描述的第一段物理内存
+ * @param dtb_pa 设备树的物理地址，由 SBI 通过 a1 传给 main
+ * @param base 返回内存起始物理地址
+ * @param size 返回内存大小（字节）
+ * @return 0 表示成功，-1 表示设备树无效或没有 /memory 节点
+ * @note 地址和长度的单元数取根节点的 #address-cells / #size-cells，缺省为 2 / 1
+ */
+int
+fdt_memory(uint64 dtb_pa, uint64 *base, uint64 *size)
+{
+  struct fdt_header *hdr = (struct fdt_header *)dtb_pa;
+  int addr_cells = 2, size_cells = 1;
+  int depth = 0, in_memory = 0;
+
+  if (dtb_pa == 0 || dtb_pa % 4 != 0 || fdt32(&hdr->magic) != FDT_MAGIC)
+    return -1;
+
+  const uint32 *p = (const uint32 *)(dtb_pa + fdt32(&hdr->off_dt_struct));
+  const uint32 *end = (const uint32 *)((uint64)p + fdt32(&hdr->size_dt_struct));
+  const char *strings = (const char *)(dtb_pa + fdt32(&hdr->off_dt_strings));
+
+  while (p < end) {
+    uint32 token = fdt32(p++);
+    if (token == FDT_BEGIN_NODE) {
+      const char *name = (const char *)p;
+      int len = strlen(name);
+      depth++;
+      // 只认根节点下名为 memory 或 memory@<addr> 的节点
+      in_memory = depth == 2 && strncmp(name, "memory", 6) == 0 &&
+                  (name[6] == '\0' || name[6] == '@');
+      p += (len + 1 + 3) / 4;
+    } else if (token == FDT_END_NODE) {
+      depth--;
+      in_memory = 0;
+    } else if (token == FDT_PROP) {
+      uint32 len = fdt32(p++);
+      const char *name = strings + fdt32(p++);
+      const uint32 *val = p;
+      p += (len + 3) / 4;
+      if (depth == 1 && strncmp(name, "#address-cells", 15) == 0)
+        addr_cells = fdt32(val);
+      else if (depth == 1 && strncmp(name, "#size-cells", 12) == 0)
+        size_cells = fdt32(val);
+      else if (in_memory && strncmp(name, "reg", 4) == 0 &&
+               len >= (addr_cells + size_cells) * 4) {
+        *base = fdt_cells(val, addr_cells);
+        *size = fdt_cells(val + addr_cells, size_cells);
+        return 0;
+      }
+    } else if (token == FDT_NOP) {
+      continue;
+    } else {
+      break;
+    }
+  }
+  return -1;
+}
@@ -16,21 +16,23 @@
 #include "include/printf.h"
 #include "include/string.h"
 #include "include/vm.h"
+#include "include/slab.h"
 
 struct devsw devsw[NDEV];
+// struct file 按需从 slab 分配，nfile 限制系统中同时打开的文件数不超过 NFILE
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache *cache;
+  int nfile;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
-  struct file *f;
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    memset(f, 0, sizeof(struct file));
-  }
+  if((ftable.cache = kmem_cache_create("file", sizeof(struct file), 0)) == NULL)
+    panic("fileinit");
+  ftable.nfile = 0;
   #ifdef DEBUG
   printf("fileinit\n");
   #endif
@@ -43,15 +45,22 @@ filealloc(void)
   struct file *f;
 
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
+  if(ftable.nfile >= NFILE){
+    release(&ftable.lock);
+    return NULL;
   }
+  ftable.nfile++;
   release(&ftable.lock);
-  return NULL;
+
+  if((f = kmem_cache_alloc(ftable.cache)) == NULL){
+    acquire(&ftable.lock);
+    ftable.nfile--;
+    release(&ftable.lock);
+    return NULL;
+  }
+  memset(f, 0, sizeof(struct file));
+  f->ref = 1;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -82,7 +91,9 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  ftable.nfile--;
   release(&ftable.lock);
+  kmem_cache_free(ftable.cache, f);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -102,6 +102,7 @@ int             enext(struct dirent *dp, struct dirent *ep, uint off, int *count
 struct dirent*  ename(char *path);
 struct dirent*  enameparent(char *path, char *name);
 int             eread(struct dirent *entry, int user_dst, uint64 dst, uint off, uint n);
+int             ereadpage(struct dirent *entry, char *page, uint off);
 int             ewrite(struct dirent* entry, int user_src, uint64 src, uint off, uint n);
 
 int is_mounted(const struct dirent* de);
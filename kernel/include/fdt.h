@@ -0,0 +1,10 @@
+#ifndef __FDT_H
+#define __FDT_H
+
+#include "types.h"
+
+#define FDT_MAGIC 0xd00dfeed
+
+int             fdt_memory(uint64 dtb_pa, uint64 *base, uint64 *size);
+
+#endif
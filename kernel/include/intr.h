@@ -6,5 +6,6 @@
 
 void push_off(void);
 void pop_off(void);
+int intr_pushed(void);
 
 #endif
@@ -3,12 +3,41 @@
 
 #include "types.h"
 
+#define MAX_ORDER 10 // 伙伴系统的最高阶，最大连续块为 2^MAX_ORDER 页（4 MiB）
+
+// 物理页描述符，分配器管理的每个物理页对应一个
+struct page {
+  int refcnt;             // 引用计数，用于 COW，只能用 __atomic 内建函数访问
+  uint16 flags;           // PG_* 标志
+  signed char order;      // 伙伴系统中空闲块的块首记录其阶数，否则为 -1
+  struct page *lru_next;  // 回收链表（LRU）的链接，供页面回收使用
+  struct page *lru_prev;
+};
+
+#define PG_BUDDY  (1 << 0)  // 页是伙伴系统中空闲块的块首
+#define PG_SLAB   (1 << 1)  // 页被 slab 分配器使用
+#define PG_LRU    (1 << 2)  // 页在回收 LRU 链表上
+#define PG_CACHE  (1 << 3)  // 页在页缓存中，缓存持有它的一个引用
+
+extern uint64 phystop;  // 物理内存的结束地址
+
 void*           kalloc(void);
 void            kfree(void *);
-void            kinit(void);
+void*           kalloc_zeroed(void);
+int             kzero_refill(void);
+void*           kzeropage(void);
+int             is_zeropage(uint64 pa);
+void*           kalloc_pages(int order);
+void            kfree_pages(void *pa, int order);
+void            kinit(uint64 dtb_pa);
+int             kmem_reclaim_wanted(void);
 uint64          freemem_amount(void);
 uint64          allocated_pages(void);
+uint64          total_pages(void);
 void            incref(uint64 pa);
 int             getref(uint64 pa);
+void            kmemdump(void);
+struct page*    pa2page(uint64 pa);
+uint64          page2pa(struct page *page);
 
 #endif
\ No newline at end of file
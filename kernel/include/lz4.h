@@ -0,0 +1,12 @@
+#ifndef __LZ4_H
+#define __LZ4_H
+
+#include "types.h"
+
+#define LZ4_HASH_BITS   11  // 压缩时的哈希表有 2^11 项
+#define LZ4_TABLE_SIZE  (sizeof(ushort) << LZ4_HASH_BITS)  // 调用者提供的哈希表字节数
+
+int             lz4_compress(const uchar *src, int n, uchar *dst, int cap, ushort *table);
+int             lz4_decompress(const uchar *src, int n, uchar *dst, int cap);
+
+#endif
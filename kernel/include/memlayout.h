@@ -102,16 +102,19 @@
 #define KERNBASE                0x80200000
 #endif
 
+// default end of RAM, only used when no device tree is passed in;
+// the real end is read from the device tree into phystop at boot.
 #define PHYSTOP                 0x80600000
 
 // map the trampoline page to the highest address,
 // in both user and kernel space.
 #define TRAMPOLINE              (MAXVA - PGSIZE)
 
-// map kernel stacks beneath the trampoline,
-// each surrounded by invalid guard pages.
-// #define KSTACK(p)               (TRAMPOLINE - ((p) + 1) * 2 * PGSIZE)
+// map kernel stacks above VKSTACK in the kernel page table,
+// each preceded by an invalid guard page. they live in the
+// kernel half shared by every user page table.
 #define VKSTACK                 0x3EC0000000L
+#define KSTACK(p)               (VKSTACK + ((p) * 2 + 1) * PGSIZE)
 
 // User memory layout.
 // Address zero first:
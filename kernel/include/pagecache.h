@@ -0,0 +1,17 @@
+#ifndef __PAGECACHE_H
+#define __PAGECACHE_H
+
+#include "types.h"
+
+#define PAGECACHE_MAX_PERCENT  25  // 缓存的文件页不超过总页数的百分比
+
+struct dirent;
+
+void            pagecacheinit(void);
+char*           pagecache_get(struct dirent *ep, uint off);
+void            pagecache_invalidate(struct dirent *ep);
+int             pagecache_shrink(int nr);
+int             pagecache_owns(uint64 pa);
+void            pagecachedump(void);
+
+#endif
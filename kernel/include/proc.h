@@ -53,11 +53,16 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  int tlb_stale;              // ASID 代号翻转后置位，下次切换地址空间时整体刷新 TLB
+  uint64 nswitch;             // 切换到用户地址空间的次数
+  uint64 npageflush;          // 按地址刷新 TLB 的次数
+  uint64 nasidflush;          // 按 ASID 刷新 TLB 的次数
+  uint64 nfullflush;          // 整体刷新 TLB 的次数
 };
 
 extern struct cpu cpus[NCPU];
 
-enum procstate { UNUSED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
+enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
@@ -75,13 +80,20 @@ struct proc {
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
-  pagetable_t kpagetable;      // Kernel page table
+  uint64 asid;                 // 地址空间标识，写入 satp 的 ASID 字段
+  uint64 asid_gen;             // 分配 asid 时的代号，与当前代号不同则需重新分配
+  int asid_cpu;                // 最近一次运行该地址空间的 hart，-1 表示未运行过
   struct trapframe *trapframe; // data page for trampoline.S
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct dirent *cwd;          // Current directory
   char name[16];               // Process name (debugging)
   int tmask;                    // trace mask
+  int fault_around;             // 缺页时预映射的窗口页数，1 表示关闭
+  uint64 minflt;                // 由缺页处理直接建立映射的缺页次数（不含 COW）
+  uint64 flttime;               // 处理缺页（含 COW）累计用去的 rdtime 计数
+  int vm_busy;                  // 非 0 时正在修改自己的地址空间（缺页、mmap 等，其间可能睡眠），页面回收跳过该进程
+  struct proc *vm_owner;        // vfork 的子进程借用其地址空间的父进程，exec 或退出时交还
   
   #ifdef SCHEDULER_RR
   // RR 算法相关 PCB 数据结构扩展
@@ -108,10 +120,18 @@ struct proc {
   int max_page_in_mem;          // mmap 区域允许驻留的最大物理页数量
   int mmap_pages_in_mem;        // 当前 mmap 区域驻留物理页数量
   int swap_count;               // swap-out 次数统计
+  int ws_auto;                  // 非零时 max_page_in_mem 按工作集估计自动调整，set_max_page_in_mem 后为 0
+  int ws_estimate;              // 上一个窗口的工作集估计（页）
+  int ws_faults;                // 本窗口内 mmap 区域的缺页次数
+  int ws_refaults;              // 本窗口内从交换区换入的次数
+  uint64 ws_window;             // 本窗口开始的时刻
+  #ifdef ALGO_CLOCK
+  uint64 clock_scan;            // 上次采样 mmap 驻留页访问位的时刻
+  #endif
   #endif
 
   // vma 相关
-  struct vma vmas[NVMA];
+  struct vma_tree vmas;
 };
 
 void            reg_info(void);
@@ -119,6 +139,8 @@ int             cpuid(void);
 void            exit(int);
 int             fork(void);
 int             clone(void);
+int             vfork(void);
+void            vfork_release(struct proc *);
 int             growproc(int);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
@@ -0,0 +1,13 @@
+#ifndef __RECLAIM_H
+#define __RECLAIM_H
+
+#include "types.h"
+
+#define RECLAIM_BATCH 32  // 每次回收的页数上限
+
+void            reclaiminit(void);
+int             reclaim_direct(void);
+int             kreclaimd(void);
+void            reclaimdump(void);
+
+#endif
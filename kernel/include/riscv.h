@@ -43,6 +43,8 @@ w_mepc(uint64 x)
 
 // Supervisor Status Register, sstatus
 
+#define SSTATUS_SUM (1L << 18) // Supervisor may access User pages
+#define SSTATUS_VS_INITIAL (1L << 9) // Vector unit on, state Initial (V extension)
 #define SSTATUS_SPP (1L << 8)  // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5) // Supervisor Previous Interrupt Enable
 #define SSTATUS_UPIE (1L << 4) // User Previous Interrupt Enable
@@ -189,6 +191,15 @@ w_mtvec(uint64 x)
 
 #define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
 
+// satp 的 ASID 字段位于 [59:44]，Sv39 下最多 16 位
+#define SATP_ASID_SHIFT 44
+#define SATP_ASID_MASK  0xFFFFL
+#define SATP_PPN_MASK   ((1L << 44) - 1)
+#define MAKE_SATP_ASID(pagetable, asid) \
+  (MAKE_SATP(pagetable) | (((uint64)(asid) & SATP_ASID_MASK) << SATP_ASID_SHIFT))
+#define SATP2ASID(satp) (((satp) >> SATP_ASID_SHIFT) & SATP_ASID_MASK)
+#define SATP2PA(satp)   (((satp) & SATP_PPN_MASK) << 12)
+
 // supervisor address translation and protection;
 // holds the address of the page table.
 static inline void 
@@ -333,6 +344,20 @@ sfence_vma()
   asm volatile("sfence.vma");
 }
 
+// flush all non-global TLB entries tagged with asid.
+static inline void
+sfence_vma_asid(uint64 asid)
+{
+  asm volatile("sfence.vma zero, %0" : : "r" (asid) : "memory");
+}
+
+// flush the TLB entries for va tagged with asid (global entries included).
+static inline void
+sfence_vma_addr(uint64 va, uint64 asid)
+{
+  asm volatile("sfence.vma %0, %1" : : "r" (va), "r" (asid) : "memory");
+}
+
 
 #define PGSIZE 4096 // bytes per page
 #define PGSHIFT 12  // bits of offset within a page
@@ -340,11 +365,19 @@ sfence_vma()
 #define PGROUNDUP(sz)  (((sz)+PGSIZE-1) & ~(PGSIZE-1))
 #define PGROUNDDOWN(a) (((a)) & ~(PGSIZE-1))
 
+// Sv39 level-1 叶子页表项映射的大页（megapage）
+#define SUPERPGSIZE  (1L << 21) // 2 MiB
+#define SUPERPGORDER 9          // 一个大页包含 2^9 个普通页
+#define SUPERPGROUNDDOWN(a) (((a)) & ~(SUPERPGSIZE-1))
+
 #define PTE_V (1L << 0) // valid
 #define PTE_R (1L << 1)
 #define PTE_W (1L << 2)
 #define PTE_X (1L << 3)
 #define PTE_U (1L << 4) // 1 -> user can access
+#define PTE_G (1L << 5) // global: 所有地址空间共享，不受 ASID 区分
+#define PTE_A (1L << 6) // accessed: 访问过该页
+#define PTE_D (1L << 7) // dirty: 写入过该页
 #define PTE_COW (1L << 8) // COW 写时复制标志
 
 // shift a physical address to the right place for a PTE.
@@ -354,11 +387,18 @@ sfence_vma()
 
 #define PTE_FLAGS(pte) ((pte) & 0x3FF)
 
+// R/W/X 任一位被置位的有效页表项是叶子，否则指向下一级页表
+#define PTE_LEAF(pte) (((pte) & (PTE_R|PTE_W|PTE_X)) != 0)
+
 // extract the three 9-bit page table indices from a virtual address.
 #define PXMASK          0x1FF // 9 bits
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
 #define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
 
+// 第 level 级页表项覆盖的地址范围大小，以及按该范围向下对齐
+#define LEVELSIZE(level) (1L << PXSHIFT(level))
+#define LEVELROUNDDOWN(a, level) (((a)) & ~(LEVELSIZE(level)-1))
+
 // one beyond the highest possible virtual address.
 // MAXVA is actually one bit less than the max allowed by
 // Sv39, to avoid having to sign-extend virtual addresses
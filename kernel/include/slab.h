@@ -0,0 +1,45 @@
+#ifndef __SLAB_H
+#define __SLAB_H
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+
+#define KMEM_CACHE_MAX   16   // 系统中最多的对象缓存个数
+#define KMEM_CACHE_NAME  16   // 对象缓存名字的最大长度（含结尾 0）
+#define SLAB_CPU_LIMIT   16   // 每个 CPU 缓存的空闲对象上限
+#define SLAB_CPU_BATCH   8    // 每个 CPU 缓存批量补充 / 归还的对象数
+
+// 每个 CPU 私有的空闲对象缓存，只在关中断时由本 CPU 访问
+struct kmem_cache_cpu {
+  void *objs[SLAB_CPU_LIMIT];
+  int avail;          // objs 中的空闲对象数
+  uint64 alloc;       // kmem_cache_alloc 总次数
+  uint64 alloc_hit;   // 直接命中本 CPU 缓存的次数
+  uint64 free;        // kmem_cache_free 总次数
+};
+
+// 一类固定大小内核对象的缓存
+// 每个 slab 是一个物理页，页首是 struct slab，其后紧跟 num 个对象
+struct kmem_cache {
+  char name[KMEM_CACHE_NAME];
+  uint size;          // 按对齐要求向上取整后的对象大小
+  uint num;           // 每个 slab 能容纳的对象数
+  uint offset;        // 第一个对象相对页首的偏移
+  struct spinlock lock; // 保护 slab 链表及下面的计数
+  struct slab *partial; // 还有空闲对象的 slab
+  struct slab *full;    // 对象全部分配出去的 slab
+  uint nslabs;        // slab（物理页）总数
+  uint inuse;         // 从 slab 中取出的对象数（含各 CPU 缓存中的对象）
+  struct kmem_cache_cpu cpu[NCPU];
+};
+
+void                kmem_cache_init(void);
+struct kmem_cache*  kmem_cache_create(char *name, uint size, uint align);
+void*               kmem_cache_alloc(struct kmem_cache *c);
+void                kmem_cache_free(struct kmem_cache *c, void *obj);
+void*               kmalloc(uint size);
+void                kmfree(void *obj);
+void                kmem_cache_dump(void);
+
+#endif
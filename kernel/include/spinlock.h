@@ -19,6 +19,10 @@ void initlock(struct spinlock*, char*);
 // Must be used with release()
 void acquire(struct spinlock*);
 
+// Try to acquire the spinlock without spinning
+// Returns 1 on success, 0 if it is already held
+int tryacquire(struct spinlock*);
+
 // Release the spinlock 
 // Must be used with acquire()
 void release(struct spinlock*);
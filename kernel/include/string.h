@@ -14,5 +14,8 @@ void            wnstr(wchar *dst, char const *src, int len);
 void            snstr(char *dst, wchar const *src, int len);
 int             wcsncmp(wchar const *s1, wchar const *s2, int len);
 char*           strchr(const char *s, char c);
+void            copy_page(void *dst, const void *src);
+void            clear_page(void *dst);
+void            strbench(void);
 
 #endif
\ No newline at end of file
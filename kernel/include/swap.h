@@ -0,0 +1,31 @@
+#ifndef __SWAP_H
+#define __SWAP_H
+
+#include "types.h"
+
+struct dirent;
+
+// 换出页的位置，0 表示没有。最低位为 1 时其余位是交换文件中的槽位号；
+// 最低两位为 10 时其余位是压缩区中的对象句柄；最低两位为 00 时是保存页内容的内核页地址
+// （压缩率太差且没有可用的交换文件时退回到内存中保存）
+typedef uint64 swp_entry_t;
+
+#define SWP_ONDISK(e)     ((e) & 1)
+#define SWP_SLOT(e)       ((uint)((e) >> 1))
+#define SWP_ENTRY(slot)   (((uint64)(slot) << 1) | 1)
+#define SWP_ZRAM(e)       (((e) & 3) == 2)
+#define SWP_ZHANDLE(e)    ((e) >> 2)
+#define SWP_ZENTRY(h)     (((uint64)(h) << 2) | 2)
+#define SWP_INMEM(e)      ((e) != 0 && ((e) & 3) == 0)
+
+void            swapinit(void);
+int             swapon(struct dirent *ep);
+swp_entry_t     swap_out(char *page);
+char*           swap_in(swp_entry_t e);
+int             swap_read(swp_entry_t e, char *dst);
+swp_entry_t     swap_dup(swp_entry_t e);
+void            swap_free(swp_entry_t e);
+int             swap_avail(void);
+void            swapdump(void);
+
+#endif
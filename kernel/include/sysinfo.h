@@ -8,5 +8,16 @@ struct sysinfo {
   uint64 nproc;     // number of process
 };
 
+// get_ws_info 为每个进程返回的 mmap 驻留预算与工作集信息
+struct wsinfo {
+  int pid;
+  int budget;       // mmap 区域允许驻留的页数
+  int resident;     // mmap 区域当前驻留的页数
+  int estimate;     // 上一个窗口的工作集估计（页）
+  int swaps;        // 换出次数
+  int automatic;    // 预算是否由系统自动调整
+  char name[16];
+};
+
 
 #endif
@@ -46,6 +46,7 @@
 #define SYS_set_timeslice 400 // RR 算法：设置当前进程的时间片
 #define SYS_set_priority 401  // PRIORITY / MLFQ 算法：设置当前进程的优先级
 #define SYS_get_priority 402  // PRIORITY / MLFQ 算法：获取当前进程的优先级
+#define SYS_vfork      403   // 创建共享父进程地址空间的子进程，父进程等到子进程 exec 或退出
 
 
 // Memory management related (内存管理相关)
@@ -53,11 +54,19 @@
 #define SYS_brk        214   // 直接设置程序数据段的结束地址
 #define SYS_munmap     215   // 释放内存映射
 #define SYS_mmap       222   // 映射文件或设备到内存
+#define SYS_swapon     224   // 启用交换文件
+#define SYS_msync      227   // 将共享文件映射中的脏页写回文件
 #define SYS_getprocsz  500   // 获取进程的内存使用情况
 #define SYS_getpgcnt   501   // 获取当前已分配物理内存的页数
+#define SYS_memstat    502   // 打印内核物理内存分配器的统计信息
+#define SYS_faultaround 503  // 设置缺页预映射窗口的页数
+#define SYS_getminflt  504   // 获取当前进程的缺页次数
+#define SYS_strbench   505   // 测量内核内存原语的吞吐量并打印
+#define SYS_getflttime 506   // 获取当前进程处理缺页所用的时间
 #define SYS_set_max_page_in_mem 600 // 设置最大物理页数
 #define SYS_get_swap_count 601 // 获取交换次数
 #define SYS_lru_access_notify 602 // 通知LRU页面替换算法
+#define SYS_get_ws_info 603 // 获取各进程的驻留预算与工作集估计
 
 
 // Others (其他)
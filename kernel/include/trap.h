@@ -53,8 +53,17 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+struct proc;
+
 void            trapinithart(void);
 void            usertrapret(void);
 void            trapframedump(struct trapframe *tf);
+int             fault_in_page(uint64 va, int write);
+void            fault_in_range(uint64 addr, uint64 n, int write);
+
+#ifdef ALGO
+struct swap_victim;
+int             select_victim_page(struct proc *p, struct swap_victim *victim);
+#endif
 
 #endif
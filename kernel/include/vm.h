@@ -3,12 +3,13 @@
 
 #include "types.h"
 #include "riscv.h"
+#include "swap.h"
 
 // 前向声明
 struct proc;
 
 #ifdef ALGO
-#define VMA_MAX_TRACKED_PAGES 128
+#define VMA_DEFAULT_RESIDENT_PAGES 128  // mmap 区域默认的驻留页预算
 
 enum mmap_page_state {
   VMA_PAGE_UNUSED = 0,
@@ -18,37 +19,69 @@ enum mmap_page_state {
 
 struct mmap_vpage {
   int state;
+  int dirty;                // 换出时页表项带 PTE_D，换入后需继续视为脏页
   uint64 load_time;
   uint64 last_access;
-  char *swap_data;
+  swp_entry_t swap;         // 换出位置，只在 VMA_PAGE_SWAPPED 时有效
+};
+
+// 页追踪信息按块分配：每块一页，覆盖 VPAGE_CHUNK 个按块大小对齐的虚拟页，第一次用到时才分配。
+// VMA 只保存块指针目录，大小与映射长度无关地可伸缩，拆分时整块移交
+#define VPAGE_CHUNK     (PGSIZE / sizeof(struct mmap_vpage))
+#define VPAGE_CHUNKNO(va)  (((va) >> PGSHIFT) / VPAGE_CHUNK)
+
+// 置换算法选出的受害者页
+struct swap_victim {
+  struct vma* v;
+  struct mmap_vpage* page;
+  uint64 va;
 };
 
 #endif
 
+// TLB 刷新批次：收集一段操作中修改过的用户地址，结束时一次性刷新。
+// 地址不超过 TLB_BATCH_MAX 个时逐个按地址刷新，否则按 ASID 整体刷新
+#define TLB_BATCH_MAX 32
+
+struct tlb_batch {
+  pagetable_t pagetable;      // 被修改的用户页表
+  int n;                      // 已记录的地址数，可以超过 TLB_BATCH_MAX
+  uint64 va[TLB_BATCH_MAX];
+};
+
 void            kvminit(void);
 void            kvminithart(void);
+void            asidinit(void);
+void            switchuvm(struct proc *p);
+void            switchkvm(void);
+void            uvmflushpage(pagetable_t, uint64);
+void            uvmflushall(pagetable_t);
+void            tlbdump(void);
+void            tlb_batch_init(struct tlb_batch *, pagetable_t);
+void            tlb_batch_add(struct tlb_batch *, uint64);
+void            tlb_batch_flush(struct tlb_batch *);
 uint64          kvmpa(uint64);
 void            kvmmap(uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
 pagetable_t     uvmcreate(void);
 // void            uvminit(pagetable_t, uchar *, uint);
-void            uvminit(pagetable_t, pagetable_t, uchar *, uint);
-uint64          uvmalloc(pagetable_t, pagetable_t, uint64, uint64);
-uint64          uvmdealloc(pagetable_t, pagetable_t, uint64, uint64);
-// int             uvmcopy(pagetable_t, pagetable_t, uint64);
-int             uvmcopy(pagetable_t, pagetable_t, pagetable_t, uint64);
+void            uvminit(pagetable_t, uchar *, uint);
+uint64          uvmalloc(pagetable_t, uint64, uint64);
+uint64          uvmdealloc(pagetable_t, uint64, uint64);
+int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 // void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            vmunmap(pagetable_t, uint64, uint64, int);
-void            uvmclear(pagetable_t, uint64);
+int             uvmclear(pagetable_t, uint64);
 uint64          walkaddr(pagetable_t, uint64);
+int             uvmcheck(pagetable_t, uint64, int);
 pte_t*          walk(pagetable_t, uint64, int);
+pte_t*          walkpte(pagetable_t, uint64, int, int, int*);
+int             superpage_unmapped(pagetable_t, uint64);
+int             splitsuperpage(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
 int             copyinstr(pagetable_t, char *, uint64, uint64);
-pagetable_t     proc_kpagetable(void);
-void            kvmfreeusr(pagetable_t kpt);
-void            kvmfree(pagetable_t kpagetable, int stack_free);
 uint64          kwalkaddr(pagetable_t pagetable, uint64 va);
 int             copyout2(uint64 dstva, char *src, uint64 len);
 int             copyin2(char *dst, uint64 srcva, uint64 len);
@@ -57,8 +90,6 @@ void            vmprint(pagetable_t pagetable);
 int             cow_make_writable(struct proc *p, uint64 va);
 
 // vma （virtual memory area） 相关函数和宏定义
-#define NVMA 16
-
 #define PROT_READ       (1 << 0)
 #define PROT_WRITE      (1 << 1)
 #define PROT_EXEC       (1 << 2)
@@ -68,8 +99,11 @@ int             cow_make_writable(struct proc *p, uint64 va);
 #define MAP_SHARED      0x04
 #define MAP_FIXED       0x08
 
+#define MS_ASYNC        1
+#define MS_INVALIDATE   2
+#define MS_SYNC         4
+
 struct vma {
-    int valid;              // 是否有效
     uint64 start;           // 起始地址
     uint64 end;             // 结束地址
     int prot;               // 内存区域的访问权限，PROT_*
@@ -78,16 +112,51 @@ struct vma {
     uint64 offset;          // 文件偏移量，只有文件映射时有效
 
     #ifdef ALGO
-    int page_count;         // VMA 覆盖的页数量
-    struct mmap_vpage *pages; // 指向跟踪 mmap 页信息的数组
+    struct mmap_vpage **pages; // 页追踪块目录，第 i 项是 VMA 起始所在块之后的第 i 块，未分配为 NULL
+    int nchunk;             // 目录项数，VMA 被拆分缩小后可能多于实际覆盖的块数
     #endif
+
+    // 以下由 vma.c 维护
+    struct vma *left;       // AVL 树左右孩子，按 start 排序
+    struct vma *right;
+    struct vma *prev;       // 按地址排序的双向链表
+    struct vma *next;
+    int height;             // AVL 子树高度
+    uint64 gap;             // 与前一个 VMA 之间的空闲间隙大小（最低的 VMA 从 0 算起）
+    uint64 max_gap;         // 子树中最大的 gap，用于查找空闲区域时剪枝
 };
 
+// 进程的 VMA 索引，数量不设上限
+struct vma_tree {
+    struct vma *root;       // AVL 树根
+    struct vma *first;      // 地址最低的 VMA，沿 next 按地址升序遍历
+    struct vma *last;       // 地址最高的 VMA
+    int count;              // VMA 个数
+};
+
+void vmainit(void);
+struct vma* vma_alloc(void);
+void vma_release(struct vma* v);
+void vma_tree_init(struct vma_tree* t);
+int vma_insert(struct vma_tree* t, struct vma* v);
+void vma_remove(struct vma_tree* t, struct vma* v);
+struct vma* vma_find(struct vma_tree* t, uint64 addr);
+struct vma* vma_ceil(struct vma_tree* t, uint64 addr);
+uint64 vma_find_gap(struct vma_tree* t, uint64 len, uint64 lo, uint64 hi);
+
 void vma_writeback(struct proc* p, struct vma* v);
+int vma_sync(struct proc* p, struct vma* v, uint64 start, uint64 end);
+int uvmmarkaccess(pagetable_t pagetable, uint64 va, int write);
+void vma_unmap(struct proc* p, struct vma* v);
+int vma_unmap_range(struct proc* p, uint64 start, uint64 end);
 void vma_free(struct proc* p);
-uint64 mmap_find_addr(struct proc* p, uint64 len);
+int vma_reclaim_clean(struct proc* p, int nr, int* ncached);
+uint64 mmap_find_addr(struct proc* p, uint64 hint, uint64 len);
+uint64 mmap_lowest(struct proc* p);
 
 #ifdef ALGO
+int vma_pages_init(struct vma* v);
+struct mmap_vpage* vma_vpage(struct vma* v, uint64 va, int alloc);
 void vma_reset_pages(struct proc* p, struct vma* v);
 #endif
 
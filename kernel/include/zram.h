@@ -0,0 +1,16 @@
+#ifndef __ZRAM_H
+#define __ZRAM_H
+
+#include "types.h"
+
+#define ZRAM_MAX_PERCENT  25  // 压缩区占用的物理页不超过总页数的百分比
+
+void            zraminit(void);
+int             zram_store(char *page, uint64 *handle);
+int             zram_load(uint64 handle, char *dst);
+uint64          zram_dup(uint64 handle);
+void            zram_free(uint64 handle);
+int             zram_room(void);
+void            zramdump(void);
+
+#endif
@@ -38,3 +38,17 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
+
+// Whether this CPU is inside push_off(), which is always
+// the case while holding a spinlock. Code that may sleep
+// must not run then: sched() allows no lock but p->lock.
+int
+intr_pushed(void)
+{
+  int n;
+
+  push_off();
+  n = mycpu()->noff;
+  pop_off();
+  return n > 1;
+}
@@ -11,50 +11,275 @@
 #include "include/kalloc.h"
 #include "include/string.h"
 #include "include/printf.h"
+#include "include/intr.h"
+#include "include/proc.h"
+#include "include/fdt.h"
 
-#define MAX_PHYS_PAGES (PHYSTOP / PGSIZE) // 物理内存页数最大值
+
+// 每个 CPU 的空闲页缓存（magazine）参数
+// kalloc/kfree 优先在本 CPU 的缓存上进行，只有缓存空或满时才批量访问全局伙伴系统
+#define PCP_HIGH  64  // 单个 CPU 缓存的页数上限，超过后批量归还伙伴系统
+#define PCP_BATCH 16  // 每次从伙伴系统批量补充 / 向伙伴系统批量归还的页数
+
+// 预清零页池参数
+// 空闲的 CPU 在进入 wfi 之前把空闲页清零放入池中，kalloc_zeroed 直接取用，缺页路径上不再需要清零
+#define ZPOOL_HIGH    64   // 池中页数上限
+#define ZPOOL_BATCH   8    // 每次空闲时最多清零的页数，避免长时间推迟调度
+#define ZPOOL_RESERVE 256  // 伙伴系统与各 CPU 缓存中的空闲页少于该值时不再补充，把内存留给普通分配
+
+// 页面回收水位
+// 伙伴系统中的空闲页低于 WMARK_LOW 时请求后台回收，空闲页（含各 CPU 缓存）回到 WMARK_HIGH 后停止
+#define WMARK_LOW   64
+#define WMARK_HIGH  128
+
+// 伙伴系统中不是空闲块块首的页在 page->order 中的取值
+#define ORDER_NONE (-1)
+
+#ifdef REFCNT_LOCK
+// 对照构建（make REFLOCK=1）：引用计数的读写都经过一把全局自旋锁，即改用原子操作之前的做法，
+// 用 forkbench 比较两种实现，尤其是两个 hart 同时 fork 时的争用
+static struct spinlock reflock;
+#define REF_LOCK()    acquire(&reflock)
+#define REF_UNLOCK()  release(&reflock)
+#else
+#define REF_LOCK()
+#define REF_UNLOCK()
+#endif
 
 void freerange(void *pa_start, void *pa_end);
 
 extern char kernel_end[]; // first address after kernel.
 
+// 物理内存的结束地址，kinit 时根据设备树的 /memory 节点确定，解析失败时退回 PHYSTOP
+uint64 phystop = PHYSTOP;
+
+// 空闲页内嵌的链表节点
+// 伙伴系统的空闲链表需要 O(1) 摘除任意块（合并伙伴时），因此是带哨兵的双向循环链表；
+// 各 CPU 缓存只使用 next 组成单链表
 struct run {
   struct run *next;
+  struct run *prev;
 };
 
-struct {
+// 伙伴系统中某一阶的空闲块链表
+struct free_area {
+  struct run head;  // 哨兵节点
+  uint64 nr_free;   // 该阶空闲块数
+};
+
+// 每个 CPU 私有的空闲页缓存
+// 平时只有本 CPU 在关中断时访问，lock 几乎不会发生争用；只有内存耗尽时其它 CPU 才会来"偷"页
+struct kmem_pcp {
   struct spinlock lock;
-  struct run *freelist;
-  uint64 freepages; // 空闲页数
-  uint64 totalpages; // 总分配物理页数（包括空闲页），小于等于 MAX_PHYS_PAGES
-  int refcnt[MAX_PHYS_PAGES]; // 引用计数，用于 COW
+  struct run *list;   // 本 CPU 缓存的空闲页链表
+  int count;          // 缓存中的页数
+  uint64 alloc;       // kalloc 总次数
+  uint64 alloc_hit;   // 直接命中本 CPU 缓存的 kalloc 次数
+  uint64 free;        // 真正归还物理页的 kfree 次数
+  uint64 refill;      // 从伙伴系统批量补充的次数
+  uint64 drain;       // 向伙伴系统批量归还的次数
+  uint64 steal;       // 伙伴系统耗尽时从其它 CPU 缓存取页的次数
+};
+
+struct {
+  struct spinlock lock; // 保护伙伴系统的 free_area、order 与 freepages
+  struct free_area area[MAX_ORDER + 1]; // 每一阶的空闲块链表
+  struct page *pages; // 页描述符数组，在 kinit 时从 kernel_end 之后划出，pages[i] 描述物理页号 base_pfn + i
+  uint64 base_pfn; // 分配器管理的第一个物理页号
+  uint64 end_pfn;  // 分配器管理的最后一个物理页号 + 1
+  uint64 freepages; // 伙伴系统中的空闲页数（不含各 CPU 缓存）
+  uint64 totalpages; // 总分配物理页数（包括空闲页），等于 end_pfn - base_pfn
+  int reclaim;      // 空闲页跌破低水位后置 1，回到高水位后清 0；只用原子操作访问
+  uint64 nlow;      // 跌破低水位的次数
+  struct kmem_pcp pcp[NCPU]; // 每个 CPU 的空闲页缓存
 } kmem;
 
+// 预清零页池
+// 池中的页引用计数为 0，视为空闲页；只有页首的链表指针不为 0，取出时单独清零
+struct {
+  struct spinlock lock;
+  struct run *list;
+  int count;          // 池中的页数
+  uint64 hit;         // kalloc_zeroed 命中池的次数
+  uint64 miss;        // kalloc_zeroed 未命中、当场清零的次数
+  uint64 hit_ticks;   // 命中时 kalloc_zeroed 的总耗时（rdtime 计数）
+  uint64 miss_ticks;  // 未命中时 kalloc_zeroed 的总耗时
+  uint64 refill;      // 空闲时补充的页数
+} zpool;
+
+// 共享零页：内容始终为 0，匿名私有内存与堆的读缺页都映射到这一页，只读，写入前经写时复制换成私有页
+static char *zeropage;
+
+static void buddy_free(uint64 pfn, int order);
+static int pcp_refill(struct kmem_pcp *pcp);
+static void pcp_drain(struct kmem_pcp *pcp, int n);
+static struct run *pcp_steal(struct kmem_pcp *self);
+static struct run *zpool_get(void);
+static void zpool_drain(void);
+static uint64 count_freepages(void);
+
+/**
+ * @brief 获取物理页号对应的页描述符
+ * @param pfn 物理页号，要求位于 [base_pfn, end_pfn) 内
+ * @return 页描述符
+ */
+static inline struct page *
+pfn2page(uint64 pfn)
+{
+  return &kmem.pages[pfn - kmem.base_pfn];
+}
+
 /**
- * @brief 将物理地址转换为 refcnt 索引
- * @param pa 物理地址，要求必须对齐到 PGSIZE
- * @return refcnt 数组的索引
+ * @brief 获取物理地址对应的页描述符
+ * @param pa 物理地址，要求必须对齐到 PGSIZE，且位于分配器管理的范围内
+ * @return 页描述符
  */
-static inline int
-pa2index(uint64 pa)
+struct page *
+pa2page(uint64 pa)
 {
+  uint64 pfn = pa >> PGSHIFT;
   if(pa % PGSIZE)
-    panic("pa2index");
-  if(pa >= PHYSTOP)
-    panic("pa2index");
-  return pa >> PGSHIFT;
+    panic("pa2page");
+  if(pfn < kmem.base_pfn || pfn >= kmem.end_pfn)
+    panic("pa2page");
+  return pfn2page(pfn);
 }
 
+/**
+ * @brief 获取页描述符对应的物理地址
+ * @param page 页描述符
+ * @return 物理地址
+ */
+uint64
+page2pa(struct page *page)
+{
+  return (kmem.base_pfn + (page - kmem.pages)) << PGSHIFT;
+}
+
+static inline struct run *
+pfn2run(uint64 pfn)
+{
+  return (struct run *)(pfn << PGSHIFT);
+}
+
+static inline void
+area_add(int order, uint64 pfn)
+{
+  struct free_area *area = &kmem.area[order];
+  struct run *r = pfn2run(pfn);
+  r->next = area->head.next;
+  r->prev = &area->head;
+  area->head.next->prev = r;
+  area->head.next = r;
+  area->nr_free++;
+  pfn2page(pfn)->order = order;
+  pfn2page(pfn)->flags |= PG_BUDDY;
+}
+
+static inline void
+area_del(int order, uint64 pfn)
+{
+  struct run *r = pfn2run(pfn);
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  kmem.area[order].nr_free--;
+  pfn2page(pfn)->order = ORDER_NONE;
+  pfn2page(pfn)->flags &= ~PG_BUDDY;
+}
+
+/**
+ * @brief 从伙伴系统中分配一个 2^order 页的块
+ * @param order 块的阶数
+ * @return 块首的物理页号，0 表示没有足够大的空闲块
+ * @note 调用者必须持有 kmem.lock；找不到恰好的阶时拆分更大的块，拆下的另一半挂回低一阶
+ */
+static uint64
+buddy_alloc(int order)
+{
+  int k;
+  uint64 pfn;
+
+  for (k = order; k <= MAX_ORDER; k++)
+    if (kmem.area[k].nr_free > 0)
+      break;
+  if (k > MAX_ORDER)
+    return 0;
+
+  pfn = (uint64)kmem.area[k].head.next >> PGSHIFT;
+  area_del(k, pfn);
+  while (k > order) {
+    k--;
+    area_add(k, pfn + (1UL << k));
+  }
+  kmem.freepages -= 1UL << order;
+  return pfn;
+}
+
+/**
+ * @brief 将一个 2^order 页的块归还伙伴系统，并尽可能与伙伴合并
+ * @param pfn 块首的物理页号，必须按 2^order 页对齐
+ * @param order 块的阶数
+ * @note 调用者必须持有 kmem.lock；伙伴按物理页号计算（pfn ^ 2^order），保证合并后的块物理对齐
+ */
+static void
+buddy_free(uint64 pfn, int order)
+{
+  kmem.freepages += 1UL << order;
+  while (order < MAX_ORDER) {
+    uint64 buddy = pfn ^ (1UL << order);
+    if (buddy < kmem.base_pfn || buddy >= kmem.end_pfn)
+      break;
+    if (pfn2page(buddy)->order != order)
+      break;
+    area_del(order, buddy);
+    if (buddy < pfn)
+      pfn = buddy;
+    order++;
+  }
+  area_add(order, pfn);
+}
+
+/**
+ * @brief 初始化物理页分配器
+ * @param dtb_pa 设备树的物理地址，用于确定物理内存大小
+ * @note 设备树只在这里读取一次，之后它所在的页和其它空闲页一样交给分配器
+ */
 void
-kinit()
+kinit(uint64 dtb_pa)
 {
+  uint64 base, size;
+
   initlock(&kmem.lock, "kmem");
-  kmem.freelist = 0;
+  memset(kmem.pcp, 0, sizeof(kmem.pcp));
+  for (int i = 0; i < NCPU; i++)
+    initlock(&kmem.pcp[i].lock, "kmem_pcp");
+  for (int i = 0; i <= MAX_ORDER; i++) {
+    kmem.area[i].head.next = kmem.area[i].head.prev = &kmem.area[i].head;
+    kmem.area[i].nr_free = 0;
+  }
   kmem.freepages = 0;
   kmem.totalpages = 0;
-  freerange(kernel_end, (void*)PHYSTOP);
+  initlock(&zpool.lock, "zpool");
+  #ifdef REFCNT_LOCK
+  initlock(&reflock, "reflock");
+  #endif
+
+  if (fdt_memory(dtb_pa, &base, &size) == 0 && base + size > (uint64)kernel_end) {
+    phystop = PGROUNDDOWN(base + size);
+    // 直接映射不能覆盖内核栈和设备所在的高地址区域
+    if (phystop > VKSTACK)
+      phystop = VKSTACK;
+    printf("memory: %d MiB at %p detected from device tree\n", (int)(size >> 20), base);
+  } else {
+    printf("memory: no device tree, assuming phystop %p\n", (void*)PHYSTOP);
+  }
+  freerange(kernel_end, (void*)phystop);
+  // 这里持有的引用永不释放，零页不会随最后一个映射的解除而回到分配器
+  if ((zeropage = kalloc()) == 0)
+    panic("kinit: zero page");
+  clear_page(zeropage);
   #ifdef DEBUG
-  printf("kernel_end: %p, phystop: %p\n", kernel_end, (void*)PHYSTOP);
+  printf("kernel_end: %p, phystop: %p\n", kernel_end, (void*)phystop);
   printf("kinit\n");
   #endif
 }
@@ -63,13 +288,128 @@ void
 freerange(void *pa_start, void *pa_end)
 {
   char *p;
-  p = (char*)PGROUNDUP((uint64)pa_start);
-  for (; p + PGSIZE <= (char*)pa_end; p += PGSIZE) {
-    // 现在在初始阶段会计数总分配物理页数，并调用 incref 增加引用计数（对于 COW 来说，这里就是设置为 1）
+  uint64 start = PGROUNDUP((uint64)pa_start);
+  uint64 end = PGROUNDDOWN((uint64)pa_end);
+
+  // 页描述符数组放在 pa_start 之后，只覆盖其后真正交给分配器的页
+  // 数组大小按 [start, end) 的页数估算，略多出的几个描述符不会被使用
+  kmem.pages = (struct page *)start;
+  start = PGROUNDUP(start + (end - start) / PGSIZE * sizeof(struct page));
+  kmem.base_pfn = start >> PGSHIFT;
+  kmem.end_pfn = end >> PGSHIFT;
+  for (uint64 pfn = kmem.base_pfn; pfn < kmem.end_pfn; pfn++) {
+    struct page *page = pfn2page(pfn);
+    memset(page, 0, sizeof(*page));
+    page->order = ORDER_NONE;
+  }
+
+  // 初始化阶段直接逐页放入伙伴系统，由 buddy_free 自动合并成尽可能大的块
+  // 不经过 kfree，避免这些页全部堆积在 hart 0 的缓存里
+  acquire(&kmem.lock);
+  for (p = (char*)start; p + PGSIZE <= (char*)end; p += PGSIZE) {
+    // 现在在初始阶段会计数总分配物理页数
     kmem.totalpages++;
-    incref((uint64)p);
-    kfree(p);
+    #ifdef DEBUG
+    memset(p, 1, PGSIZE);
+    #endif
+    buddy_free((uint64)p >> PGSHIFT, 0);
+  }
+  release(&kmem.lock);
+
+  // 与按 phystop 从物理地址 0 开始索引的 int 引用计数表相比节省的内存
+  uint64 desc = start - (uint64)kmem.pages;
+  uint64 table = phystop / PGSIZE * sizeof(int);
+  printf("kmem: %d pages managed, page descriptors use %d KiB, %d KiB reclaimed from the refcnt table\n",
+         (int)kmem.totalpages, (int)(desc >> 10), (int)((table - desc) >> 10));
+}
+
+/**
+ * @brief 从伙伴系统批量取出至多 PCP_BATCH 页补充到本 CPU 缓存
+ * @param pcp 本 CPU 的缓存，调用者必须持有 pcp->lock
+ * @return 实际补充的页数，0 表示伙伴系统已空
+ */
+static int
+pcp_refill(struct kmem_pcp *pcp)
+{
+  int n = 0;
+  uint64 pfn;
+  acquire(&kmem.lock);
+  while (n < PCP_BATCH && (pfn = buddy_alloc(0)) != 0) {
+    struct run *r = pfn2run(pfn);
+    r->next = pcp->list;
+    pcp->list = r;
+    n++;
+  }
+  // 只在批量补充这条慢路径上检查水位，kalloc 的快速路径不受影响
+  if (kmem.freepages < WMARK_LOW && !kmem.reclaim) {
+    __atomic_store_n(&kmem.reclaim, 1, __ATOMIC_RELAXED);
+    kmem.nlow++;
+  }
+  release(&kmem.lock);
+  pcp->count += n;
+  if (n > 0)
+    pcp->refill++;
+  return n;
+}
+
+/**
+ * @brief 将本 CPU 缓存中的 n 页批量归还伙伴系统
+ * @param pcp 本 CPU 的缓存，调用者必须持有 pcp->lock
+ * @param n 归还的页数
+ */
+static void
+pcp_drain(struct kmem_pcp *pcp, int n)
+{
+  struct run *head, *tail;
+  int i;
+
+  if (n > pcp->count)
+    n = pcp->count;
+  if (n <= 0)
+    return;
+  // 先在锁外把要归还的 n 页从缓存链表上摘下来，持锁时只做合并
+  head = tail = pcp->list;
+  for (i = 1; i < n; i++)
+    tail = tail->next;
+  pcp->list = tail->next;
+  tail->next = 0;
+  pcp->count -= n;
+
+  acquire(&kmem.lock);
+  while (head) {
+    struct run *r = head;
+    head = r->next;
+    buddy_free((uint64)r >> PGSHIFT, 0);
+  }
+  release(&kmem.lock);
+  pcp->drain++;
+}
+
+/**
+ * @brief 伙伴系统耗尽时，从其它 CPU 的缓存中取一页
+ * @param self 本 CPU 的缓存，调用者不能持有任何 pcp->lock
+ * @return 取到的页，0 表示所有缓存都为空
+ * @note 避免内存被"困"在空闲 CPU 的缓存里导致 kalloc 误报内存不足
+ */
+static struct run *
+pcp_steal(struct kmem_pcp *self)
+{
+  struct run *r = 0;
+  for (int i = 0; i < NCPU && r == 0; i++) {
+    struct kmem_pcp *pcp = &kmem.pcp[i];
+    if (pcp == self)
+      continue;
+    acquire(&pcp->lock);
+    r = pcp->list;
+    if (r) {
+      pcp->list = r->next;
+      pcp->count--;
+    }
+    release(&pcp->lock);
   }
+  if (r)
+    self->steal++;
+  return r;
 }
 
 // Free the page of physical memory pointed at by v,
@@ -81,35 +421,43 @@ kfree(void *pa)
 {
   struct run *r;
   
-  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < kernel_end || (uint64)pa >= PHYSTOP)
+  if(((uint64)pa % PGSIZE) != 0 || ((uint64)pa >> PGSHIFT) < kmem.base_pfn || ((uint64)pa >> PGSHIFT) >= kmem.end_pfn)
     panic("kfree");
 
-  // 首先解析物理地址，并转换为 refcnt 索引
-  uint64 addr = (uint64)pa;
-  int idx = pa2index(addr);
+  // 首先解析物理地址，找到对应的页描述符
+  struct page *page = pa2page((uint64)pa);
 
-  // 获取锁，并检查引用计数是否大于 0
-  // 若引用计数小于 1，则 panic
-  // 若引用计数大于 0，则递减引用计数，并返回
-  // 若引用计数等于 0，则说明这是最后一次引用，可以真正释放物理页，填充垃圾值，并重新挂回 freelist
-  acquire(&kmem.lock);
-  if(kmem.refcnt[idx] < 1)
+  // 原子地递减引用计数（RISC-V 上编译为一条 amoadd.w），不需要任何锁
+  // 若递减后小于 0，说明重复释放，panic
+  // 若递减后大于 0，说明仍有其它引用，直接返回
+  // 若递减后等于 0，则说明这是最后一次引用，可以真正释放物理页，填充垃圾值，并挂回本 CPU 的缓存
+  REF_LOCK();
+  int ref = __atomic_sub_fetch(&page->refcnt, 1, __ATOMIC_ACQ_REL);
+  REF_UNLOCK();
+  if(ref < 0)
     panic("kfree");
-  kmem.refcnt[idx]--;
-  if(kmem.refcnt[idx] > 0){
-    release(&kmem.lock);
+  if(ref > 0)
     return;
-  }
 
+  #ifdef DEBUG
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+  #endif
 
   r = (struct run*)pa;
 
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  kmem.freepages++;
-  release(&kmem.lock);
+  // 挂回本 CPU 的缓存，缓存超过上限时批量归还伙伴系统
+  push_off();
+  struct kmem_pcp *pcp = &kmem.pcp[cpuid()];
+  acquire(&pcp->lock);
+  r->next = pcp->list;
+  pcp->list = r;
+  pcp->count++;
+  pcp->free++;
+  if (pcp->count > PCP_HIGH)
+    pcp_drain(pcp, PCP_BATCH);
+  release(&pcp->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -120,25 +468,301 @@ kalloc(void)
 {
   struct run *r;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
+  // 优先从本 CPU 的缓存分配，缓存为空时才从伙伴系统批量补充
+  push_off();
+  struct kmem_pcp *pcp = &kmem.pcp[cpuid()];
+  acquire(&pcp->lock);
+  pcp->alloc++;
+  if (pcp->count > 0)
+    pcp->alloc_hit++;
+  else
+    pcp_refill(pcp);
+  r = pcp->list;
   if(r) {
-    kmem.freelist = r->next;
-    // 这里必然是初次分配，所以减少空闲页数，并设置引用计数为 1
-    kmem.freepages--;
-    kmem.refcnt[pa2index((uint64)r)] = 1;
+    pcp->list = r->next;
+    pcp->count--;
   }
-  release(&kmem.lock);
+  release(&pcp->lock);
+  if(r == 0)
+    r = pcp_steal(pcp);
+  pop_off();
+  if(r == 0)
+    r = zpool_get();
+  if(r == 0)
+    __atomic_store_n(&kmem.reclaim, 1, __ATOMIC_RELAXED);
 
-  if(r)
+  if(r) {
+    // 这里必然是初次分配，页面此时只被当前调用者持有，直接设置引用计数为 1
+    __atomic_store_n(&pa2page((uint64)r)->refcnt, 1, __ATOMIC_RELAXED);
+    #ifdef DEBUG
     memset((char*)r, 5, PGSIZE); // fill with junk
+    #endif
+  }
   return (void*)r;
 }
 
+/**
+ * @brief 从预清零页池中取出一页
+ * @return 已整页清零的页，0 表示池为空
+ */
+static struct run *
+zpool_get(void)
+{
+  struct run *r;
+  acquire(&zpool.lock);
+  r = zpool.list;
+  if (r) {
+    zpool.list = r->next;
+    zpool.count--;
+  }
+  release(&zpool.lock);
+  if (r)
+    memset(r, 0, sizeof(*r));
+  return r;
+}
+
+/**
+ * @brief 分配一页内容全为 0 的物理页
+ * @return 物理页地址，0 表示内存不足
+ * @note 优先从预清零页池取页，池空时退化为 kalloc + memset；
+ *       页表页、懒分配与匿名映射的缺页都应使用它，避免先填垃圾值再清零的两次整页写
+ */
+void *
+kalloc_zeroed(void)
+{
+  uint64 start = r_time();
+  struct run *r = zpool_get();
+
+  if (r) {
+    __atomic_store_n(&pa2page((uint64)r)->refcnt, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&zpool.hit, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&zpool.hit_ticks, r_time() - start, __ATOMIC_RELAXED);
+    return (void *)r;
+  }
+  if ((r = kalloc()) == 0)
+    return 0;
+  clear_page(r);
+  __atomic_fetch_add(&zpool.miss, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&zpool.miss_ticks, r_time() - start, __ATOMIC_RELAXED);
+  return (void *)r;
+}
+
+/**
+ * @brief 补充预清零页池，由空闲的 CPU 在调度循环中进入 wfi 之前调用
+ * @return 本次清零的页数，0 表示池已满或空闲内存不足，调用者可以进入 wfi
+ * @note 清零在锁外进行，每次至多 ZPOOL_BATCH 页，以便尽快回到调度循环检查可运行进程
+ */
+int
+kzero_refill(void)
+{
+  int n;
+
+  #ifdef ZPOOL_OFF
+  // 对照构建：池始终为空，缺页时 kalloc_zeroed 都在原地清零
+  return 0;
+  #endif
+  for (n = 0; n < ZPOOL_BATCH; n++) {
+    if (__atomic_load_n(&zpool.count, __ATOMIC_RELAXED) >= ZPOOL_HIGH)
+      break;
+    if (count_freepages() <= ZPOOL_RESERVE)
+      break;
+    struct run *r = kalloc();
+    if (r == 0)
+      break;
+    clear_page(r);
+    // 池中的页视为空闲页
+    __atomic_store_n(&pa2page((uint64)r)->refcnt, 0, __ATOMIC_RELAXED);
+    acquire(&zpool.lock);
+    r->next = zpool.list;
+    zpool.list = r;
+    zpool.count++;
+    zpool.refill++;
+    release(&zpool.lock);
+  }
+  return n;
+}
+
+/**
+ * @brief 把预清零页池中的页全部归还伙伴系统
+ * @note 在分配连续块失败时调用，池中的页与各 CPU 缓存中的页一样会拆散伙伴
+ */
+static void
+zpool_drain(void)
+{
+  struct run *head;
+
+  acquire(&zpool.lock);
+  head = zpool.list;
+  zpool.list = 0;
+  zpool.count = 0;
+  release(&zpool.lock);
+
+  acquire(&kmem.lock);
+  while (head) {
+    struct run *r = head;
+    head = r->next;
+    buddy_free((uint64)r >> PGSHIFT, 0);
+  }
+  release(&kmem.lock);
+}
+
+/**
+ * @brief 分配 2^order 个物理连续、按 2^order 页对齐的物理页
+ * @param order 块的阶数，0 <= order <= MAX_ORDER
+ * @return 块首的物理地址，0 表示没有足够大的连续空闲块
+ * @note order 为 0 时等价于 kalloc()，走本 CPU 缓存的快速路径；
+ *       块内每一页的引用计数都被置为 1，因此之后也可以用 kfree 逐页释放
+ */
+void *
+kalloc_pages(int order)
+{
+  uint64 pfn;
+  char *pa;
+
+  if (order == 0)
+    return kalloc();
+  if (order < 0 || order > MAX_ORDER)
+    return 0;
+
+  acquire(&kmem.lock);
+  pfn = buddy_alloc(order);
+  release(&kmem.lock);
+  if (pfn == 0) {
+    // 各 CPU 缓存中的页不参与合并，可能正是它们拆散了所需的连续块；全部归还后重试一次
+    for (int i = 0; i < NCPU; i++) {
+      struct kmem_pcp *pcp = &kmem.pcp[i];
+      acquire(&pcp->lock);
+      pcp_drain(pcp, pcp->count);
+      release(&pcp->lock);
+    }
+    zpool_drain();
+    acquire(&kmem.lock);
+    pfn = buddy_alloc(order);
+    release(&kmem.lock);
+    if (pfn == 0)
+      return 0;
+  }
+
+  pa = (char *)pfn2run(pfn);
+  for (int i = 0; i < (1 << order); i++)
+    __atomic_store_n(&pa2page((uint64)pa + i * PGSIZE)->refcnt, 1, __ATOMIC_RELAXED);
+  #ifdef DEBUG
+  memset(pa, 5, PGSIZE << order); // fill with junk
+  #endif
+  return pa;
+}
+
+/**
+ * @brief 释放 kalloc_pages 分配的 2^order 个物理页
+ * @param pa 块首的物理地址
+ * @param order 分配时的阶数
+ * @note 逐页递减引用计数；若整块都已无人引用，则整块归还伙伴系统，
+ *       否则（例如其中某些页仍被 COW 共享）只把已无人引用的页逐页归还
+ */
+void
+kfree_pages(void *pa, int order)
+{
+  uint64 addr = (uint64)pa;
+  int npages = 1 << order;
+  int alive = 0;
+
+  if (order == 0) {
+    kfree(pa);
+    return;
+  }
+  if (order < 0 || order > MAX_ORDER || (addr & ((PGSIZE << order) - 1)) != 0 ||
+      (addr >> PGSHIFT) < kmem.base_pfn || (addr >> PGSHIFT) + npages > kmem.end_pfn)
+    panic("kfree_pages");
+
+  // 引用计数降为 0 的页只属于当前调用者，先借用页内空间把它们串成链表
+  struct run *dead = 0;
+  for (int i = 0; i < npages; i++) {
+    struct page *page = pa2page(addr + i * PGSIZE);
+    REF_LOCK();
+    int ref = __atomic_sub_fetch(&page->refcnt, 1, __ATOMIC_ACQ_REL);
+    REF_UNLOCK();
+    if (ref < 0)
+      panic("kfree_pages");
+    if (ref > 0) {
+      alive++;
+    } else {
+      struct run *r = (struct run *)(addr + i * PGSIZE);
+      r->next = dead;
+      dead = r;
+    }
+  }
+
+  if (alive == 0) {
+    #ifdef DEBUG
+    // Fill with junk to catch dangling refs.
+    memset(pa, 1, PGSIZE << order);
+    #endif
+    acquire(&kmem.lock);
+    buddy_free(addr >> PGSHIFT, order);
+    release(&kmem.lock);
+    return;
+  }
+  acquire(&kmem.lock);
+  while (dead) {
+    struct run *r = dead;
+    dead = r->next;
+    #ifdef DEBUG
+    memset((void *)r, 1, PGSIZE);
+    #endif
+    buddy_free((uint64)r >> PGSHIFT, 0);
+  }
+  release(&kmem.lock);
+}
+
+/**
+ * @brief 统计可直接分配的空闲物理页数，包括伙伴系统和各 CPU 缓存中的页，不含预清零页池
+ * @return 空闲物理页数
+ * @note 读取其它 CPU 的缓存计数时不加锁，结果只用于统计，允许瞬时误差
+ */
+static uint64
+count_freepages(void)
+{
+  uint64 n;
+  acquire(&kmem.lock);
+  n = kmem.freepages;
+  release(&kmem.lock);
+  for (int i = 0; i < NCPU; i++)
+    n += kmem.pcp[i].count;
+  return n;
+}
+
+/**
+ * @brief 查询是否需要回收页面
+ * @return 需要回收的页数，0 表示空闲内存充足
+ * @note 空闲页跌破低水位之后，直到重新回到高水位之前，都返回与高水位的差值；
+ *       由空闲的 CPU 在调度循环中调用，见 kreclaimd
+ */
+int
+kmem_reclaim_wanted(void)
+{
+  if (!__atomic_load_n(&kmem.reclaim, __ATOMIC_RELAXED))
+    return 0;
+  uint64 n = count_freepages();
+  if (n >= WMARK_HIGH) {
+    __atomic_store_n(&kmem.reclaim, 0, __ATOMIC_RELAXED);
+    return 0;
+  }
+  return WMARK_HIGH - n;
+}
+
 uint64
 freemem_amount(void)
 {
-  return kmem.freepages << PGSHIFT;
+  return (count_freepages() + zpool.count) << PGSHIFT;
+}
+
+/**
+ * @brief 获取伙伴系统管理的物理页总数
+ */
+uint64
+total_pages(void)
+{
+  return kmem.totalpages;
 }
 
 /**
@@ -150,10 +774,8 @@ uint64
 allocated_pages(void)
 {
   uint64 freepages, totalpages;
-  acquire(&kmem.lock);
-  freepages = kmem.freepages;
+  freepages = count_freepages() + zpool.count;
   totalpages = kmem.totalpages;
-  release(&kmem.lock);
   if (totalpages < freepages) {
     return 0;
   }
@@ -163,15 +785,14 @@ allocated_pages(void)
 /**
  * @brief 增加引用计数
  * @param pa 物理地址
- * @note 增加引用计数，用于 COW
+ * @note 增加引用计数，用于 COW；使用原子操作，fork 时逐页调用也不会争用任何锁
  */
 void
 incref(uint64 pa)
 {
-  acquire(&kmem.lock);
-  int idx = pa2index(pa);
-  kmem.refcnt[idx]++;
-  release(&kmem.lock);
+  REF_LOCK();
+  __atomic_fetch_add(&pa2page(pa)->refcnt, 1, __ATOMIC_RELAXED);
+  REF_UNLOCK();
 }
 
 /**
@@ -182,9 +803,82 @@ incref(uint64 pa)
 int
 getref(uint64 pa)
 {
+  int ref;
+
+  REF_LOCK();
+  ref = __atomic_load_n(&pa2page(pa)->refcnt, __ATOMIC_ACQUIRE);
+  REF_UNLOCK();
+  return ref;
+}
+
+/**
+ * @brief 为一个新映射获取共享零页
+ * @return 零页的物理地址，已为调用者增加一个引用，解除映射时照常 kfree 归还
+ */
+void *
+kzeropage(void)
+{
+  incref((uint64)zeropage);
+  return zeropage;
+}
+
+/**
+ * @brief 判断物理页是否为共享零页
+ */
+int
+is_zeropage(uint64 pa)
+{
+  return pa == (uint64)zeropage;
+}
+
+/**
+ * @brief 打印物理页分配器的统计信息，包括各 CPU 缓存的命中、补充与归还情况，以及伙伴系统各阶的空闲块
+ * @note 命中率 = alloc_hit / alloc，补充 / 归还次数用于评估 PCP_HIGH、PCP_BATCH 是否合适；
+ *       碎片率 = 空闲页中无法满足该阶分配请求的比例（只计伙伴系统，各 CPU 缓存中的页不参与合并）；
+ *       预清零页池给出命中率，以及命中 / 未命中时 kalloc_zeroed 的平均耗时（rdtime 计数），即缺页路径上有无页池的分配开销
+ */
+void
+kmemdump(void)
+{
+  uint64 freepages, nr_free[MAX_ORDER + 1];
+  int largest = -1;
+
   acquire(&kmem.lock);
-  int idx = pa2index(pa);
-  int cnt = kmem.refcnt[idx];
+  freepages = kmem.freepages;
+  for (int i = 0; i <= MAX_ORDER; i++) {
+    nr_free[i] = kmem.area[i].nr_free;
+    if (nr_free[i] > 0)
+      largest = i;
+  }
   release(&kmem.lock);
-  return cnt;
+  printf("kmem: total %d pages, buddy free %d pages\n", (int)kmem.totalpages, (int)freepages);
+  printf("cpu\tcached\talloc\thit%%\tfree\trefill\tdrain\tsteal\n");
+  for (int i = 0; i < NCPU; i++) {
+    struct kmem_pcp *pcp = &kmem.pcp[i];
+    int hit = pcp->alloc ? (int)(pcp->alloc_hit * 100 / pcp->alloc) : 0;
+    printf("%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n", i, pcp->count, (int)pcp->alloc, hit,
+           (int)pcp->free, (int)pcp->refill, (int)pcp->drain, (int)pcp->steal);
+  }
+
+  // 从高阶往低阶累计，usable 为能满足该阶请求的空闲页数
+  uint64 usable = 0;
+  int frag[MAX_ORDER + 1];
+  for (int i = MAX_ORDER; i >= 0; i--) {
+    usable += nr_free[i] << i;
+    frag[i] = freepages ? (int)((freepages - usable) * 100 / freepages) : 0;
+  }
+  printf("order\tblocks\tpages\tfrag%%\n");
+  for (int i = 0; i <= MAX_ORDER; i++)
+    printf("%d\t%d\t%d\t%d\n", i, (int)nr_free[i], (int)(nr_free[i] << i), frag[i]);
+  printf("largest free block: order %d\n", largest);
+  printf("watermark: low %d, high %d, below low %d times%s\n", WMARK_LOW, WMARK_HIGH,
+         (int)kmem.nlow, kmem.reclaim ? ", reclaiming" : "");
+
+  uint64 zhit = zpool.hit, zmiss = zpool.miss;
+  printf("zero pool: %d pages, refilled %d, hit %d, miss %d, hit%% %d\n",
+         zpool.count, (int)zpool.refill, (int)zhit, (int)zmiss,
+         zhit + zmiss ? (int)(zhit * 100 / (zhit + zmiss)) : 0);
+  printf("kalloc_zeroed avg ticks: pool %d, no pool %d\n",
+         zhit ? (int)(zpool.hit_ticks / zhit) : 0, zmiss ? (int)(zpool.miss_ticks / zmiss) : 0);
+  printf("shared zero page: %d mappings\n", getref((uint64)zeropage) - 1);
 }
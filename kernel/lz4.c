@@ -0,0 +1,183 @@
+// LZ4 block compression, used by the compressed swap store.
+// The compressor matches greedily against the most recent
+// position with the same 4-byte hash; the output follows
+// the LZ4 block format. Inputs are at most 64 KiB, so
+// positions and offsets fit in 16 bits.
+
+#include "include/types.h"
+#include "include/lz4.h"
+#include "include/string.h"
+
+#define LZ4_MINMATCH      4   // 最短匹配长度
+#define LZ4_LASTLITERALS  5   // 输入的最后 5 字节必须作为字面量输出
+#define LZ4_MFLIMIT       12  // 距输入结尾不足 12 字节时不再开始新的匹配
+#define LZ4_MAX_INPUT     65536
+
+// 按字节读，K210 上非对齐访问会陷入
+static inline uint
+read32(const uchar *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+static inline uint
+hash4(uint v)
+{
+  return (v * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+// 写出 token 之后的长度扩展字节
+static uchar *
+put_len(uchar *op, int len)
+{
+  for (len -= 15; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+/**
+ * @brief 输出一个序列：litlen 个字面量，之后是偏移 off、长度 mlen + LZ4_MINMATCH 的匹配
+ * @return 输出后的位置，0 表示输出缓冲区不够
+ * @note off 为 0 时是最后一个序列，只有字面量
+ */
+static uchar *
+put_sequence(uchar *op, uchar *oend, const uchar *lit, int litlen, int off, int mlen)
+{
+  // 按最坏情况检查剩余空间
+  if (1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1 > oend - op)
+    return 0;
+  uchar *token = op++;
+  *token = (litlen >= 15 ? 15 : litlen) << 4;
+  if (litlen >= 15)
+    op = put_len(op, litlen);
+  memmove(op, lit, litlen);
+  op += litlen;
+  if (off == 0)
+    return op;
+  *op++ = off & 0xff;
+  *op++ = off >> 8;
+  *token |= mlen >= 15 ? 15 : mlen;
+  if (mlen >= 15)
+    op = put_len(op, mlen);
+  return op;
+}
+
+/**
+ * @brief 压缩 n 字节
+ * @param src 输入
+ * @param n 输入长度，不超过 64 KiB
+ * @param dst 输出缓冲区
+ * @param cap 输出缓冲区大小
+ * @param table 调用者提供的 LZ4_TABLE_SIZE 字节哈希表，内容不必初始化
+ * @return 压缩后的长度，-1 表示结果超过 cap
+ * @note 只要结果超过 cap 就立即放弃，调用者把 cap 设为能接受的最大长度，不可压缩的输入不会被完整处理
+ */
+int
+lz4_compress(const uchar *src, int n, uchar *dst, int cap, ushort *table)
+{
+  const uchar *ip = src, *anchor = src, *end = src + n;
+  uchar *op = dst, *oend = dst + cap;
+
+  if (n > LZ4_MAX_INPUT)
+    return -1;
+  if (n > LZ4_MFLIMIT) {
+    const uchar *mflimit = end - LZ4_MFLIMIT, *matchlimit = end - LZ4_LASTLITERALS;
+    // 表项为 0 时指向输入开头，总会经过内容比较，不需要另作区分
+    memset(table, 0, LZ4_TABLE_SIZE);
+    ip++;
+    while (ip < mflimit) {
+      uint seq = read32(ip);
+      uint h = hash4(seq);
+      const uchar *ref = src + table[h];
+      table[h] = ip - src;
+      if (ref >= ip || read32(ref) != seq) {
+        ip++;
+        continue;
+      }
+      // 向前延伸到上一个序列末尾，向后延伸到不得不输出字面量的位置
+      while (ip > anchor && ref > src && ip[-1] == ref[-1]) {
+        ip--;
+        ref--;
+      }
+      const uchar *m = ip + LZ4_MINMATCH, *r = ref + LZ4_MINMATCH;
+      while (m < matchlimit && *m == *r) {
+        m++;
+        r++;
+      }
+      op = put_sequence(op, oend, anchor, ip - anchor, ip - ref, m - ip - LZ4_MINMATCH);
+      if (op == 0)
+        return -1;
+      ip = anchor = m;
+    }
+  }
+  op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+  if (op == 0)
+    return -1;
+  return op - dst;
+}
+
+// 读出 token 之后的长度扩展字节，-1 表示输入截断
+static int
+get_len(const uchar **ipp, const uchar *iend, int len)
+{
+  const uchar *ip = *ipp;
+  uint b;
+
+  do {
+    if (ip >= iend)
+      return -1;
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  *ipp = ip;
+  return len;
+}
+
+/**
+ * @brief 解压 lz4_compress 的输出
+ * @param src 压缩数据
+ * @param n 压缩数据长度
+ * @param dst 输出缓冲区
+ * @param cap 输出缓冲区大小
+ * @return 解压后的长度，-1 表示数据损坏或输出超过 cap
+ * @note 逐项检查边界，损坏的数据不会读写缓冲区以外的内存
+ */
+int
+lz4_decompress(const uchar *src, int n, uchar *dst, int cap)
+{
+  const uchar *ip = src, *iend = src + n;
+  uchar *op = dst, *oend = dst + cap;
+
+  while (ip < iend) {
+    uint token = *ip++;
+    int len = token >> 4;
+    if (len == 15 && (len = get_len(&ip, iend, len)) < 0)
+      return -1;
+    if (len > iend - ip || len > oend - op)
+      return -1;
+    memmove(op, ip, len);
+    op += len;
+    ip += len;
+    // 最后一个序列只有字面量
+    if (ip == iend)
+      break;
+    if (iend - ip < 2)
+      return -1;
+    int off = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (off == 0 || off > op - dst)
+      return -1;
+    len = token & 15;
+    if (len == 15 && (len = get_len(&ip, iend, len)) < 0)
+      return -1;
+    len += LZ4_MINMATCH;
+    if (len > oend - op)
+      return -1;
+    // 匹配可以与输出重叠（off < len 时重复前面的内容），必须逐字节向前复制
+    const uchar *m = op - off;
+    while (len-- > 0)
+      *op++ = *m++;
+  }
+  return op - dst;
+}
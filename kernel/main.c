@@ -9,14 +9,18 @@
 #include "include/console.h"
 #include "include/printf.h"
 #include "include/kalloc.h"
+#include "include/slab.h"
 #include "include/timer.h"
 #include "include/trap.h"
 #include "include/proc.h"
 #include "include/plic.h"
 #include "include/vm.h"
+#include "include/reclaim.h"
+#include "include/pagecache.h"
 #include "include/disk.h"
 #include "include/buf.h"
 #include "include/semaphore.h"
+#include "include/pipe.h"
 #ifndef QEMU
 #include "include/sdcard.h"
 #include "include/fpioa.h"
@@ -33,6 +37,10 @@ void
 main(unsigned long hartid, unsigned long dtb_pa)
 {
   inithartid(hartid);
+  #ifdef STRING_RVV
+  // string.c 的向量实现从第一次 memset 起就会用到向量单元
+  w_sstatus(r_sstatus() | SSTATUS_VS_INITIAL);
+  #endif
   
   if (hartid == 0) {
     consoleinit();
@@ -41,9 +49,11 @@ main(unsigned long hartid, unsigned long dtb_pa)
     #ifdef DEBUG
     printf("hart %d enter main()...\n", hartid);
     #endif
-    kinit();         // physical page allocator
+    kinit(dtb_pa);   // physical page allocator, sized from the device tree
+    kmem_cache_init(); // slab object caches
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
+    asidinit();      // probe ASID width for address-space tags
     timerinit();     // init a lock for timer
     trapinithart();  // install kernel trap vector, including interrupt handler
     procinit();
@@ -56,6 +66,11 @@ main(unsigned long hartid, unsigned long dtb_pa)
     disk_init();
     binit();         // buffer cache
     fileinit();      // file table
+    pipeinit();      // pipe cache
+    vmainit();       // vma cache
+    pagecacheinit(); // page cache for private file mappings
+    swapinit();      // swap space
+    reclaiminit();   // page reclaim
     seminit();       // semaphore table
     userinit();      // first user process
     printf("hart 0 init done\n");
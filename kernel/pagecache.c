@@ -0,0 +1,227 @@
+// Page cache for private file mappings.
+// Pages read for MAP_PRIVATE file mappings, which include
+// the program segments exec maps, are kept here by file and
+// offset, so every process mapping the same file shares one
+// clean copy. Mappings take a reference to the cached page
+// and copy it on the first write. Pages no process maps any
+// more are dropped under memory pressure, and writing or
+// truncating a file drops all of its pages.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/sleeplock.h"
+#include "include/fat32.h"
+#include "include/kalloc.h"
+#include "include/slab.h"
+#include "include/pagecache.h"
+#include "include/printf.h"
+
+#define PC_NHASH  64  // 哈希桶数，同一文件的页落在同一个桶中
+
+struct cpage {
+  struct cpage *next;     // 同一哈希桶中的下一项
+  uint32 clus;            // 文件的首簇号，与 dev 一起标识文件
+  uint8 dev;
+  uint off;               // 页内容在文件中的起始偏移，不必页对齐
+  char *pa;               // 缓存持有它的一个引用
+};
+
+static struct {
+  struct spinlock lock;   // 保护哈希表与以下计数
+  struct kmem_cache *cache;
+  struct cpage *hash[PC_NHASH];
+  int hand;               // pagecache_shrink 下一次开始扫描的哈希桶
+  uint pages;             // 缓存的页数
+  uint limit;             // pages 的上限
+  uint64 nhit;            // 命中次数
+  uint64 nmiss;           // 未命中、从文件读入的次数
+  uint64 ndrop;           // 内存紧张时丢弃的页数
+  uint64 ninval;          // 文件被修改而作废的页数
+} pcache;
+
+static inline int
+pc_hash(struct dirent *ep)
+{
+  return (ep->first_clus * 31 + ep->dev) % PC_NHASH;
+}
+
+static inline int
+pc_match(struct cpage *c, struct dirent *ep)
+{
+  return c->clus == ep->first_clus && c->dev == ep->dev;
+}
+
+void
+pagecacheinit(void)
+{
+  initlock(&pcache.lock, "pagecache");
+  if ((pcache.cache = kmem_cache_create("pagecache", sizeof(struct cpage), 0)) == NULL)
+    panic("pagecacheinit");
+  pcache.limit = total_pages() * PAGECACHE_MAX_PERCENT / 100;
+}
+
+/**
+ * @brief 判断物理页是否在页缓存中
+ * @note 不加锁，只作为回收的参考：页随时可能被丢出缓存，但缓存页的内容始终与文件一致
+ */
+int
+pagecache_owns(uint64 pa)
+{
+  return (pa2page(pa)->flags & PG_CACHE) != 0;
+}
+
+// 释放摘下的缓存项，不持有 pcache.lock
+static void
+pc_free(struct cpage *c)
+{
+  while (c) {
+    struct cpage *next = c->next;
+    pa2page((uint64)c->pa)->flags &= ~PG_CACHE;
+    kfree(c->pa);
+    kmem_cache_free(pcache.cache, c);
+    c = next;
+  }
+}
+
+/**
+ * @brief 取得文件 ep 从 off 开始的一页内容
+ * @param ep 文件，调用者持有它的锁
+ * @param off 文件偏移，不必页对齐
+ * @return 物理页，调用者得到它的一个引用；0 表示内存不足或读文件出错
+ * @note 不在缓存中时读入一页并加入缓存，文件结尾之后的部分为 0。缓存已满且没有可以丢弃的页时，
+ *       返回的页只属于调用者。返回的页可能同时被其他进程映射，调用者只能以只读或 COW 方式映射它。
+ *       同一文件的页只在持有文件锁时加入，不会重复缓存
+ */
+char*
+pagecache_get(struct dirent *ep, uint off)
+{
+  int h = pc_hash(ep);
+  struct cpage *c;
+  char *mem;
+
+  acquire(&pcache.lock);
+  for (c = pcache.hash[h]; c; c = c->next) {
+    if (pc_match(c, ep) && c->off == off) {
+      incref((uint64)c->pa);
+      pcache.nhit++;
+      release(&pcache.lock);
+      return c->pa;
+    }
+  }
+  pcache.nmiss++;
+  release(&pcache.lock);
+
+  if ((mem = kalloc_zeroed()) == 0)
+    return 0;
+  if (ereadpage(ep, mem, off) < 0) {
+    kfree(mem);
+    return 0;
+  }
+  // 空文件没有首簇号，无法标识
+  if (ep->first_clus == 0)
+    return mem;
+  if (pcache.pages >= pcache.limit && pagecache_shrink(1) == 0)
+    return mem;
+  if ((c = kmem_cache_alloc(pcache.cache)) == 0)
+    return mem;
+  c->clus = ep->first_clus;
+  c->dev = ep->dev;
+  c->off = off;
+  c->pa = mem;
+  incref((uint64)mem);
+  pa2page((uint64)mem)->flags |= PG_CACHE;
+
+  acquire(&pcache.lock);
+  c->next = pcache.hash[h];
+  pcache.hash[h] = c;
+  pcache.pages++;
+  release(&pcache.lock);
+  return mem;
+}
+
+/**
+ * @brief 作废文件 ep 的全部缓存页，文件内容改变之前调用
+ * @param ep 文件，调用者持有它的锁
+ * @note 已经映射这些页的进程继续使用旧内容，与 exec 之后再修改可执行文件的效果相同
+ */
+void
+pagecache_invalidate(struct dirent *ep)
+{
+  struct cpage *drop = 0;
+  int n = 0;
+
+  if (ep->first_clus == 0)
+    return;
+  acquire(&pcache.lock);
+  for (struct cpage **pp = &pcache.hash[pc_hash(ep)]; *pp; ) {
+    struct cpage *c = *pp;
+    if (pc_match(c, ep)) {
+      *pp = c->next;
+      c->next = drop;
+      drop = c;
+      n++;
+    } else {
+      pp = &c->next;
+    }
+  }
+  pcache.pages -= n;
+  pcache.ninval += n;
+  release(&pcache.lock);
+  pc_free(drop);
+}
+
+/**
+ * @brief 丢弃至多 nr 个没有进程映射的缓存页
+ * @return 丢弃的页数
+ * @note 只看引用计数，不修改任何页表，不会睡眠。各哈希桶轮流作为起点。
+ *       进程映射的缓存页由 vma_reclaim_clean 解除映射后，在这里才真正释放
+ */
+int
+pagecache_shrink(int nr)
+{
+  struct cpage *drop = 0;
+  int n = 0, i;
+
+  acquire(&pcache.lock);
+  for (i = 0; i < PC_NHASH && n < nr; i++) {
+    struct cpage **pp = &pcache.hash[(pcache.hand + i) % PC_NHASH];
+    while (*pp && n < nr) {
+      struct cpage *c = *pp;
+      // 新的引用只能在持有 pcache.lock 时由 pagecache_get 取得，检查之后不会再增加
+      if (getref((uint64)c->pa) == 1) {
+        *pp = c->next;
+        c->next = drop;
+        drop = c;
+        n++;
+      } else {
+        pp = &c->next;
+      }
+    }
+  }
+  pcache.hand = (pcache.hand + i) % PC_NHASH;
+  pcache.pages -= n;
+  pcache.ndrop += n;
+  release(&pcache.lock);
+  pc_free(drop);
+  return n;
+}
+
+/**
+ * @brief 打印页缓存的使用情况
+ */
+void
+pagecachedump(void)
+{
+  int mapped = 0;
+
+  acquire(&pcache.lock);
+  for (int h = 0; h < PC_NHASH; h++)
+    for (struct cpage *c = pcache.hash[h]; c; c = c->next)
+      mapped += getref((uint64)c->pa) > 1;
+  printf("pagecache: %d/%d pages cached (%d mapped), %d hits, %d misses, %d dropped, %d invalidated\n",
+         pcache.pages, pcache.limit, mapped, (int)pcache.nhit, (int)pcache.nmiss,
+         (int)pcache.ndrop, (int)pcache.ninval);
+  release(&pcache.lock);
+}
@@ -7,8 +7,20 @@
 #include "include/sleeplock.h"
 #include "include/file.h"
 #include "include/pipe.h"
-#include "include/kalloc.h"
+#include "include/slab.h"
 #include "include/vm.h"
+#include "include/trap.h"
+#include "include/printf.h"
+
+static struct kmem_cache *pipe_cache;
+
+void
+pipeinit(void)
+{
+  // struct pipe 只有约 550 字节，一页可以放下 7 个
+  if((pipe_cache = kmem_cache_create("pipe", sizeof(struct pipe), 0)) == NULL)
+    panic("pipeinit");
+}
 
 int
 pipealloc(struct file **f0, struct file **f1)
@@ -19,7 +31,7 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == NULL || (*f1 = filealloc()) == NULL)
     goto bad;
-  if((pi = (struct pipe*)kalloc()) == NULL)
+  if((pi = (struct pipe*)kmem_cache_alloc(pipe_cache)) == NULL)
     goto bad;
   pi->readopen = 1;
   pi->writeopen = 1;
@@ -38,7 +50,7 @@ pipealloc(struct file **f0, struct file **f1)
 
  bad:
   if(pi)
-    kfree((char*)pi);
+    kmem_cache_free(pipe_cache, pi);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -59,7 +71,7 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
-    kfree((char*)pi);
+    kmem_cache_free(pipe_cache, pi);
   } else
     release(&pi->lock);
 }
@@ -67,24 +79,40 @@ pipeclose(struct pipe *pi, int writable)
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, r, faulted = -1;
   char ch;
   struct proc *pr = myproc();
 
+  // 持有 pi->lock 时 copyin2 不能缺页，加锁之前先为源缓冲区补上映射
+  fault_in_range(addr, n, 0);
   acquire(&pi->lock);
-  for(i = 0; i < n; i++){
-    while(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
+  i = 0;
+  while(i < n){
+    if(pi->nwrite == pi->nread + PIPESIZE){  //DOC: pipewrite-full
       if(pi->readopen == 0 || pr->killed){
         release(&pi->lock);
         return -1;
       }
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
+      continue;
     }
     // if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-    if(copyin2(&ch, addr + i, 1) == -1)
-      break;
+    if(copyin2(&ch, addr + i, 1) == -1){
+      // 等待读者期间源页可能又被回收：放开锁补上映射，回到循环开头重新检查管道。
+      // 补上之后仍然读不到则放弃
+      if(faulted == i)
+        break;
+      release(&pi->lock);
+      r = fault_in_page(PGROUNDDOWN(addr + i), 0);
+      acquire(&pi->lock);
+      if(r < 0)
+        break;
+      faulted = i;
+      continue;
+    }
     pi->data[pi->nwrite++ % PIPESIZE] = ch;
+    i++;
   }
   wakeup(&pi->nread);
   release(&pi->lock);
@@ -94,10 +122,11 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, r, faulted = -1;
   struct proc *pr = myproc();
   char ch;
 
+  fault_in_range(addr, n, 1);
   acquire(&pi->lock);
   while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
     if(pr->killed){
@@ -106,13 +135,26 @@ piperead(struct pipe *pi, uint64 addr, int n)
     }
     sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
+  i = 0;
+  while(i < n){  //DOC: piperead-copy
     if(pi->nread == pi->nwrite)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
+    ch = pi->data[pi->nread % PIPESIZE];
     // if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
-    if(copyout2(addr + i, &ch, 1) == -1)
-      break;
+    if(copyout2(addr + i, &ch, 1) == -1){
+      // 与 pipewrite 相同：目标页在加锁之后被回收时放开锁补上映射，字节留在管道中重新读取
+      if(faulted == i)
+        break;
+      release(&pi->lock);
+      r = fault_in_page(PGROUNDDOWN(addr + i), 1);
+      acquire(&pi->lock);
+      if(r < 0)
+        break;
+      faulted = i;
+      continue;
+    }
+    pi->nread++;
+    i++;
   }
   wakeup(&pi->nwrite);  //DOC: piperead-wakeup
   release(&pi->lock);
@@ -7,12 +7,15 @@
 #include "include/proc.h"
 #include "include/intr.h"
 #include "include/kalloc.h"
+#include "include/slab.h"
 #include "include/printf.h"
 #include "include/string.h"
 #include "include/fat32.h"
 #include "include/file.h"
+#include "include/timer.h"
 #include "include/trap.h"
 #include "include/vm.h"
+#include "include/reclaim.h"
 #include "include/syscall.h"
 
 struct cpu cpus[NCPU];
@@ -30,99 +33,58 @@ static void wakeup1(struct proc *chan);
 static void freeproc(struct proc* p);
 
 #ifdef ALGO
-/**
- * @brief 重置 mmap 跟踪页的状态，清除时间戳和 swap 数据。
- * @param page 待重置的页面元数据指针
- */
-static void reset_vma_page(struct mmap_vpage *page) {
-  page->state = VMA_PAGE_UNUSED;
-  page->load_time = 0;
-  page->last_access = 0;
-  page->swap_data = 0;
-}
-
-/**
- * @brief 回收克隆 VMA 过程中分配的 swap 缓冲并重置元数据。
- * @param v 目标 VMA
- * @param upto 已处理的页数量
- */
-static void cleanup_cloned_pages(struct vma *v, int upto) {
-  if (v->pages == 0) {
-    return;
-  }
-  for (int i = 0; i < upto; i++) {
-    if (v->pages[i].swap_data) {
-      kfree(v->pages[i].swap_data);
-      v->pages[i].swap_data = 0;
-    }
-    reset_vma_page(&v->pages[i]);
-  }
-}
-
 /**
  * @brief 克隆源 VMA 的页追踪信息，包括驻留页和 swap 中的数据。
  * @param src_proc 源进程指针
- * @param dst 目标 VMA
+ * @param dst 目标 VMA，必须已经插入目标进程的 VMA 索引
  * @param src 源 VMA
  * @return 0 成功，-1 失败（kalloc 失败）
+ * @note 源进程的驻留页复制为子进程中已换出的页。失败时已复制的部分留在 dst 中，由 vma_free 统一释放
  */
 static int clone_vma_pages(struct proc *src_proc, struct vma* dst, struct vma* src) {
   if (src->pages == 0) {
-    dst->page_count = 0;
     return 0;
   }
-  int total = src->page_count;
-  if (total <= 0) {
-    total = (src->end - src->start) / PGSIZE;
-  }
-  if (total > VMA_MAX_TRACKED_PAGES) {
-    total = VMA_MAX_TRACKED_PAGES;
-  }
-
-  if (dst->pages == 0) {
-    dst->pages = (struct mmap_vpage*)kalloc();
-    if (dst->pages == 0) {
-      return -1;
-    }
-  } else {
-    cleanup_cloned_pages(dst, VMA_MAX_TRACKED_PAGES);
-  }
-
-  for (int i = 0; i < VMA_MAX_TRACKED_PAGES; i++) {
-    reset_vma_page(&dst->pages[i]);
+  if (vma_pages_init(dst) < 0) {
+    return -1;
   }
 
-  for (int i = 0; i < total; i++) {
-    struct mmap_vpage *src_page = &src->pages[i];
-    struct mmap_vpage *dst_page = &dst->pages[i];
-    if (src_page->state == VMA_PAGE_SWAPPED && src_page->swap_data) {
-      char* buf = kalloc();
-      if (buf == 0) {
-        cleanup_cloned_pages(dst, i);
-        return -1;
-      }
-      memmove(buf, src_page->swap_data, PGSIZE);
-      dst_page->swap_data = buf;
-      dst_page->state = VMA_PAGE_SWAPPED;
+  uint64 base = VPAGE_CHUNKNO(src->start) * VPAGE_CHUNK * PGSIZE;
+  for (int i = 0; i < dst->nchunk; i++) {
+    struct mmap_vpage *src_chunk = src->pages[i];
+    if (src_chunk == 0) {
       continue;
     }
-    if (src_page->state == VMA_PAGE_INMEM) {
-      uint64 va = src->start + (uint64)i * PGSIZE;
-      uint64 pa = walkaddr(src_proc->pagetable, va);
-      if (pa == 0) {
+    struct mmap_vpage *dst_chunk = (struct mmap_vpage*)kalloc_zeroed();
+    if (dst_chunk == 0) {
+      return -1;
+    }
+    dst->pages[i] = dst_chunk;
+    for (int j = 0; j < VPAGE_CHUNK; j++) {
+      struct mmap_vpage *src_page = &src_chunk[j];
+      struct mmap_vpage *dst_page = &dst_chunk[j];
+      if (src_page->state == VMA_PAGE_SWAPPED && src_page->swap) {
+        // 交换文件中的槽位由父子进程共享
+        if ((dst_page->swap = swap_dup(src_page->swap)) == 0) {
+          return -1;
+        }
+        dst_page->state = VMA_PAGE_SWAPPED;
+        dst_page->dirty = src_page->dirty;
         continue;
       }
-      char* buf = kalloc();
-      if (buf == 0) {
-        cleanup_cloned_pages(dst, i);
-        return -1;
+      if (src_page->state == VMA_PAGE_INMEM) {
+        uint64 va = base + ((uint64)i * VPAGE_CHUNK + j) * PGSIZE;
+        uint64 pa = walkaddr(src_proc->pagetable, va);
+        if (pa == 0) {
+          continue;
+        }
+        if ((dst_page->swap = swap_out((char*)pa)) == 0) {
+          return -1;
+        }
+        dst_page->state = VMA_PAGE_SWAPPED;
       }
-      memmove(buf, (char*)pa, PGSIZE);
-      dst_page->swap_data = buf;
-      dst_page->state = VMA_PAGE_SWAPPED;
     }
   }
-  dst->page_count = total;
   return 0;
 }
 #endif
@@ -134,19 +96,22 @@ static int clone_vma_pages(struct proc *src_proc, struct vma* dst, struct vma* s
  * @return 0 成功，-1 失败
  */
 static int copy_process_vmas(struct proc* dst, struct proc* src) {
-  for (int i = 0; i < NVMA; i++) {
-    if (!src->vmas[i].valid) {
-      dst->vmas[i].valid = 0;
-      continue;
-    }
-    dst->vmas[i] = src->vmas[i];
-    if (dst->vmas[i].vm_file) {
-      dst->vmas[i].vm_file = filedup(dst->vmas[i].vm_file);
+  for (struct vma* sv = src->vmas.first; sv; sv = sv->next) {
+    struct vma* v = vma_alloc();
+    if (v == 0) {
+      return -1;
     }
-    
+    v->start = sv->start;
+    v->end = sv->end;
+    v->prot = sv->prot;
+    v->flags = sv->flags;
+    v->offset = sv->offset;
+    v->vm_file = sv->vm_file ? filedup(sv->vm_file) : NULL;
+    // 源 VMA 互不重叠，插入不会失败；先插入，失败时由 vma_free 统一清理
+    vma_insert(&dst->vmas, v);
+
     #ifdef ALGO
-    dst->vmas[i].pages = 0;
-    if (clone_vma_pages(src, &dst->vmas[i], &src->vmas[i]) < 0) {
+    if (clone_vma_pages(src, v, sv) < 0) {
       return -1;
     }
     #endif
@@ -154,6 +119,26 @@ static int copy_process_vmas(struct proc* dst, struct proc* src) {
   return 0;
 }
 
+/**
+ * @brief 在 fork/clone 中为子进程复制 VMA，调用时持有 dst->lock，返回时仍持有
+ * @return 0 成功，-1 失败，此时 dst 的 VMA 已释放
+ * @note ALGO 下复制 mmap 页会读写交换文件而睡眠，期间释放 dst->lock。dst 处于 USED 状态，
+ *       不会被调度，也不会被 allocproc 重新分配；src 置 vm_busy，页面回收不会改动正在复制的 VMA
+ */
+static int copy_vmas_unlocked(struct proc* dst, struct proc* src) {
+  int r;
+
+  release(&dst->lock);
+  src->vm_busy++;
+  r = copy_process_vmas(dst, src);
+  src->vm_busy--;
+  if (r < 0) {
+    vma_free(dst);
+  }
+  acquire(&dst->lock);
+  return r;
+}
+
 #ifdef SCHEDULER_RR
 /**
  * @brief RR 算法所需内核函数，处理时间片递减与抢占逻辑
@@ -331,18 +316,16 @@ procinit(void)
       initlock(&p->lock, "proc");
 
       // Allocate a page for the process's kernel stack.
-      // Map it high in memory, followed by an invalid
+      // Map it high in memory, preceded by an invalid
       // guard page.
-      // char *pa = kalloc();
-      // // printf("[procinit]kernel stack: %p\n", (uint64)pa);
-      // if(pa == 0)
-      //   panic("kalloc");
-      // uint64 va = KSTACK((int) (p - proc));
-      // // printf("[procinit]kvmmap va %p to pa %p\n", va, (uint64)pa);
-      // kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
-      // p->kstack = va;
+      char *pa = kalloc();
+      if(pa == 0)
+        panic("kalloc");
+      uint64 va = KSTACK((int) (p - proc));
+      kvmmap(va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+      p->kstack = va;
   }
-  //kvminithart();
+  sfence_vma();
 
   memset(cpus, 0, sizeof(cpus));
   #ifdef DEBUG
@@ -412,7 +395,18 @@ allocproc(void)
   return NULL;
 
 found:
+  // 占住这个槽位：fork 复制 VMA 时会释放 p->lock，此后不能再被 allocproc 选中，也不会被调度
+  p->state = USED;
   p->pid = allocpid();
+  p->fault_around = FAULT_AROUND_PAGES;
+  p->minflt = 0;
+  p->flttime = 0;
+  p->vm_busy = 0;
+  p->vm_owner = NULL;
+  // 新地址空间必须重新分配 ASID，否则会命中上一个使用者残留的 TLB 项
+  p->asid = 0;
+  p->asid_gen = 0;
+  p->asid_cpu = -1;
 
   #ifdef SCHEDULER_RR
   // RR 算法: 初始化时间片、剩余时间片
@@ -435,32 +429,35 @@ found:
   
 
   #ifdef ALGO
-  p->max_page_in_mem = VMA_MAX_TRACKED_PAGES;
+  p->max_page_in_mem = VMA_DEFAULT_RESIDENT_PAGES;
   p->mmap_pages_in_mem = 0;
   p->swap_count = 0;
+  p->ws_auto = 1;
+  p->ws_estimate = 0;
+  p->ws_faults = 0;
+  p->ws_refaults = 0;
+  p->ws_window = ticks;
+  #ifdef ALGO_CLOCK
+  p->clock_scan = 0;
+  #endif
   #endif
   
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == NULL){
+    freeproc(p);
     release(&p->lock);
     return NULL;
   }
 
-  // An empty user page table.
-  // And an identical kernel page table for this proc.
-  if ((p->pagetable = proc_pagetable(p)) == NULL ||
-      (p->kpagetable = proc_kpagetable()) == NULL) {
+  // An empty user page table, sharing the kernel half.
+  if ((p->pagetable = proc_pagetable(p)) == NULL) {
     freeproc(p);
     release(&p->lock);
     return NULL;
   }
 
   // vma 初始化
-  for (int i = 0; i < NVMA; i++) {
-    p->vmas[i].valid = 0;
-  }
-
-  p->kstack = VKSTACK;
+  vma_tree_init(&p->vmas);
 
   // Set up new context to start executing at forkret,
   // which returns to user space.
@@ -480,10 +477,6 @@ freeproc(struct proc *p)
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if (p->kpagetable) {
-    kvmfree(p->kpagetable, 1);
-  }
-  p->kpagetable = 0;
   if(p->pagetable)
     proc_freepagetable(p->pagetable, p->sz);
   p->pagetable = 0;
@@ -514,9 +507,17 @@ freeproc(struct proc *p)
   #endif
 
   #ifdef ALGO
-  p->max_page_in_mem = VMA_MAX_TRACKED_PAGES;
+  p->max_page_in_mem = VMA_DEFAULT_RESIDENT_PAGES;
   p->mmap_pages_in_mem = 0;
   p->swap_count = 0;
+  p->ws_auto = 1;
+  p->ws_estimate = 0;
+  p->ws_faults = 0;
+  p->ws_refaults = 0;
+  p->ws_window = ticks;
+  #ifdef ALGO_CLOCK
+  p->clock_scan = 0;
+  #endif
   #endif
 }
 
@@ -619,7 +620,7 @@ userinit(void)
   
   // allocate one user page and copy init's instructions
   // and data into it.
-  uvminit(p->pagetable , p->kpagetable, initcode, sizeof(initcode));
+  uvminit(p->pagetable, initcode, sizeof(initcode));
   p->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
@@ -653,11 +654,15 @@ growproc(int n)
       return -1;
     if (newsz >= MMAPBASE)
       return -1;
+    // mmap 可以把映射放在紧贴堆顶的位置，堆不能长进已有的映射
+    struct vma *v = vma_ceil(&p->vmas, sz);
+    if (v && v->start < newsz)
+      return -1;
     p->sz = newsz;
   } else if(n < 0){
     uint64 delta = (uint64)(-n);
     uint64 newsz = (delta > sz) ? 0 : sz - delta;
-    uvmdealloc(p->pagetable, p->kpagetable, sz, newsz);
+    uvmdealloc(p->pagetable, sz, newsz);
     p->sz = newsz;
   }
   return 0;
@@ -678,7 +683,7 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -689,6 +694,7 @@ fork(void)
 
   // copy tracing mask from parent.
   np->tmask = p->tmask;
+  np->fault_around = p->fault_around;
 
   #ifdef SCHEDULER_RR
   // fork 时沿用父进程的时间片配置
@@ -713,6 +719,14 @@ fork(void)
   np->max_page_in_mem = p->max_page_in_mem;
   np->mmap_pages_in_mem = 0;
   np->swap_count = 0;
+  np->ws_auto = p->ws_auto;
+  np->ws_estimate = 0;
+  np->ws_faults = 0;
+  np->ws_refaults = 0;
+  np->ws_window = ticks;
+  #ifdef ALGO_CLOCK
+  np->clock_scan = 0;
+  #endif
   #endif
 
   // copy saved user registers.
@@ -721,8 +735,7 @@ fork(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  if (copy_process_vmas(np, p) < 0) {
-    vma_free(np);
+  if (copy_vmas_unlocked(np, p) < 0) {
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -768,7 +781,7 @@ clone(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, np->kpagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -779,6 +792,7 @@ clone(void)
 
   // copy tracing mask from parent.
   np->tmask = p->tmask;
+  np->fault_around = p->fault_around;
 
   #ifdef SCHEDULER_RR
   // 克隆时沿用父进程的时间片配置
@@ -803,6 +817,14 @@ clone(void)
   np->max_page_in_mem = p->max_page_in_mem;
   np->mmap_pages_in_mem = 0;
   np->swap_count = 0;
+  np->ws_auto = p->ws_auto;
+  np->ws_estimate = 0;
+  np->ws_faults = 0;
+  np->ws_refaults = 0;
+  np->ws_window = ticks;
+  #ifdef ALGO_CLOCK
+  np->clock_scan = 0;
+  #endif
   #endif
 
   // copy saved user registers.
@@ -832,8 +854,7 @@ clone(void)
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
 
-  if (copy_process_vmas(np, p) < 0) {
-    vma_free(np);
+  if (copy_vmas_unlocked(np, p) < 0) {
     freeproc(np);
     release(&np->lock);
     return -1;
@@ -856,6 +877,129 @@ clone(void)
   return pid;
 }
 
+/**
+ * @brief 实现 vfork 系统调用，创建与父进程共享地址空间的子进程
+ * @return 父进程中返回子进程的 pid，子进程中返回 0，-1 失败
+ * @note 子进程的根页表直接引用父进程用户部分的下级页表，不复制也不修改任何页表项与页引用计数，
+ * @note 因此开销与父进程的大小无关。父进程睡眠到子进程 exec 或退出时由 vfork_release 交还地址空间
+ * @note 与 POSIX vfork 相同，子进程在此期间只能调用 exec 或 exit，不能从调用 vfork 的函数返回，
+ * @note 否则会破坏父进程的栈
+ */
+int
+vfork(void)
+{
+  int i, pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  // Allocate process.
+  if((np = allocproc()) == NULL){
+    return -1;
+  }
+
+  // 借用父进程的用户地址空间：用户部分的根页表项、大小与 VMA 树
+  for(i = 0; i < PX(2, MAXUVA); i++)
+    np->pagetable[i] = p->pagetable[i];
+  np->sz = p->sz;
+  np->vmas = p->vmas;
+  np->vm_owner = p;
+
+  np->parent = p;
+
+  // copy tracing mask from parent.
+  np->tmask = p->tmask;
+  np->fault_around = p->fault_around;
+
+  #ifdef SCHEDULER_RR
+  np->timeslice = p->timeslice;
+  np->slice_remaining = p->timeslice;
+  #endif
+  #ifdef SCHEDULER_PRIORITY
+  np->priority = p->priority;
+  #endif
+  #ifdef SCHEDULER_MLFQ
+  np->priority = p->priority;
+  np->base_priority = p->base_priority;
+  np->ticks_used = 0;
+  np->eval_ticks = 0;
+  np->cpu_ticks = 0;
+  np->sleep_ticks = 0;
+  #endif
+
+  #ifdef ALGO
+  // 驻留的 mmap 页属于借用的地址空间，计数随之转交
+  np->max_page_in_mem = p->max_page_in_mem;
+  np->mmap_pages_in_mem = p->mmap_pages_in_mem;
+  np->ws_auto = p->ws_auto;
+  #endif
+
+  // copy saved user registers.
+  *(np->trapframe) = *(p->trapframe);
+
+  // Cause vfork to return 0 in the child.
+  np->trapframe->a0 = 0;
+
+  // increment reference counts on open file descriptors.
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  np->cwd = edup(p->cwd);
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+
+  pid = np->pid;
+
+  // 地址空间借出期间不能回收父进程的页，否则要刷新的是子进程的 TLB
+  p->vm_busy++;
+
+  np->state = RUNNABLE;
+
+  release(&np->lock);
+
+  acquire(&p->lock);
+  while(np->vm_owner == p)
+    sleep(p, &p->lock);
+  release(&p->lock);
+
+  return pid;
+}
+
+/**
+ * @brief vfork 的子进程 exec 或退出时，把借用的地址空间交还父进程并唤醒它
+ * @param p 当前进程，p->vm_owner 非空
+ * @note 子进程期间新建的根页表项、改变后的大小与 VMA 树一并交还。子进程可能改过共享的页表项，
+ * @note 父进程下次运行时整体刷新 TLB。交还后子进程的根页表中不再有用户部分，释放它不会触及父进程的内存
+ */
+void
+vfork_release(struct proc *p)
+{
+  struct proc *pp = p->vm_owner;
+
+  p->vm_busy++;
+  acquire(&pp->lock);
+  for(int i = 0; i < PX(2, MAXUVA); i++){
+    pp->pagetable[i] = p->pagetable[i];
+    p->pagetable[i] = 0;
+  }
+  pp->sz = p->sz;
+  pp->vmas = p->vmas;
+  #ifdef ALGO
+  pp->mmap_pages_in_mem = p->mmap_pages_in_mem;
+  #endif
+  pp->asid_cpu = -1;
+  pp->vm_busy--;
+  p->vm_owner = NULL;
+  wakeup1(pp);
+  release(&pp->lock);
+
+  p->sz = 0;
+  vma_tree_init(&p->vmas);
+  #ifdef ALGO
+  p->mmap_pages_in_mem = 0;
+  #endif
+  p->vm_busy--;
+}
+
 // Pass p's abandoned children to init.
 // Caller must hold p->lock.
 void
@@ -905,6 +1049,10 @@ exit(int status)
   eput(p->cwd);
   p->cwd = 0;
 
+  // vfork 的子进程先交还借用的地址空间，之后的 VMA 树为空
+  if(p->vm_owner)
+    vfork_release(p);
+
   // 在进程变成 ZOMBIE 之前，释放所有 VMA
   vma_free(p);
 
@@ -997,14 +1145,12 @@ wait(int wpid, uint64 addr)
           // 高 8 位：如果子进程正常终止，这里存储了退出状态码。
           // 所以，这里我们需要左移 8 位，才能通过 waitpid 中的 WEXITSTATUS(wstatus) == 3 宏检查
           status = np->xstate << 8;
-          if (addr != 0 && copyout2(addr, (char*)&status, sizeof(status)) < 0) {
-            release(&np->lock);
-            release(&p->lock);
-            return -1;
-          }
           freeproc(np);
           release(&np->lock);
           release(&p->lock);
+          // 放开锁之后再写回状态：目标页可能尚未映射（如未访问过的 .bss）或已被回收，需要按缺页补上
+          if (addr != 0 && copyout2(addr, (char*)&status, sizeof(status)) < 0)
+            return -1;
           return pid;
         }
         release(&np->lock);
@@ -1034,7 +1180,6 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  extern pagetable_t kernel_pagetable;
 
   #ifdef SCHEDULER_PRIORITY
   c->proc = 0;
@@ -1073,11 +1218,9 @@ scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
-        w_satp(MAKE_SATP(p->kpagetable));
-        sfence_vma();
+        switchuvm(p);
         swtch(&c->context, &p->context);
-        w_satp(MAKE_SATP(kernel_pagetable));
-        sfence_vma();
+        switchkvm();
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -1086,7 +1229,8 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if (found == 0) {
+    // 空闲时先在后台回收页面、补充预清零页池，都无事可做才真正进入 wfi
+    if (found == 0 && kreclaimd() == 0 && kzero_refill() == 0) {
       intr_on();
       asm volatile("wfi");
     }
@@ -1127,11 +1271,9 @@ scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
-        w_satp(MAKE_SATP(p->kpagetable));
-        sfence_vma();
+        switchuvm(p);
         swtch(&c->context, &p->context);
-        w_satp(MAKE_SATP(kernel_pagetable));
-        sfence_vma();
+        switchkvm();
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -1140,7 +1282,8 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if (found == 0) {
+    // 空闲时先在后台回收页面、补充预清零页池，都无事可做才真正进入 wfi
+    if (found == 0 && kreclaimd() == 0 && kzero_refill() == 0) {
       intr_on();
       asm volatile("wfi");
     }
@@ -1168,11 +1311,9 @@ scheduler(void)
         // printf("[scheduler]found runnable proc with pid: %d\n", p->pid);
         p->state = RUNNING;
         c->proc = p;
-        w_satp(MAKE_SATP(p->kpagetable));
-        sfence_vma();
+        switchuvm(p);
         swtch(&c->context, &p->context);
-        w_satp(MAKE_SATP(kernel_pagetable));
-        sfence_vma();
+        switchkvm();
         // Process is done running for now.
         // It should have changed its p->state before coming back.
         c->proc = 0;
@@ -1181,7 +1322,8 @@ scheduler(void)
       }
       release(&p->lock);
     }
-    if(found == 0) {
+    // 空闲时先在后台回收页面、补充预清零页池，都无事可做才真正进入 wfi
+    if(found == 0 && kreclaimd() == 0 && kzero_refill() == 0) {
       intr_on();
       asm volatile("wfi");
     }
@@ -1385,6 +1527,7 @@ procdump(void)
 {
   static char *states[] = {
   [UNUSED]    "unused",
+  [USED]      "used  ",
   [SLEEPING]  "sleep ",
   [RUNNABLE]  "runble",
   [RUNNING]   "run   ",
@@ -0,0 +1,240 @@
+// Page reclaim across processes.
+// When free memory runs low, cached file pages no process
+// maps are dropped first. Then pages are taken back from
+// processes that are not running: clean pages of file
+// mappings are dropped and read again from the file on the
+// next fault, and with ALGO other mmap pages are compressed
+// or written to the swap file. An idle CPU reclaims in the
+// background up to the high watermark; a fault that finds
+// no free page reclaims a batch directly before giving up.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/intr.h"
+#include "include/kalloc.h"
+#include "include/timer.h"
+#include "include/trap.h"
+#include "include/vm.h"
+#include "include/swap.h"
+#include "include/reclaim.h"
+#include "include/pagecache.h"
+#include "include/printf.h"
+
+extern struct proc proc[NPROC];
+
+static struct {
+  struct spinlock lock;   // 保护 cursor
+  int cursor;             // 下一次从 proc[cursor] 开始扫描，回收压力轮流落在各进程上
+  uint idle_fail;         // 后台回收上一次一无所获时的 ticks，同一 tick 内不再重试
+  uint64 nidle;           // 后台回收释放的页数
+  uint64 ndirect;         // 直接回收释放的页数
+  uint64 ncache;          // 丢弃的没有进程映射的页缓存页数
+  uint64 nclean;          // 丢弃的文件映射干净页数
+  uint64 nswap;           // 从其他进程换出到交换文件的页数
+  uint64 nfail;           // 直接回收一页也没有回收到的次数
+} reclaim;
+
+void
+reclaiminit(void)
+{
+  initlock(&reclaim.lock, "reclaim");
+  reclaim.idle_fail = -1;
+}
+
+/**
+ * @brief 判断进程当前能否作为回收对象，调用者持有 p->lock
+ * @note 进程不在运行，也没有在修改自己的地址空间时，它的页表与 VMA 在持锁期间保持不变；
+ *       持有 p->lock 时调度器也不会让它开始运行
+ */
+static int
+reclaimable(struct proc *p)
+{
+  return (p->state == SLEEPING || p->state == RUNNABLE) && p->vm_busy == 0;
+}
+
+#ifdef ALGO
+/**
+ * @brief 按进程自己的置换算法挑一页换出到交换文件
+ * @param p 目标进程，不是当前进程
+ * @return 1 换出了一页，0 没有可换出的页或进程状态已经改变
+ * @note 写交换文件需要睡眠，不能一直持有 p->lock，因此分两步：先摘下页，页本身暂作它在内存中的换出副本，
+ *       此时进程再访问该页，缺页处理会直接把这一页换回；写完后如果它仍是该页的换出副本，才换成交换文件中的位置并释放
+ */
+static int
+reclaim_swap_one(struct proc *p)
+{
+  struct swap_victim victim;
+  struct mmap_vpage *page;
+  struct vma *v;
+  pte_t *pte;
+  char *pa;
+  int pid, level, done = 0;
+
+  acquire(&p->lock);
+  if (!reclaimable(p) || select_victim_page(p, &victim) < 0 ||
+      (pte = walkpte(p->pagetable, victim.va, 0, 0, &level)) == 0 || (*pte & PTE_V) == 0 || level != 0) {
+    release(&p->lock);
+    return 0;
+  }
+  pa = (char *)PTE2PA(*pte);
+  victim.page->dirty = (*pte & PTE_D) != 0;
+  victim.page->state = VMA_PAGE_SWAPPED;
+  victim.page->swap = (swp_entry_t)pa;
+  victim.page->load_time = 0;
+  victim.page->last_access = ticks;
+  *pte = 0;
+  p->asid_cpu = -1;
+  if (p->mmap_pages_in_mem > 0)
+    p->mmap_pages_in_mem--;
+  p->swap_count++;
+  pid = p->pid;
+  // 写盘期间进程可能换回并释放这一页，自己再持有一个引用
+  incref((uint64)pa);
+  release(&p->lock);
+
+  swp_entry_t e = swap_out(pa);
+
+  acquire(&p->lock);
+  if (e && !SWP_INMEM(e) && p->pid == pid && reclaimable(p) &&
+      (v = vma_find(&p->vmas, victim.va)) != 0 &&
+      (page = vma_vpage(v, victim.va, 0)) != 0 &&
+      page->state == VMA_PAGE_SWAPPED && page->swap == (swp_entry_t)pa) {
+    page->swap = e;
+    e = 0;
+    done = 1;
+  }
+  release(&p->lock);
+
+  // 只换成了内存拷贝，或没能换成交换文件与压缩区中的位置时丢掉写出的内容，页仍作为内存中的换出副本
+  swap_free(e);
+  if (done)
+    kfree(pa);
+  kfree(pa);
+  return done;
+}
+#endif
+
+/**
+ * @brief 从当前进程以外的进程中回收至多 nr 页
+ * @param nr 目标页数
+ * @param may_sleep 能否睡眠，决定是否写交换文件，不能睡眠时其他进程的锁只尝试获取
+ * @return 实际回收的页数
+ * @note 先丢弃页缓存中没有进程映射的页，不需要修改任何页表。
+ *       再丢弃文件映射的干净页：第一轮清除访问位，第二轮回收其间没有再被访问的页。
+ *       其中只剩页缓存引用的页解除映射后再从页缓存中丢弃。
+ *       不够时再换出 mmap 页，这只在 ALGO 构建中可行，其他构建不记录匿名页的换出位置
+ */
+static int
+reclaim_scan(int nr, int may_sleep)
+{
+  struct proc *self = myproc();
+  int start, ncache, nunmapped = 0, n;
+
+  acquire(&reclaim.lock);
+  start = reclaim.cursor;
+  reclaim.cursor = (start + 1) % NPROC;
+  release(&reclaim.lock);
+
+  ncache = n = pagecache_shrink(nr);
+  __atomic_fetch_add(&reclaim.ncache, ncache, __ATOMIC_RELAXED);
+
+  for (int pass = 0; pass < 2 && n + nunmapped < nr; pass++) {
+    for (int i = 0; i < NPROC && n + nunmapped < nr; i++) {
+      struct proc *p = &proc[(start + i) % NPROC];
+      if (p == self)
+        continue;
+      // 不能睡眠的调用者可能持有自旋锁（例如 piperead 在 copyout2 中复制 COW 页时持有 pi->lock），
+      // 其他进程的锁只尝试获取、拿不到就跳过，不会与另一个这样回收的 CPU 互相等待
+      if (may_sleep)
+        acquire(&p->lock);
+      else if (!tryacquire(&p->lock))
+        continue;
+      if (reclaimable(p)) {
+        n += vma_reclaim_clean(p, nr - n - nunmapped, &nunmapped);
+        // 页表项被修改过（包括只清除访问位），让它下次运行时按 ASID 刷新 TLB
+        p->asid_cpu = -1;
+      }
+      release(&p->lock);
+    }
+  }
+  __atomic_fetch_add(&reclaim.nclean, n - ncache, __ATOMIC_RELAXED);
+  // 解除了映射的缓存页现在只由页缓存持有，从缓存中丢弃才真正释放
+  if (nunmapped > 0 && n < nr) {
+    int m = pagecache_shrink(nr - n);
+    __atomic_fetch_add(&reclaim.ncache, m, __ATOMIC_RELAXED);
+    n += m;
+  }
+
+  #ifdef ALGO
+  // 第一轮只换出驻留页数超过预算的进程，它们的预算已被工作集估计压缩，多出的页最不可能马上用到
+  for (int pass = 0; pass < 2 && n < nr && may_sleep; pass++) {
+    for (int i = 0; i < NPROC && n < nr; i++) {
+      struct proc *p = &proc[(start + i) % NPROC];
+      if (p == self)
+        continue;
+      while (n < nr && swap_avail() > 0 &&
+             (pass > 0 || p->mmap_pages_in_mem > p->max_page_in_mem) && reclaim_swap_one(p)) {
+        __atomic_fetch_add(&reclaim.nswap, 1, __ATOMIC_RELAXED);
+        n++;
+      }
+    }
+  }
+  #endif
+  return n;
+}
+
+/**
+ * @brief 分配失败时直接回收一批页
+ * @return 回收的页数，0 表示没有可回收的页，调用者只能放弃
+ * @note 回收期间本进程置 vm_busy，不会被其他 CPU 上的回收反过来选中。
+ *       持有自旋锁的调用者不能睡眠，只丢弃干净页，不写交换文件，其他进程的锁也只尝试获取
+ */
+int
+reclaim_direct(void)
+{
+  struct proc *p = myproc();
+  int n;
+
+  p->vm_busy++;
+  n = reclaim_scan(RECLAIM_BATCH, !intr_pushed());
+  p->vm_busy--;
+  if (n == 0)
+    __atomic_fetch_add(&reclaim.nfail, 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&reclaim.ndirect, n, __ATOMIC_RELAXED);
+  return n;
+}
+
+/**
+ * @brief 后台回收，由空闲的 CPU 在调度循环中调用，直到空闲页回到高水位
+ * @return 本次回收的页数，0 表示不需要回收或没有可回收的页，调用者可以进入 wfi
+ * @note 调度器上下文不能睡眠，只丢弃干净页；每次至多 RECLAIM_BATCH 页，以便尽快回到调度循环
+ */
+int
+kreclaimd(void)
+{
+  int nr = kmem_reclaim_wanted();
+
+  if (nr == 0 || __atomic_load_n(&reclaim.idle_fail, __ATOMIC_RELAXED) == ticks)
+    return 0;
+  if (nr > RECLAIM_BATCH)
+    nr = RECLAIM_BATCH;
+  int n = reclaim_scan(nr, 0);
+  if (n == 0)
+    __atomic_store_n(&reclaim.idle_fail, ticks, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&reclaim.nidle, n, __ATOMIC_RELAXED);
+  return n;
+}
+
+/**
+ * @brief 打印页面回收的统计信息
+ */
+void
+reclaimdump(void)
+{
+  printf("reclaim: %d pages in background, %d direct, %d cached dropped, %d clean dropped, %d swapped, %d direct failures\n",
+         (int)reclaim.nidle, (int)reclaim.ndirect, (int)reclaim.ncache, (int)reclaim.nclean,
+         (int)reclaim.nswap, (int)reclaim.nfail);
+}
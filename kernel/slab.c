@@ -0,0 +1,323 @@
+// Slab allocator for small, fixed-size kernel objects,
+// built on top of the page allocator in kalloc.c.
+// Each slab is one physical page: a struct slab header
+// at the start of the page, followed by the objects.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/kalloc.h"
+#include "include/slab.h"
+#include "include/string.h"
+#include "include/printf.h"
+#include "include/intr.h"
+#include "include/proc.h"
+
+#define KMALLOC_MIN_SHIFT 4   // kmalloc 最小的大小类为 16 字节
+#define KMALLOC_MAX_SHIFT 10  // kmalloc 最大的大小类为 1024 字节，更大的请求直接分配整页
+#define KMALLOC_NCLASS    (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+// slab 页首的描述符
+struct slab {
+  struct kmem_cache *cache; // 所属的对象缓存
+  struct slab *next;
+  struct slab *prev;
+  void *freelist;           // 空闲对象链表，链接指针存放在空闲对象的开头
+  uint inuse;               // 已分配出去的对象数
+};
+
+static struct {
+  struct spinlock lock;     // 保护 n
+  struct kmem_cache caches[KMEM_CACHE_MAX];
+  int n;
+} kcaches;
+
+static struct kmem_cache *kmalloc_caches[KMALLOC_NCLASS];
+static char *kmalloc_names[KMALLOC_NCLASS] = {
+  "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+  "kmalloc-256", "kmalloc-512", "kmalloc-1024",
+};
+
+static void
+slab_list_add(struct slab **head, struct slab *s)
+{
+  s->prev = 0;
+  s->next = *head;
+  if (*head)
+    (*head)->prev = s;
+  *head = s;
+}
+
+static void
+slab_list_del(struct slab **head, struct slab *s)
+{
+  if (s->prev)
+    s->prev->next = s->next;
+  else
+    *head = s->next;
+  if (s->next)
+    s->next->prev = s->prev;
+  s->next = s->prev = 0;
+}
+
+/**
+ * @brief 初始化对象缓存子系统，创建 kmalloc 使用的各大小类缓存
+ * @note 必须在 kinit 之后、任何 kmem_cache_create 调用之前执行
+ */
+void
+kmem_cache_init(void)
+{
+  initlock(&kcaches.lock, "kcaches");
+  kcaches.n = 0;
+  for (int i = 0; i < KMALLOC_NCLASS; i++) {
+    kmalloc_caches[i] = kmem_cache_create(kmalloc_names[i], 1 << (i + KMALLOC_MIN_SHIFT), 8);
+    if (kmalloc_caches[i] == 0)
+      panic("kmem_cache_init");
+  }
+  #ifdef DEBUG
+  printf("kmem_cache_init\n");
+  #endif
+}
+
+/**
+ * @brief 创建一个固定大小对象的缓存
+ * @param name 缓存名字，用于统计输出
+ * @param size 对象大小
+ * @param align 对象对齐要求，必须是 2 的幂，0 表示默认 8 字节对齐
+ * @return 对象缓存，0 表示缓存个数已满或对象过大
+ */
+struct kmem_cache*
+kmem_cache_create(char *name, uint size, uint align)
+{
+  struct kmem_cache *c;
+
+  if (align < 8)
+    align = 8;
+  if (size < sizeof(void *))
+    size = sizeof(void *);
+  size = (size + align - 1) & ~(align - 1);
+  uint offset = (sizeof(struct slab) + align - 1) & ~(align - 1);
+  if (offset + size > PGSIZE)
+    return 0;
+
+  acquire(&kcaches.lock);
+  if (kcaches.n >= KMEM_CACHE_MAX) {
+    release(&kcaches.lock);
+    return 0;
+  }
+  c = &kcaches.caches[kcaches.n++];
+  release(&kcaches.lock);
+
+  memset(c, 0, sizeof(*c));
+  safestrcpy(c->name, name, KMEM_CACHE_NAME);
+  c->size = size;
+  c->offset = offset;
+  c->num = (PGSIZE - offset) / size;
+  initlock(&c->lock, "kmem_cache");
+  return c;
+}
+
+/**
+ * @brief 分配一个新的 slab 页并挂到 partial 链表
+ * @param c 对象缓存，调用者必须持有 c->lock
+ * @return 0 成功，-1 物理内存不足
+ */
+static int
+slab_grow(struct kmem_cache *c)
+{
+  struct slab *s = (struct slab *)kalloc();
+  if (s == 0)
+    return -1;
+  pa2page((uint64)s)->flags |= PG_SLAB;
+  s->cache = c;
+  s->inuse = 0;
+  s->freelist = 0;
+  char *obj = (char *)s + c->offset + (c->num - 1) * c->size;
+  for (uint i = 0; i < c->num; i++, obj -= c->size) {
+    *(void **)obj = s->freelist;
+    s->freelist = obj;
+  }
+  slab_list_add(&c->partial, s);
+  c->nslabs++;
+  return 0;
+}
+
+/**
+ * @brief 从 slab 中取出一个空闲对象，必要时分配新的 slab
+ * @param c 对象缓存，调用者必须持有 c->lock
+ * @return 对象地址，0 表示物理内存不足
+ */
+static void *
+slab_get_obj(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *obj;
+
+  if (c->partial == 0 && slab_grow(c) < 0)
+    return 0;
+  s = c->partial;
+  obj = s->freelist;
+  s->freelist = *(void **)obj;
+  s->inuse++;
+  c->inuse++;
+  if (s->inuse == c->num) {
+    slab_list_del(&c->partial, s);
+    slab_list_add(&c->full, s);
+  }
+  return obj;
+}
+
+/**
+ * @brief 将对象放回它所在的 slab，slab 完全空闲时把物理页还给 kalloc
+ * @param c 对象缓存，调用者必须持有 c->lock
+ * @param obj 对象地址
+ * @note 至少保留一个空闲 slab，避免在边界上反复分配 / 释放物理页
+ */
+static void
+slab_put_obj(struct kmem_cache *c, void *obj)
+{
+  struct slab *s = (struct slab *)PGROUNDDOWN((uint64)obj);
+
+  if (s->cache != c || ((char *)obj - (char *)s - c->offset) % c->size != 0)
+    panic("slab_put_obj");
+  if (s->inuse == c->num) {
+    slab_list_del(&c->full, s);
+    slab_list_add(&c->partial, s);
+  }
+  *(void **)obj = s->freelist;
+  s->freelist = obj;
+  s->inuse--;
+  c->inuse--;
+  if (s->inuse == 0 && (c->partial != s || s->next != 0)) {
+    slab_list_del(&c->partial, s);
+    c->nslabs--;
+    pa2page((uint64)s)->flags &= ~PG_SLAB;
+    kfree((void *)s);
+  }
+}
+
+/**
+ * @brief 从对象缓存中分配一个对象
+ * @param c 对象缓存
+ * @return 对象地址，0 表示物理内存不足
+ * @note 优先从本 CPU 的缓存分配，缓存为空时才持锁从 slab 批量补充；对象内容未初始化
+ */
+void *
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  void *obj = 0;
+
+  push_off();
+  struct kmem_cache_cpu *cc = &c->cpu[cpuid()];
+  cc->alloc++;
+  if (cc->avail > 0) {
+    cc->alloc_hit++;
+  } else {
+    acquire(&c->lock);
+    while (cc->avail < SLAB_CPU_BATCH) {
+      void *o = slab_get_obj(c);
+      if (o == 0)
+        break;
+      cc->objs[cc->avail++] = o;
+    }
+    release(&c->lock);
+  }
+  if (cc->avail > 0)
+    obj = cc->objs[--cc->avail];
+  pop_off();
+  return obj;
+}
+
+/**
+ * @brief 释放一个由 kmem_cache_alloc 分配的对象
+ * @param c 分配时使用的对象缓存
+ * @param obj 对象地址
+ * @note 对象先放回本 CPU 的缓存，缓存满时批量归还 slab
+ */
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  push_off();
+  struct kmem_cache_cpu *cc = &c->cpu[cpuid()];
+  cc->free++;
+  if (cc->avail == SLAB_CPU_LIMIT) {
+    acquire(&c->lock);
+    while (cc->avail > SLAB_CPU_LIMIT - SLAB_CPU_BATCH)
+      slab_put_obj(c, cc->objs[--cc->avail]);
+    release(&c->lock);
+  }
+  cc->objs[cc->avail++] = obj;
+  pop_off();
+}
+
+/**
+ * @brief 分配 size 字节的内核内存
+ * @param size 字节数，不能超过 PGSIZE
+ * @return 内存地址，0 表示失败
+ * @note 不超过 1024 字节的请求向上取整到 2 的幂并从对应的大小类缓存分配，
+ *       更大的请求直接分配一整页（页对齐，kmfree 据此区分两种情况）
+ */
+void *
+kmalloc(uint size)
+{
+  if (size > PGSIZE)
+    return 0;
+  if (size > (1 << KMALLOC_MAX_SHIFT))
+    return kalloc();
+  int i = 0;
+  while ((1U << (i + KMALLOC_MIN_SHIFT)) < size)
+    i++;
+  return kmem_cache_alloc(kmalloc_caches[i]);
+}
+
+/**
+ * @brief 释放由 kmalloc 分配的内存
+ * @param obj 内存地址，可以为 0
+ * @note slab 中的对象前面总有 slab 描述符，不会页对齐；页对齐的地址一定是整页分配的
+ */
+void
+kmfree(void *obj)
+{
+  if (obj == 0)
+    return;
+  if ((uint64)obj % PGSIZE == 0) {
+    kfree(obj);
+    return;
+  }
+  struct slab *s = (struct slab *)PGROUNDDOWN((uint64)obj);
+  kmem_cache_free(s->cache, obj);
+}
+
+/**
+ * @brief 打印各对象缓存的使用情况
+ * @note active 为真正被使用的对象数（不含各 CPU 缓存中的空闲对象），
+ *       objsz * active 与 pages * PGSIZE 的差距即为内部碎片和缓存带来的开销
+ */
+void
+kmem_cache_dump(void)
+{
+  int n;
+
+  acquire(&kcaches.lock);
+  n = kcaches.n;
+  release(&kcaches.lock);
+  printf("cache\t\tobjsz\tactive\ttotal\tpages\thit%%\n");
+  for (int i = 0; i < n; i++) {
+    struct kmem_cache *c = &kcaches.caches[i];
+    uint64 alloc = 0, hit = 0;
+    int cached = 0;
+    acquire(&c->lock);
+    for (int j = 0; j < NCPU; j++) {
+      alloc += c->cpu[j].alloc;
+      hit += c->cpu[j].alloc_hit;
+      cached += c->cpu[j].avail;
+    }
+    int active = c->inuse - cached;
+    int total = c->nslabs * c->num;
+    int pages = c->nslabs;
+    release(&c->lock);
+    printf("%s\t%s%d\t%d\t%d\t%d\t%d\n", c->name, strlen(c->name) < 8 ? "\t" : "",
+           c->size, active, total, pages, alloc ? (int)(hit * 100 / alloc) : 0);
+  }
+}
@@ -44,6 +44,22 @@ acquire(struct spinlock *lk)
   lk->cpu = mycpu();
 }
 
+// Try to acquire the lock without spinning.
+// Returns 1 if acquired, 0 if the lock is held,
+// including by this cpu.
+int
+tryacquire(struct spinlock *lk)
+{
+  push_off();
+  if(holding(lk) || __sync_lock_test_and_set(&lk->locked, 1) != 0){
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+  return 1;
+}
+
 // Release the lock.
 void
 release(struct spinlock *lk)
@@ -0,0 +1,152 @@
+// Microbenchmark for the kernel memory primitives.
+// Each primitive runs over a range of sizes until about
+// 1 MiB has been processed, and throughput is reported in
+// bytes per timebase tick next to a plain byte loop doing
+// the same work. The timebase is used instead of rdcycle
+// because S-mode may only read the cycle counter if the
+// SBI allows it, while rdtime always works.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/kalloc.h"
+#include "include/string.h"
+#include "include/printf.h"
+
+#define SB_ORDER  2                 // 缓冲区为 2^2 页
+#define SB_BYTES  (1 << 20)         // 每项测量处理的总字节数
+
+enum { SB_MEMSET, SB_MEMMOVE, SB_UNALIGNED, SB_OVERLAP, SB_MEMCMP, SB_NPRIM };
+
+static char *prim_name[SB_NPRIM] = {
+  [SB_MEMSET]    "memset",
+  [SB_MEMMOVE]   "memmove",
+  [SB_UNALIGNED] "memmove (src+1)",
+  [SB_OVERLAP]   "memmove (overlap)",
+  [SB_MEMCMP]    "memcmp",
+};
+
+static int sizes[] = { 16, 64, 512, 4096, 16000 };
+
+static volatile int sink;   // 保存 memcmp 的结果，避免调用被优化掉
+
+// 原来的逐字节实现，作为对照
+static void
+byte_op(int prim, uchar *a, uchar *b, uint n)
+{
+  switch (prim) {
+  case SB_MEMSET:
+    for (uint i = 0; i < n; i++)
+      a[i] = 0x5a;
+    break;
+  case SB_MEMMOVE:
+  case SB_UNALIGNED:
+    for (uint i = 0; i < n; i++)
+      a[i] = b[i];
+    break;
+  case SB_OVERLAP:
+    for (uint i = n; i-- > 0; )
+      a[i + 8] = a[i];
+    break;
+  case SB_MEMCMP:
+    for (uint i = 0; i < n; i++)
+      if (a[i] != b[i]) {
+        sink = a[i] - b[i];
+        break;
+      }
+    break;
+  }
+}
+
+static void
+fast_op(int prim, uchar *a, uchar *b, uint n)
+{
+  switch (prim) {
+  case SB_MEMSET:
+    memset(a, 0x5a, n);
+    break;
+  case SB_MEMMOVE:
+  case SB_UNALIGNED:
+    memmove(a, b, n);
+    break;
+  case SB_OVERLAP:
+    memmove(a + 8, a, n);
+    break;
+  case SB_MEMCMP:
+    sink = memcmp(a, b, n);
+    break;
+  }
+}
+
+// 处理 SB_BYTES 字节所用的 tick 数，至少为 1
+static uint64
+measure(void (*op)(int, uchar *, uchar *, uint), int prim, uchar *a, uchar *b, uint n)
+{
+  int iters = SB_BYTES / n;
+  uint64 start = r_time();
+
+  for (int i = 0; i < iters; i++)
+    op(prim, a, b, n);
+  uint64 t = r_time() - start;
+  return t ? t : 1;
+}
+
+// 打印每 tick 的字节数，保留两位小数
+static void
+print_rate(char *label, uint64 bytes, uint64 ticks)
+{
+  uint64 r = bytes * 100 / ticks;
+  printf("%s %d.%d%d", label, (int)(r / 100), (int)(r / 10 % 10), (int)(r % 10));
+}
+
+/**
+ * @brief 测量 memset、memmove、memcmp 以及整页复制与清零的吞吐量并打印到控制台
+ * @note 每个计时单位是 1 / CLOCK_FREQ 秒，乘以 CLOCK_FREQ 即得每秒字节数。
+ *       测量期间不关中断，结果包含时钟中断的开销
+ */
+void
+strbench(void)
+{
+  uchar *a = kalloc_pages(SB_ORDER), *b = kalloc_pages(SB_ORDER);
+
+  if (a == 0 || b == 0) {
+    printf("strbench: out of memory\n");
+    goto out;
+  }
+  memset(a, 0, PGSIZE << SB_ORDER);
+  memset(b, 0, PGSIZE << SB_ORDER);
+  #ifdef STRING_RVV
+  printf("strbench: bytes per tick at %d Hz, byte loop vs. word loop / RVV\n", CLOCK_FREQ);
+  #else
+  printf("strbench: bytes per tick at %d Hz, byte loop vs. word loop\n", CLOCK_FREQ);
+  #endif
+  for (int prim = 0; prim < SB_NPRIM; prim++) {
+    for (int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+      uint n = sizes[i];
+      uchar *src = prim == SB_UNALIGNED ? b + 1 : b;
+      uint64 bytes = SB_BYTES / n * n;
+      printf("  %s %d:", prim_name[prim], n);
+      print_rate(" byte", bytes, measure(byte_op, prim, a, src, n));
+      print_rate(", fast", bytes, measure(fast_op, prim, a, src, n));
+      printf("\n");
+    }
+  }
+
+  uint64 start = r_time();
+  for (int i = 0; i < SB_BYTES / PGSIZE; i++)
+    copy_page(a, b);
+  uint64 t = r_time() - start;
+  print_rate("  copy_page:", SB_BYTES, t ? t : 1);
+  start = r_time();
+  for (int i = 0; i < SB_BYTES / PGSIZE; i++)
+    clear_page(a);
+  t = r_time() - start;
+  print_rate(", clear_page:", SB_BYTES, t ? t : 1);
+  printf("\n");
+
+out:
+  if (a)
+    kfree_pages(a, SB_ORDER);
+  if (b)
+    kfree_pages(b, SB_ORDER);
+}
@@ -1,13 +1,101 @@
 #include "include/types.h"
+#include "include/riscv.h"
+#ifdef STRING_RVV
+#include "include/intr.h"
+#endif
+
+// 内存原语按 8 字节的字读写，每轮展开 8 个字。K210 不支持非对齐访问，
+// 只有两个地址对字边界的偏移相同、能同时对齐时才走字循环，否则逐字节处理。
+// 以 RVV=1 构建时，较长的区间改用 RISC-V 向量扩展
+
+#define WSIZE     sizeof(uint64)
+#define WMASK     (WSIZE - 1)
+#define WBLOCK    (8 * WSIZE)   // 展开的一轮处理的字节数
+
+#ifdef STRING_RVV
+// 短于此长度时标量循环更快，也省去开关中断
+#define RVV_MIN   256
+
+// 陷入时不保存向量寄存器，使用期间关中断，不会被另一段使用它们的内核代码打断。
+// e8、m8：每次处理 8 个向量寄存器所能容纳的字节数。
+// 整个循环写在同一段汇编中，v0-v7 声明为被破坏，编译器不会在两段汇编之间改动向量寄存器；
+// vl、vtype 无法声明为被破坏，但只在这段汇编内部由 vsetvli 设置并使用。调用者保证 n > 0
+#define RVV_CLOBBERS "v0", "v1", "v2", "v3", "v4", "v5", "v6", "v7", "memory"
+
+static void
+rvv_memset(uchar *d, int c, uint n)
+{
+  uint64 len = n, vl;
+
+  push_off();
+  asm volatile("vsetvli %1, %0, e8, m8, ta, ma\n\t"
+               "vmv.v.x v0, %3\n"
+               "1:\n\t"
+               "vsetvli %1, %0, e8, m8, ta, ma\n\t"
+               "vse8.v v0, (%2)\n\t"
+               "sub %0, %0, %1\n\t"
+               "add %2, %2, %1\n\t"
+               "bnez %0, 1b"
+               : "+r"(len), "=&r"(vl), "+r"(d) : "r"(c) : RVV_CLOBBERS);
+  pop_off();
+}
+
+// 从低地址向高地址复制，每一段先整段读入再写出，dst 在 src 之前的重叠区间也能正确复制
+static void
+rvv_copy(uchar *d, const uchar *s, uint n)
+{
+  uint64 len = n, vl;
+
+  push_off();
+  asm volatile("1:\n\t"
+               "vsetvli %1, %0, e8, m8, ta, ma\n\t"
+               "vle8.v v0, (%2)\n\t"
+               "vse8.v v0, (%3)\n\t"
+               "sub %0, %0, %1\n\t"
+               "add %2, %2, %1\n\t"
+               "add %3, %3, %1\n\t"
+               "bnez %0, 1b"
+               : "+r"(len), "=&r"(vl), "+r"(s), "+r"(d) : : RVV_CLOBBERS);
+  pop_off();
+}
+#endif
+
+static inline uint64
+fill_word(int c)
+{
+  uint64 w = (uchar)c;
+
+  w |= w << 8;
+  w |= w << 16;
+  w |= w << 32;
+  return w;
+}
 
 void*
 memset(void *dst, int c, uint n)
 {
-  char *cdst = (char *) dst;
-  int i;
-  for(i = 0; i < n; i++){
-    cdst[i] = c;
+  uchar *d = dst;
+
+  #ifdef STRING_RVV
+  if (n >= RVV_MIN) {
+    rvv_memset(d, c, n);
+    return dst;
+  }
+  #endif
+  for (; n > 0 && ((uint64)d & WMASK); n--)
+    *d++ = c;
+  if (n >= WSIZE) {
+    uint64 w = fill_word(c), *wd = (uint64 *)d;
+    for (; n >= WBLOCK; n -= WBLOCK, wd += 8) {
+      wd[0] = w; wd[1] = w; wd[2] = w; wd[3] = w;
+      wd[4] = w; wd[5] = w; wd[6] = w; wd[7] = w;
+    }
+    for (; n >= WSIZE; n -= WSIZE)
+      *wd++ = w;
+    d = (uchar *)wd;
   }
+  while (n-- > 0)
+    *d++ = c;
   return dst;
 }
 
@@ -18,6 +106,14 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  // 按字跳过相同的部分，第一个不同的字再逐字节比较，得到与逐字节比较相同的结果
+  if (((uint64)s1 & WMASK) == ((uint64)s2 & WMASK)) {
+    for (; n > 0 && ((uint64)s1 & WMASK); n--, s1++, s2++)
+      if (*s1 != *s2)
+        return *s1 - *s2;
+    for (; n >= WSIZE && *(const uint64 *)s1 == *(const uint64 *)s2; n -= WSIZE)
+      s1 += WSIZE, s2 += WSIZE;
+  }
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -27,26 +123,119 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// 从低地址向高地址复制，每个字先读后写，d 在 s 之前的重叠区间也能正确复制
+static void
+copy_forward(uchar *d, const uchar *s, uint n)
+{
+  if ((((uint64)d ^ (uint64)s) & WMASK) == 0) {
+    for (; n > 0 && ((uint64)d & WMASK); n--)
+      *d++ = *s++;
+    uint64 *wd = (uint64 *)d;
+    const uint64 *ws = (const uint64 *)s;
+    for (; n >= WBLOCK; n -= WBLOCK, wd += 8, ws += 8) {
+      uint64 a0 = ws[0], a1 = ws[1], a2 = ws[2], a3 = ws[3];
+      uint64 a4 = ws[4], a5 = ws[5], a6 = ws[6], a7 = ws[7];
+      wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+      wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+    }
+    for (; n >= WSIZE; n -= WSIZE)
+      *wd++ = *ws++;
+    d = (uchar *)wd;
+    s = (const uchar *)ws;
+  }
+  while (n-- > 0)
+    *d++ = *s++;
+}
+
+// 从高地址向低地址复制，d、s 指向区间的末尾，d 在 s 之后的重叠区间也能正确复制
+static void
+copy_backward(uchar *d, const uchar *s, uint n)
+{
+  if ((((uint64)d ^ (uint64)s) & WMASK) == 0) {
+    for (; n > 0 && ((uint64)d & WMASK); n--)
+      *--d = *--s;
+    uint64 *wd = (uint64 *)d;
+    const uint64 *ws = (const uint64 *)s;
+    for (; n >= WBLOCK; n -= WBLOCK) {
+      wd -= 8;
+      ws -= 8;
+      uint64 a7 = ws[7], a6 = ws[6], a5 = ws[5], a4 = ws[4];
+      uint64 a3 = ws[3], a2 = ws[2], a1 = ws[1], a0 = ws[0];
+      wd[7] = a7; wd[6] = a6; wd[5] = a5; wd[4] = a4;
+      wd[3] = a3; wd[2] = a2; wd[1] = a1; wd[0] = a0;
+    }
+    for (; n >= WSIZE; n -= WSIZE)
+      *--wd = *--ws;
+    d = (uchar *)wd;
+    s = (const uchar *)ws;
+  }
+  while (n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
-  const char *s;
-  char *d;
+  const uchar *s;
+  uchar *d;
 
   s = src;
   d = dst;
-  if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  if (s == d)
+    return dst;
+  if(s < d && s + n > d)
+    copy_backward(d + n, s + n, n);
+  #ifdef STRING_RVV
+  else if (n >= RVV_MIN)
+    rvv_copy(d, s, n);
+  #endif
+  else
+    copy_forward(d, s, n);
 
   return dst;
 }
 
+/**
+ * @brief 复制一整页
+ * @param dst 目标页（内核地址），页对齐
+ * @param src 源页（内核地址），页对齐，与 dst 不重叠
+ * @note 省去 memmove 的重叠与对齐判断，换页、写时复制等整页复制使用
+ */
+void
+copy_page(void *dst, const void *src)
+{
+  #ifdef STRING_RVV
+  rvv_copy(dst, src, PGSIZE);
+  #else
+  uint64 *wd = dst;
+  const uint64 *ws = src;
+  for (int i = 0; i < PGSIZE / WSIZE; i += 8, wd += 8, ws += 8) {
+    uint64 a0 = ws[0], a1 = ws[1], a2 = ws[2], a3 = ws[3];
+    uint64 a4 = ws[4], a5 = ws[5], a6 = ws[6], a7 = ws[7];
+    wd[0] = a0; wd[1] = a1; wd[2] = a2; wd[3] = a3;
+    wd[4] = a4; wd[5] = a5; wd[6] = a6; wd[7] = a7;
+  }
+  #endif
+}
+
+/**
+ * @brief 将一整页清零
+ * @param dst 页（内核地址），页对齐
+ */
+void
+clear_page(void *dst)
+{
+  #ifdef STRING_RVV
+  rvv_memset(dst, 0, PGSIZE);
+  #else
+  uint64 *wd = dst;
+  for (int i = 0; i < PGSIZE / WSIZE; i += 8, wd += 8) {
+    wd[0] = 0; wd[1] = 0; wd[2] = 0; wd[3] = 0;
+    wd[4] = 0; wd[5] = 0; wd[6] = 0; wd[7] = 0;
+  }
+  #endif
+}
+
 // memcpy exists to placate GCC.  Use memmove.
 void*
 memcpy(void *dst, const void *src, uint n)
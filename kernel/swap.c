@@ -0,0 +1,293 @@
+// Swap space for pages evicted by page replacement.
+// Evicted pages are first compressed into the in-memory
+// store in zram.c. Pages that do not compress well are
+// written to page-sized slots of a preallocated swap file
+// enabled with swapon(). Without one, or once it is full,
+// the page is kept as a copy in memory instead, as before.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/intr.h"
+#include "include/sleeplock.h"
+#include "include/kalloc.h"
+#include "include/fat32.h"
+#include "include/swap.h"
+#include "include/zram.h"
+#include "include/string.h"
+#include "include/printf.h"
+
+#define SWAP_MAP_MAX  255   // 槽位引用计数的上限，再复制时退回到内存拷贝
+
+static struct {
+  struct spinlock lock;   // 保护以下全部字段；交换文件的读写由文件自己的睡眠锁保护
+  struct dirent *ep;      // 交换文件，NULL 表示没有启用
+  uchar *map;             // 每个槽位的引用计数，0 为空闲；fork 后父子进程共享槽位
+  int maporder;           // map 所占伙伴块的阶数
+  uint nslots;            // 槽位总数
+  uint used;              // 已使用的槽位数
+  uint cursor;            // 下一次从这里开始查找空闲槽位
+  uint64 nout;            // 写入交换文件的页数
+  uint64 nin;             // 从交换文件读回的页数
+  uint64 nmem;            // 交换文件不可用而保存在内存中的页数
+  uint64 nzin;            // 从压缩区换入的页数
+  uint64 zin_ticks;       // 从压缩区换入的总耗时（rdtime 计数）
+  uint64 din_ticks;       // 从交换文件换入的总耗时
+} swap;
+
+void
+swapinit(void)
+{
+  initlock(&swap.lock, "swap");
+  zraminit();
+}
+
+/**
+ * @brief 启用交换文件，文件的全部内容（按页取整）都用作槽位
+ * @param ep 已预先分配好大小的普通文件，成功时引用转交给交换区
+ * @return 0 成功，-1 已经启用过、文件过小或内存不足
+ */
+int
+swapon(struct dirent *ep)
+{
+  uint n = ep->file_size / PGSIZE;
+  int order = 0;
+
+  if (n == 0 || (ep->attribute & ATTR_DIRECTORY))
+    return -1;
+  while ((PGSIZE << order) < n)
+    order++;
+  if (order > MAX_ORDER)
+    return -1;
+  uchar *map = (uchar *)kalloc_pages(order);
+  if (map == 0)
+    return -1;
+  memset(map, 0, n);
+
+  acquire(&swap.lock);
+  if (swap.ep) {
+    release(&swap.lock);
+    kfree_pages(map, order);
+    return -1;
+  }
+  swap.ep = ep;
+  swap.map = map;
+  swap.maporder = order;
+  swap.nslots = n;
+  swap.used = 0;
+  swap.cursor = 0;
+  release(&swap.lock);
+  printf("swap: %d KiB on %s\n", (int)(n * (PGSIZE / 1024)), ep->filename);
+  return 0;
+}
+
+// 分配一个空闲槽位，返回槽位号，-1 表示没有交换文件或已满
+static int
+slot_alloc(void)
+{
+  int s = -1;
+
+  acquire(&swap.lock);
+  if (swap.ep && swap.used < swap.nslots) {
+    uint i = swap.cursor;
+    while (swap.map[i] != 0)
+      i = (i + 1) % swap.nslots;
+    swap.map[i] = 1;
+    swap.used++;
+    swap.cursor = (i + 1) % swap.nslots;
+    s = i;
+  }
+  release(&swap.lock);
+  return s;
+}
+
+// 释放槽位的一个引用
+static void
+slot_put(uint s)
+{
+  acquire(&swap.lock);
+  if (swap.map[s] == 0)
+    panic("slot_put");
+  if (--swap.map[s] == 0)
+    swap.used--;
+  release(&swap.lock);
+}
+
+/**
+ * @brief 保存一页的内容，之后页本身可以释放
+ * @param page 要换出的页（内核地址）
+ * @return 换出位置，0 表示交换文件不可用且内存不足
+ * @note 优先压缩保存在内存中；压缩率太差或压缩区已满时写入交换文件，写入同步完成；
+ *       交换文件也不可用时拷贝到新分配的一页中
+ */
+swp_entry_t
+swap_out(char *page)
+{
+  uint64 h;
+
+  if (zram_store(page, &h) == 0)
+    return SWP_ZENTRY(h);
+
+  int s = slot_alloc();
+
+  if (s >= 0) {
+    // 写交换文件会睡眠，调用者不能持有任何自旋锁；页面回收不能睡眠时不会换出 mmap 页
+    if (intr_pushed())
+      panic("swap_out: spinlock held");
+    elock(swap.ep);
+    int n = ewrite(swap.ep, 0, (uint64)page, (uint)s * PGSIZE, PGSIZE);
+    eunlock(swap.ep);
+    if (n == PGSIZE) {
+      __atomic_fetch_add(&swap.nout, 1, __ATOMIC_RELAXED);
+      return SWP_ENTRY(s);
+    }
+    slot_put(s);
+  }
+
+  char *buf = kalloc();
+  if (buf == 0)
+    return 0;
+  copy_page(buf, page);
+  __atomic_fetch_add(&swap.nmem, 1, __ATOMIC_RELAXED);
+  return (swp_entry_t)buf;
+}
+
+/**
+ * @brief 读出一个换出位置保存的内容，位置本身保持不变
+ * @param e 换出位置
+ * @param dst 目标页（内核地址）
+ * @return 0 成功，-1 读交换文件失败或压缩数据损坏
+ */
+int
+swap_read(swp_entry_t e, char *dst)
+{
+  if (SWP_ZRAM(e))
+    return zram_load(SWP_ZHANDLE(e), dst);
+  if (!SWP_ONDISK(e)) {
+    copy_page(dst, (char *)e);
+    return 0;
+  }
+  elock(swap.ep);
+  int n = eread(swap.ep, 0, (uint64)dst, SWP_SLOT(e) * PGSIZE, PGSIZE);
+  eunlock(swap.ep);
+  return n == PGSIZE ? 0 : -1;
+}
+
+/**
+ * @brief 换入：取回一个换出位置保存的内容，并释放该位置
+ * @param e 换出位置
+ * @return 保存内容的页，0 表示内存不足或读失败，此时 e 仍然有效
+ * @note 保存在内存中的页直接交给调用者，不再拷贝；压缩区与交换文件分别统计换入耗时
+ */
+char*
+swap_in(swp_entry_t e)
+{
+  if (SWP_INMEM(e))
+    return (char *)e;
+
+  char *mem = kalloc();
+  if (mem == 0)
+    return 0;
+  uint64 start = r_time();
+  if (swap_read(e, mem) < 0) {
+    kfree(mem);
+    return 0;
+  }
+  if (SWP_ZRAM(e)) {
+    zram_free(SWP_ZHANDLE(e));
+    __atomic_fetch_add(&swap.nzin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&swap.zin_ticks, r_time() - start, __ATOMIC_RELAXED);
+  } else {
+    slot_put(SWP_SLOT(e));
+    __atomic_fetch_add(&swap.nin, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&swap.din_ticks, r_time() - start, __ATOMIC_RELAXED);
+  }
+  return mem;
+}
+
+/**
+ * @brief 为 fork 复制一个换出位置
+ * @param e 换出位置
+ * @return 新的换出位置，0 表示内存不足
+ * @note 交换文件中的槽位只增加引用计数，由父子进程共享；压缩区中的对象直接复制压缩后的数据；
+ *       内存中的页需要拷贝
+ */
+swp_entry_t
+swap_dup(swp_entry_t e)
+{
+  if (SWP_ZRAM(e)) {
+    uint64 h = zram_dup(SWP_ZHANDLE(e));
+    if (h)
+      return SWP_ZENTRY(h);
+  } else if (SWP_ONDISK(e)) {
+    acquire(&swap.lock);
+    if (swap.map[SWP_SLOT(e)] < SWAP_MAP_MAX) {
+      swap.map[SWP_SLOT(e)]++;
+      release(&swap.lock);
+      return e;
+    }
+    release(&swap.lock);
+  }
+
+  char *buf = kalloc();
+  if (buf == 0)
+    return 0;
+  if (swap_read(e, buf) < 0) {
+    kfree(buf);
+    return 0;
+  }
+  return (swp_entry_t)buf;
+}
+
+/**
+ * @brief 丢弃一个换出位置保存的内容
+ * @param e 换出位置，可以为 0
+ */
+void
+swap_free(swp_entry_t e)
+{
+  if (e == 0)
+    return;
+  if (SWP_ZRAM(e))
+    zram_free(SWP_ZHANDLE(e));
+  else if (SWP_ONDISK(e))
+    slot_put(SWP_SLOT(e));
+  else
+    kfree((void *)e);
+}
+
+/**
+ * @brief 还能换出而不占用整页内存的页数的估计：交换文件中空闲的槽位数加上压缩区剩余的页数
+ * @note 压缩区的每一页至少能保存一个换出页，因此估计偏低
+ */
+int
+swap_avail(void)
+{
+  int n;
+
+  acquire(&swap.lock);
+  n = swap.ep ? swap.nslots - swap.used : 0;
+  release(&swap.lock);
+  return n + zram_room();
+}
+
+/**
+ * @brief 打印交换区的使用情况
+ */
+void
+swapdump(void)
+{
+  acquire(&swap.lock);
+  if (swap.ep)
+    printf("swap: %d/%d slots used, ", (int)swap.used, (int)swap.nslots);
+  else
+    printf("swap: no swap file, ");
+  release(&swap.lock);
+  printf("%d pages out, %d pages in, %d pages kept in memory\n",
+         (int)swap.nout, (int)swap.nin, (int)swap.nmem);
+  zramdump();
+  printf("swap-in avg ticks: zram %d (%d pages), disk %d (%d pages)\n",
+         swap.nzin ? (int)(swap.zin_ticks / swap.nzin) : 0, (int)swap.nzin,
+         swap.nin ? (int)(swap.din_ticks / swap.nin) : 0, (int)swap.nin);
+}
@@ -122,6 +122,7 @@ extern uint64 sys_uname(void);
 extern uint64 sys_times(void);
 extern uint64 sys_sched_yield(void);
 extern uint64 sys_clone(void);
+extern uint64 sys_vfork(void);
 extern uint64 sys_waitpid(void);
 extern uint64 sys_getppid(void);
 extern uint64 sys_gettimeofday(void);
@@ -130,6 +131,8 @@ extern uint64 sys_brk(void);
 extern uint64 sys_openat(void);
 extern uint64 sys_mmap(void);
 extern uint64 sys_munmap(void);
+extern uint64 sys_msync(void);
+extern uint64 sys_swapon(void);
 extern uint64 sys_dup3(void);
 extern uint64 sys_pipe(void);
 extern uint64 sys_getdents(void);
@@ -140,6 +143,11 @@ extern uint64 sys_umount(void);
 extern uint64 sys_dup2(void);
 extern uint64 sys_getprocsz(void);
 extern uint64 sys_getpgcnt(void);
+extern uint64 sys_memstat(void);
+extern uint64 sys_faultaround(void);
+extern uint64 sys_getminflt(void);
+extern uint64 sys_getflttime(void);
+extern uint64 sys_strbench(void);
 extern uint64 sys_sem_p(void);
 extern uint64 sys_sem_v(void);
 extern uint64 sys_sem_create(void);
@@ -156,9 +164,10 @@ extern uint64 sys_get_priority(void);
 #ifdef ALGO
 extern uint64 sys_set_max_page_in_mem(void);
 extern uint64 sys_get_swap_count(void);
+extern uint64 sys_get_ws_info(void);
 #endif
 
-#ifdef ALGO_LRU
+#if defined(ALGO_LRU) || defined(ALGO_CLOCK)
 extern uint64 sys_lru_access_notify(void);
 #endif
 
@@ -195,6 +204,7 @@ static uint64 (*syscalls[])(void) = {
   [SYS_times]       sys_times,
   [SYS_sched_yield] sys_sched_yield,
   [SYS_clone]       sys_clone,
+  [SYS_vfork]       sys_vfork,
   [SYS_waitpid]     sys_waitpid,
   [SYS_getppid]     sys_getppid,
   [SYS_gettimeofday] sys_gettimeofday,
@@ -203,6 +213,8 @@ static uint64 (*syscalls[])(void) = {
   [SYS_openat]      sys_openat,
   [SYS_mmap]        sys_mmap,
   [SYS_munmap]      sys_munmap,
+  [SYS_msync]       sys_msync,
+  [SYS_swapon]      sys_swapon,
   [SYS_dup3]        sys_dup3,
   [SYS_pipe]        sys_pipe,
   [SYS_getdents]   sys_getdents,
@@ -223,11 +235,17 @@ static uint64 (*syscalls[])(void) = {
   #endif
   [SYS_getprocsz]   sys_getprocsz,
   [SYS_getpgcnt]    sys_getpgcnt,
+  [SYS_memstat]     sys_memstat,
+  [SYS_faultaround] sys_faultaround,
+  [SYS_getminflt]   sys_getminflt,
+  [SYS_getflttime]  sys_getflttime,
+  [SYS_strbench]    sys_strbench,
   #ifdef ALGO
   [SYS_set_max_page_in_mem] sys_set_max_page_in_mem,
   [SYS_get_swap_count] sys_get_swap_count,
+  [SYS_get_ws_info] sys_get_ws_info,
   #endif
-  #ifdef ALGO_LRU
+  #if defined(ALGO_LRU) || defined(ALGO_CLOCK)
   [SYS_lru_access_notify] sys_lru_access_notify,
   #endif
 };
@@ -265,6 +283,7 @@ static char *sysnames[] = {
   [SYS_times]       "times",
   [SYS_sched_yield] "sched_yield",
   [SYS_clone]       "clone",
+  [SYS_vfork]       "vfork",
   [SYS_waitpid]     "waitpid",
   [SYS_getppid]     "getppid",
   [SYS_gettimeofday] "gettimeofday",
@@ -273,6 +292,8 @@ static char *sysnames[] = {
   [SYS_openat]      "openat",
   [SYS_mmap]        "mmap",
   [SYS_munmap]      "munmap",
+  [SYS_msync]       "msync",
+  [SYS_swapon]      "swapon",
   [SYS_dup3]        "dup3",
   [SYS_pipe]        "pipe",
   [SYS_getdents]    "getdents",
@@ -293,11 +314,17 @@ static char *sysnames[] = {
   #endif
   [SYS_getprocsz]   "getprocsz",
   [SYS_getpgcnt]    "getpgcnt",
+  [SYS_memstat]     "memstat",
+  [SYS_faultaround] "faultaround",
+  [SYS_getminflt]   "getminflt",
+  [SYS_getflttime]  "getflttime",
+  [SYS_strbench]    "strbench",
   #ifdef ALGO
   [SYS_set_max_page_in_mem] "set_max_page_in_mem",
   [SYS_get_swap_count] "get_swap_count",
+  [SYS_get_ws_info] "get_ws_info",
   #endif
-  #ifdef ALGO_LRU
+  #if defined(ALGO_LRU) || defined(ALGO_CLOCK)
   [SYS_lru_access_notify] "lru_access_notify",
   #endif
 };
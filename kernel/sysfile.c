@@ -20,6 +20,7 @@
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/vm.h"
+#include "include/swap.h"
 #include "include/fcntl.h"
 
 struct mount mounts[NMOUNT];
@@ -567,6 +568,31 @@ sys_chdir(void)
   return 0;
 }
 
+/**
+ * @brief 实现 swapon 系统调用，把一个预先分配好大小的普通文件用作交换区
+ * @param path 交换文件路径
+ * @return 0 成功，-1 文件不存在、不是普通文件、小于一页或已经启用过交换区
+ * @note 文件的内容会被覆盖；启用后不能关闭，文件引用一直保留到关机
+ */
+uint64
+sys_swapon(void)
+{
+  char path[FAT32_MAX_PATH];
+  struct dirent *ep;
+
+  if(argstr(0, path, FAT32_MAX_PATH) < 0 || (ep = ename(path)) == NULL){
+    return -1;
+  }
+  elock(ep);
+  int isdir = ep->attribute & ATTR_DIRECTORY;
+  eunlock(ep);
+  if(isdir || swapon(ep) < 0){
+    eput(ep);
+    return -1;
+  }
+  return 0;
+}
+
 uint64
 sys_pipe(void)
 {
@@ -8,11 +8,15 @@
 #include "include/syscall.h"
 #include "include/timer.h"
 #include "include/kalloc.h"
+#include "include/slab.h"
 #include "include/string.h"
 #include "include/printf.h"
 #include "include/sbi.h"
 #include "include/semaphore.h"
 #include "include/vm.h"
+#include "include/sysinfo.h"
+#include "include/reclaim.h"
+#include "include/pagecache.h"
 
 extern int exec(char *path, char **argv);
 
@@ -117,6 +121,16 @@ uint64 sys_clone(void) {
   return clone();
 }
 
+/**
+ * @brief 实现 vfork 系统调用，子进程借用父进程的地址空间直到 exec 或退出
+ * @return 父进程中返回子进程的 pid，子进程中返回 0，-1 失败
+ */
+uint64
+sys_vfork(void)
+{
+  return vfork();
+}
+
 uint64
 sys_wait(void)
 {
@@ -179,6 +193,65 @@ uint64 sys_getpgcnt(void) {
   return allocated_pages();
 }
 
+/**
+ * @brief 实现 memstat 系统调用，在控制台打印内核物理页分配器、各对象缓存以及 ASID/TLB 刷新的统计信息。
+ * @return 0
+ */
+uint64 sys_memstat(void) {
+  kmemdump();
+  kmem_cache_dump();
+  tlbdump();
+  swapdump();
+  pagecachedump();
+  reclaimdump();
+  return 0;
+}
+
+/**
+ * @brief 实现 faultaround 系统调用，设置当前进程缺页预映射窗口的页数，子进程继承该设置
+ * @param npages 窗口页数，1 表示每次缺页只映射一页，0 表示只查询不修改
+ * @return 原来的窗口页数，参数不合法时返回 -1
+ */
+uint64 sys_faultaround(void) {
+  int npages;
+  if (argint(0, &npages) < 0)
+    return -1;
+  if (npages < 0 || npages > FAULT_AROUND_MAX)
+    return -1;
+
+  struct proc* p = myproc();
+  int old = p->fault_around;
+  if (npages > 0)
+    p->fault_around = npages;
+  return old;
+}
+
+/**
+ * @brief 实现 getminflt 系统调用
+ * @return 当前进程由缺页处理直接建立映射的缺页次数
+ */
+uint64 sys_getminflt(void) {
+  return myproc()->minflt;
+}
+
+/**
+ * @brief 实现 getflttime 系统调用
+ * @return 当前进程处理缺页累计用去的 rdtime 计数，每个计数为 1 / CLOCK_FREQ 秒
+ * @note 与 getminflt 配合可得每次缺页的平均耗时，其中包含缺页期间读文件、换入换出的睡眠时间
+ */
+uint64 sys_getflttime(void) {
+  return myproc()->flttime;
+}
+
+/**
+ * @brief 实现 strbench 系统调用，在控制台打印 memset、memmove、memcmp 等内核内存原语的吞吐量
+ * @return 0
+ */
+uint64 sys_strbench(void) {
+  strbench();
+  return 0;
+}
+
 /**
  * @brief 实现 brk 系统调用，用于调整程序数据段（Heap，堆）的大小。
  * @param addr 新的数据段结束地址
@@ -488,10 +561,11 @@ uint64 sys_sched_yield(void) {
 
 /**
  * @brief 实现 mmap 系统调用，将文件映射到进程的地址空间。
- * @param addr 映射的起始地址，只支持 0，即系统自动选择地址
- * @param len 映射的长度，会向上取整到 PGSIZE 的整倍数
+ * @param addr 映射的起始地址。0 表示由系统选择；否则作为建议地址，区域空闲时采用，
+ *             带 MAP_FIXED 时必须页对齐并且一定使用，原有的重叠映射先被取消
+ * @param len 映射的长度，会向上取整到 PGSIZE 的整倍数，不设上限
  * @param prot 映射的权限
- * @param flags 映射的标志，只支持 MAP_SHARED 和 MAP_ANONYMOUS，不支持 MAP_FIXED
+ * @param flags 映射的标志，支持 MAP_SHARED、MAP_PRIVATE、MAP_ANONYMOUS 和 MAP_FIXED
  * @param fd 文件描述符
  * @param offset 文件偏移量，必须是 PGSIZE 的整倍数
  * @return 映射的起始地址，-1 表示失败
@@ -520,38 +594,24 @@ uint64 sys_mmap(void) {
     return -1;
   }
 
-  // 不支持用户指定地址或者固定地址映射
-  if (addr != 0 || (flags & MAP_FIXED)) {
+  // 长度不能超过整个 mmap 区域，向上取整到 PGSIZE 的整倍数
+  if (len > MMAPBASE) {
     return -1;
   }
-
-  // 向上取整到 PGSIZE 的整倍数
   len = PGROUNDUP(len);
 
-  #ifdef ALGO
-  int page_cnt = len / PGSIZE;
-  if (page_cnt > VMA_MAX_TRACKED_PAGES) {
-    return -1;
-  }
-  #endif
-
-  // 寻找一个可用的 VMA 位置
-  struct vma* v = NULL;
-  for (int i = 0; i < NVMA; i++) {
-    if (!p->vmas[i].valid) {
-      v = &p->vmas[i];
-      break;
+  // 映射只能位于堆顶与 MMAPBASE 之间
+  uint64 va;
+  if (flags & MAP_FIXED) {
+    if (addr % PGSIZE != 0 || addr < mmap_lowest(p) || addr > MMAPBASE - len) {
+      return -1;
+    }
+    va = addr;
+  } else {
+    // 虚拟空间地址不足，返回失败
+    if ((va = mmap_find_addr(p, PGROUNDDOWN(addr), len)) == 0) {
+      return -1;
     }
-  }
-  // 没有可用的 VMA 位置，返回失败
-  if (v == NULL) {
-    return -1;
-  }
-
-  uint64 va = mmap_find_addr(p, len);
-  // 虚拟空间地址不足，返回失败
-  if (va == 0) {
-    return -1;
   }
 
   struct file* f = NULL;
@@ -564,16 +624,16 @@ uint64 sys_mmap(void) {
     }
   }
 
+  // 分配一个新的 VMA，数量不设上限
+  struct vma* v = vma_alloc();
+  if (v == NULL) {
+    return -1;
+  }
   v->start = va;
   v->end = va + len;
   v->prot = prot;
   v->flags = flags;
   v->offset = offset;
-  v->valid = 0;
-  
-  #ifdef ALGO
-  v->pages = 0;
-  #endif
   
   // 如果是文件映射，则需要增加文件的引用计数，并保存文件指针
   if (f) {
@@ -584,34 +644,43 @@ uint64 sys_mmap(void) {
   }
 
   #ifdef ALGO
-  v->page_count = page_cnt;
-  v->pages = (struct mmap_vpage*)kalloc();
-  if (v->pages == 0) {
-    if (v->vm_file) {
-      fileclose(v->vm_file);
-      v->vm_file = NULL;
-    }
-    return -1;
-  }
-  memset(v->pages, 0, PGSIZE);
-  for (int i = 0; i < page_cnt && i < VMA_MAX_TRACKED_PAGES; i++) {
-    v->pages[i].state = VMA_PAGE_UNUSED;
-    v->pages[i].swap_data = 0;
-    v->pages[i].load_time = 0;
-    v->pages[i].last_access = 0;
+  // 只分配追踪块目录，追踪块在缺页时按需分配
+  if (vma_pages_init(v) < 0) {
+    goto bad;
   }
   #endif
-  
-  v->valid = 1;
+
+  // MAP_FIXED 覆盖的原有映射先取消；新 VMA 已经准备好，取消只会因拆分时内存不足而失败，此时原有映射的内容不受影响
+  if ((flags & MAP_FIXED) && vma_unmap_range(p, va, va + len) < 0) {
+    goto bad;
+  }
+
+  // 区域此时是空闲的，插入不会失败。插入途中被抢占时 VMA 链表不完整，页面回收必须跳过本进程
+  p->vm_busy++;
+  vma_insert(&p->vmas, v);
+  p->vm_busy--;
 
   return va;
+
+bad:
+  #ifdef ALGO
+  vma_reset_pages(p, v);
+  #endif
+  if (v->vm_file) {
+    fileclose(v->vm_file);
+    v->vm_file = NULL;
+  }
+  vma_release(v);
+  return -1;
 }
 
 /**
  * @brief 实现 munmap 系统调用，取消映射进程的地址空间。
- * @param addr 映射的起始地址
+ * @param addr 映射的起始地址，必须页对齐
  * @param len 映射的长度，会向上取整到 PGSIZE 的整倍数
  * @return 0 成功，-1 失败
+ * @note 范围可以只覆盖某个映射的一部分（VMA 被缩小或一分为二），也可以跨越多个映射或包含空洞；
+ *       只写回范围内共享文件映射的脏页，物理页立即归还给 kalloc
  */
 uint64 sys_munmap(void) {
   uint64 addr;
@@ -622,50 +691,58 @@ uint64 sys_munmap(void) {
     return -1;
   }
 
-  // 地址和长度都需要页对齐。
-  if (addr % PGSIZE != 0) {
+  // 地址需要页对齐，长度向上取整
+  if (addr % PGSIZE != 0 || len < 0) {
     return -1;
   }
-  len = PGROUNDUP(len);
-  if (len == 0) {
+  uint64 end = addr + PGROUNDUP((uint64)len);
+  if (end == addr) {
     return 0; // unmap 长度为0是无操作，直接成功。
   }
+  if (end < addr || end > MAXUVA) {
+    return -1;
+  }
 
-  // 遍历查找要 unmap 的 VMA。
-  // 这个实现简化为：必须完整地 unmap 一个或多个已存在的 VMA。
-  // 不支持部分 unmap（那会使一个 VMA 分裂成两个）。
-  for (int i = 0; i < NVMA; i++) {
-    struct vma* v = &p->vmas[i];
-    // 检查地址和长度是否精确匹配一个 VMA。
-    if (v->valid && v->start == addr && (v->end - v->start) == len) {
-
-      // 写回
-      vma_writeback(p, v);
-
-      // 决定是否释放物理页。
-      int do_free = (v->flags & MAP_SHARED) ? 0 : 1;
-
-      // 调用 vmunmap 清理页表和物理内存。
-      vmunmap(p->pagetable, addr, len / PGSIZE, do_free);
-
-      // 释放对文件的引用。
-      if (v->vm_file) {
-        fileclose(v->vm_file);
-        v->vm_file = NULL;
-      }
+  return vma_unmap_range(p, addr, end);
+}
 
-      #ifdef ALGO
-      vma_reset_pages(p, v);
-      #endif
+/**
+ * @brief 实现 msync 系统调用，将 [addr, addr+len) 范围内共享文件映射的脏页写回文件
+ * @param addr 起始地址，必须页对齐
+ * @param len 长度，会向上取整到 PGSIZE 的整倍数
+ * @param flags MS_ASYNC 或 MS_SYNC，可附加 MS_INVALIDATE
+ * @return 0 成功，-1 参数错误或范围内有未映射的部分
+ * @note 写回总是同步完成，因此 MS_ASYNC 与 MS_SYNC 行为相同；映射页本身就是文件内容的唯一缓存，
+ *       MS_INVALIDATE 无需额外处理。私有映射与匿名映射没有需要写回的内容，直接跳过
+ */
+uint64 sys_msync(void) {
+  uint64 addr;
+  int len, flags;
+  struct proc* p = myproc();
 
-      // 将 VMA 标记为无效。
-      v->valid = 0;
+  if (argaddr(0, &addr) < 0 || argint(1, &len) < 0 || argint(2, &flags) < 0) {
+    return -1;
+  }
+  if (addr % PGSIZE != 0 || len < 0) {
+    return -1;
+  }
+  if ((flags & ~(MS_ASYNC | MS_INVALIDATE | MS_SYNC)) || ((flags & MS_ASYNC) && (flags & MS_SYNC))) {
+    return -1;
+  }
 
-      return 0; // 成功。
-    }
+  uint64 end = addr + PGROUNDUP(len);
+  // 统计被 VMA 覆盖的字节数，用来判断范围内是否有空洞
+  uint64 covered = 0;
+  p->vm_busy++;
+  for (struct vma* v = vma_ceil(&p->vmas, addr); v && v->start < end; v = v->next) {
+    uint64 s = v->start > addr ? v->start : addr;
+    uint64 e = v->end < end ? v->end : end;
+    covered += e - s;
+    vma_sync(p, v, s, e);
   }
+  p->vm_busy--;
 
-  return -1; // 没有找到匹配的 VMA。
+  return covered == end - addr ? 0 : -1;
 }
 
 #ifdef SCHEDULER_RR
@@ -744,10 +821,13 @@ uint64 sys_get_priority(void) {
 #endif
 
 #ifdef ALGO
+extern struct proc proc[NPROC];
+
 /**
  * @brief 设置最大物理页数
- * @param max_page_in_mem 最大物理页数
+ * @param max_page_in_mem 最大物理页数，0 表示交还系统按工作集估计自动调整
  * @return 0 成功，-1 失败
+ * @note 设置了具体页数后预算固定不变，不再自动调整，子进程继承这一设置
  */
 uint64 sys_set_max_page_in_mem(void) {
   int max_page_in_mem;
@@ -755,12 +835,20 @@ uint64 sys_set_max_page_in_mem(void) {
     return -1;
   }
 
-  if (max_page_in_mem < 1) {
+  if (max_page_in_mem < 0) {
     return -1;
   }
   struct proc* p = myproc();
   acquire(&p->lock);
-  p->max_page_in_mem = max_page_in_mem;
+  if (max_page_in_mem == 0) {
+    p->ws_auto = 1;
+    p->ws_faults = 0;
+    p->ws_refaults = 0;
+    p->ws_window = ticks;
+  } else {
+    p->ws_auto = 0;
+    p->max_page_in_mem = max_page_in_mem;
+  }
   release(&p->lock);
 
   return 0;
@@ -777,41 +865,72 @@ uint64 sys_get_swap_count(void) {
   release(&p->lock);
   return count;
 }
+
+/**
+ * @brief 获取各进程的 mmap 驻留预算、驻留页数、工作集估计与换出次数
+ * @param addr 用户空间 struct wsinfo 数组的地址
+ * @param n 数组长度
+ * @return 填入的项数，-1 失败
+ */
+uint64 sys_get_ws_info(void) {
+  uint64 addr;
+  int n, cnt = 0;
+  struct wsinfo info;
+
+  if (argaddr(0, &addr) < 0 || argint(1, &n) < 0 || n < 0) {
+    return -1;
+  }
+  for (struct proc *p = proc; p < &proc[NPROC] && cnt < n; p++) {
+    acquire(&p->lock);
+    if (p->state == UNUSED) {
+      release(&p->lock);
+      continue;
+    }
+    info.pid = p->pid;
+    info.budget = p->max_page_in_mem;
+    info.resident = p->mmap_pages_in_mem;
+    info.estimate = p->ws_estimate;
+    info.swaps = p->swap_count;
+    info.automatic = p->ws_auto;
+    safestrcpy(info.name, p->name, sizeof(info.name));
+    release(&p->lock);
+    // copyout2 可能缺页睡眠，不能持有 p->lock
+    if (copyout2(addr + cnt * sizeof(info), (char *)&info, sizeof(info)) < 0) {
+      return -1;
+    }
+    cnt++;
+  }
+  return cnt;
+}
 #endif
 
-#ifdef ALGO_LRU
+#if defined(ALGO_LRU) || defined(ALGO_CLOCK)
 /**
  * @brief 通知LRU页面替换算法
  * @param addr 地址
  * @return 0 成功，-1 失败
+ * @note CLOCK 算法从页表项的访问位得到访问信息，这里什么也不做，只为兼容为 LRU 编写的程序
  */
 uint64 sys_lru_access_notify(void) {
+  #ifdef ALGO_CLOCK
+  return 0;
+  #else
   uint64 addr;
   if (argaddr(0, &addr) < 0) {
     return -1;
   }
 
   struct proc* p = myproc();
-  struct vma* v = 0;
-  for (int i = 0; i < NVMA; i++) {
-    if (p->vmas[i].valid && addr >= p->vmas[i].start && addr < p->vmas[i].end) {
-      v = &p->vmas[i];
-      break;
-    }
-  }
+  struct vma* v = vma_find(&p->vmas, addr);
   if (v == 0) {
     return -1;
   }
-  uint64 page_base = PGROUNDDOWN(addr);
-  int page_index = (page_base - v->start) / PGSIZE;
-  if (page_index < 0 || page_index >= v->page_count) {
+  struct mmap_vpage* page = vma_vpage(v, PGROUNDDOWN(addr), 0);
+  if (page == 0) {
     return -1;
   }
-  if (v->pages == 0) {
-    return -1;
-  }
-  struct mmap_vpage* page = &v->pages[page_index];
   page->last_access = ticks;
   return 0;
+  #endif
 }
 #endif
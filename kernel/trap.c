@@ -15,8 +15,12 @@
 #include "include/vm.h"
 #include "include/kalloc.h"
 #include "include/string.h"
+#include "include/intr.h"
+#include "include/reclaim.h"
+#include "include/pagecache.h"
 
 extern char trampoline[], uservec[], userret[];
+extern struct proc proc[NPROC];
 
 // in kernelvec.S, calls kerneltrap().
 extern void kernelvec();
@@ -25,7 +29,7 @@ int devintr();
 
 static int handle_user_page_fault(struct proc *p, uint64 scause, uint64 stval);
 static int vma_handler(struct proc *p, uint64 scause, uint64 stval);
-static int lazy_handler(struct proc *p, uint64 stval);
+static int lazy_handler(struct proc *p, uint64 scause, uint64 stval);
 static int cow_handler(struct proc *p, uint64 scause, uint64 stval);
 
 // void
@@ -68,7 +72,9 @@ cow_handler(struct proc *p, uint64 scause, uint64 stval)
   }
 
   uint64 va = PGROUNDDOWN(stval);
-  pte_t *pte = walk(p->pagetable, va, 0);
+  int level;
+  // 只查找不拆分大页，需要修改时由 cow_make_writable 拆分
+  pte_t *pte = walkpte(p->pagetable, va, 0, 0, &level);
   if (pte == 0) {
     return -1;
   }
@@ -85,66 +91,177 @@ cow_handler(struct proc *p, uint64 scause, uint64 stval)
   return 0;
 }
 
+/**
+ * @brief 计算缺页地址 va 的预映射窗口 [*start, *end)
+ * @param p 进程
+ * @param va 缺页地址
+ * @param lo 允许映射的最低地址
+ * @param hi 允许映射的最高地址（不含）
+ * @param start 返回窗口起始地址
+ * @param end 返回窗口结束地址（不含）
+ * @note 窗口包含 va，按 p->fault_around 页对齐，并裁剪到 [lo, hi) 与 va 所在的 2 MiB 区域内，
+ *       因此整个窗口落在同一个 level-0 页表中
+ */
+static void
+fault_around_window(struct proc *p, uint64 va, uint64 lo, uint64 hi, uint64 *start, uint64 *end)
+{
+  uint64 va0 = PGROUNDDOWN(va);
+  uint64 base = SUPERPGROUNDDOWN(va0);
+  uint64 span = (uint64)(p->fault_around > 1 ? p->fault_around : 1) * PGSIZE;
+  uint64 s = va0 - (va0 - base) % span;
+  uint64 e = s + span;
+
+  lo = PGROUNDDOWN(lo);
+  hi = PGROUNDUP(hi);
+  if (s < lo)
+    s = lo;
+  if (e > hi)
+    e = hi;
+  if (e > base + SUPERPGSIZE)
+    e = base + SUPERPGSIZE;
+  *start = s;
+  *end = e;
+}
+
+/**
+ * @brief 为缺页分配一页清零的物理页，内存不足时先直接回收一批页再重试一次
+ * @return 物理页地址，0 表示回收后仍然没有空闲页
+ */
+static void*
+fault_alloc_page(void)
+{
+  void* mem = kalloc_zeroed();
+  if (mem == 0 && reclaim_direct() > 0)
+    mem = kalloc_zeroed();
+  return mem;
+}
+
+/**
+ * @brief 计算映射共享页（共享零页或页缓存中的文件页）时的页表项权限
+ * @param pte_flags 该地址本应使用的权限位
+ * @return 可写的内存去掉 PTE_W、标记 PTE_COW，首次写入时由 cow_handler 换成私有页；只读内存保持不变
+ */
+static int
+shared_pte_flags(int pte_flags)
+{
+  return (pte_flags & PTE_W) ? ((pte_flags & ~PTE_W) | PTE_COW) : pte_flags;
+}
+
 #ifdef ALGO
-struct swap_victim {
-  struct vma* v;
-  struct mmap_vpage* page;
-  int index;
-};
+/**
+ * @brief 采样并清除 mmap 驻留页的访问位（PTE_A）
+ * @param p 进程指针
+ * @return 本估计窗口内访问过的驻留页数。CLOCK 构建在窗口内会多次采样，按 last_access 补上此前采样已清除访问位的页
+ * @note CLOCK 算法：上次采样后访问过的页把 last_access 更新为当前时刻，相当于 CLOCK 算法中的第二次机会；
+ *       之后按 last_access 选择受害者，就是以采样间隔为精度的 LRU，不需要用户程序通知。
+ *       上次采样后才换入的页，触发换入的那次访问已经记在 load_time 中，它的访问位分不清之后是否
+ *       还访问过，保留 last_access 不变。一个追踪块不会跨越 level-0 页表，每块只查找一次页表
+ */
+static int sample_access(struct proc *p)
+{
+  struct tlb_batch tb;
+  int n = 0;
+  #ifdef ALGO_CLOCK
+  uint64 now = ticks;
+  #endif
+
+  tlb_batch_init(&tb, p->pagetable);
+  for (struct vma* v = p->vmas.first; v; v = v->next) {
+    if (v->pages == 0) {
+      continue;
+    }
+    uint64 base = VPAGE_CHUNKNO(v->start) * VPAGE_CHUNK * PGSIZE;
+    for (int i = 0; i < v->nchunk; i++, base += VPAGE_CHUNK * PGSIZE) {
+      struct mmap_vpage* chunk = v->pages[i];
+      pte_t* pte;
+      int level;
+      // 只查找不拆分；mmap 区在页面置换构建中不会映射大页
+      if (chunk == 0 || (pte = walkpte(p->pagetable, base, 0, 0, &level)) == 0 || level != 0) {
+        continue;
+      }
+      for (int j = 0; j < VPAGE_CHUNK; j++, pte++) {
+        if (chunk[j].state != VMA_PAGE_INMEM || (*pte & PTE_V) == 0) {
+          continue;
+        }
+        int accessed = (*pte & PTE_A) != 0;
+        if (accessed) {
+          *pte &= ~PTE_A;
+          tlb_batch_add(&tb, base + (uint64)j * PGSIZE);
+          #ifdef ALGO_CLOCK
+          if (chunk[j].load_time < p->clock_scan)
+            chunk[j].last_access = now;
+          #endif
+        }
+        #ifdef ALGO_CLOCK
+        accessed |= chunk[j].last_access >= p->ws_window;
+        #endif
+        n += accessed;
+      }
+    }
+  }
+  // 清除 PTE_A 后必须刷新 TLB，否则缓存的翻译不会再次设置 PTE_A
+  tlb_batch_flush(&tb);
+  #ifdef ALGO_CLOCK
+  p->clock_scan = now;
+  #endif
+  return n;
+}
 
 /**
  * @brief 从进程的 mmap 区域中挑选可换出的页面。
  * @param p 进程指针
  * @param victim 输出受害者页面信息
  * @return 0 表示找到受害者，-1 表示没有可换页面
+ * @note 只扫描已分配的追踪块，未分配的块里没有驻留页。CLOCK 算法先采样一次访问位。
+ *       全局回收也用它从其他进程中挑选要换出的页
  */
-static int select_victim_page(struct proc *p, struct swap_victim *victim)
+int select_victim_page(struct proc *p, struct swap_victim *victim)
 {
+  #ifdef ALGO_CLOCK
+  sample_access(p);
+  #endif
+
   struct vma* chosen_v = 0;
   struct mmap_vpage* chosen_page = 0;
-  int chosen_index = -1;
+  uint64 chosen_va = 0;
   uint64 chosen_metric = 0;
   uint64 chosen_secondary = 0;
 
-  for (int i = 0; i < NVMA; i++) {
-    struct vma* v = &p->vmas[i];
-    if (!v->valid) {
-      continue;
-    }
+  for (struct vma* v = p->vmas.first; v; v = v->next) {
     if (v->pages == 0) {
       continue;
     }
-    int total_pages = v->page_count;
-    if (total_pages <= 0) {
-      total_pages = (v->end - v->start) / PGSIZE;
-    }
-    if (total_pages > VMA_MAX_TRACKED_PAGES) {
-      total_pages = VMA_MAX_TRACKED_PAGES;
-    }
-    for (int idx = 0; idx < total_pages; idx++) {
-      struct mmap_vpage* page = &v->pages[idx];
-      if (page->state != VMA_PAGE_INMEM) {
+    uint64 base = VPAGE_CHUNKNO(v->start) * VPAGE_CHUNK * PGSIZE;
+    for (int i = 0; i < v->nchunk; i++) {
+      struct mmap_vpage* chunk = v->pages[i];
+      if (chunk == 0) {
         continue;
       }
-      uint64 metric;
-      uint64 secondary;
-
-      #ifdef ALGO_FIFO
-      metric = page->load_time;
-      secondary = page->last_access;
-      #else
-      metric = page->last_access;
-      secondary = page->load_time;
-      #endif
-      
-      if (chosen_page == 0 ||
-          metric < chosen_metric ||
-          (metric == chosen_metric && secondary < chosen_secondary)) {
-        chosen_page = page;
-        chosen_v = v;
-        chosen_index = idx;
-        chosen_metric = metric;
-        chosen_secondary = secondary;
+      for (int j = 0; j < VPAGE_CHUNK; j++) {
+        struct mmap_vpage* page = &chunk[j];
+        if (page->state != VMA_PAGE_INMEM) {
+          continue;
+        }
+        uint64 metric;
+        uint64 secondary;
+
+        #ifdef ALGO_FIFO
+        metric = page->load_time;
+        secondary = page->last_access;
+        #else
+        metric = page->last_access;
+        secondary = page->load_time;
+        #endif
+
+        if (chosen_page == 0 ||
+            metric < chosen_metric ||
+            (metric == chosen_metric && secondary < chosen_secondary)) {
+          chosen_page = page;
+          chosen_v = v;
+          chosen_va = base + ((uint64)i * VPAGE_CHUNK + j) * PGSIZE;
+          chosen_metric = metric;
+          chosen_secondary = secondary;
+        }
       }
     }
   }
@@ -155,7 +272,7 @@ static int select_victim_page(struct proc *p, struct swap_victim *victim)
 
   victim->v = chosen_v;
   victim->page = chosen_page;
-  victim->index = chosen_index;
+  victim->va = chosen_va;
   return 0;
 }
 
@@ -171,20 +288,22 @@ static int swap_out_one_page(struct proc *p)
     return -1;
   }
 
-  uint64 va = victim.v->start + (uint64)victim.index * PGSIZE;
-  pte_t* pte = walk(p->pagetable, va, 0);
-  if (pte == 0 || (*pte & PTE_V) == 0) {
+  uint64 va = victim.va;
+  int level;
+  pte_t* pte = walkpte(p->pagetable, va, 0, 0, &level);
+  if (pte == 0 || (*pte & PTE_V) == 0 || level != 0) {
     return -1;
   }
   uint64 pa = PTE2PA(*pte);
-  char* buf = kalloc();
-  if (buf == 0) {
+  int dirty = (*pte & PTE_D) != 0;
+  // 压缩保存或写入交换文件后页本身就可以释放，压缩率太差且交换文件不可用时退回到内存拷贝
+  swp_entry_t e = swap_out((char*)pa);
+  if (e == 0) {
     return -1;
   }
-  memmove(buf, (char*)pa, PGSIZE);
   vmunmap(p->pagetable, va, 1, 1);
-  vmunmap(p->kpagetable, va, 1, 0);
-  victim.page->swap_data = buf;
+  victim.page->swap = e;
+  victim.page->dirty = dirty;
   victim.page->state = VMA_PAGE_SWAPPED;
   victim.page->load_time = 0;
   victim.page->last_access = ticks;
@@ -199,13 +318,16 @@ static int swap_out_one_page(struct proc *p)
  * @brief 确保进程 mmap 区域的驻留页数不超过限制，必要时触发换出。
  * @param p 进程指针
  * @return 0 成功，-1 失败
+ * @note 换出可能同步写交换文件，调用时不持有任何自旋锁，进程的 VMA 由 vm_busy 防止被回收改动。
+ *       每次至多换出 FAULT_SWAP_MAX 页：预算被压缩后多出的驻留页分摊到之后的缺页中换出，
+ *       换出过至少一页后，本次缺页映射新页也不会使驻留页数增加
  */
 static int ensure_mmap_budget(struct proc *p)
 {
   if (p->max_page_in_mem <= 0) {
     return 0;
   }
-  while (p->mmap_pages_in_mem >= p->max_page_in_mem) {
+  for (int n = 0; n < FAULT_SWAP_MAX && p->mmap_pages_in_mem >= p->max_page_in_mem; n++) {
     if (swap_out_one_page(p) < 0) {
       return -1;
     }
@@ -213,6 +335,103 @@ static int ensure_mmap_budget(struct proc *p)
   return 0;
 }
 
+/**
+ * @brief 所有进程的 mmap 驻留预算之和的上限（页）
+ */
+static int ws_target(void)
+{
+  return total_pages() * WS_TARGET_PERCENT / 100;
+}
+
+/**
+ * @brief 计算 p 在全局目标之下最多可以使用的预算
+ * @note 其他进程按 min(驻留页数, 预算) 计：超出预算的驻留页是全局回收首先换出的对象，不算占用
+ */
+static int ws_room(struct proc *p)
+{
+  int used = 0;
+
+  for (struct proc *q = proc; q < &proc[NPROC]; q++) {
+    if (q == p) {
+      continue;
+    }
+    acquire(&q->lock);
+    if (q->state != UNUSED && q->state != ZOMBIE) {
+      used += q->mmap_pages_in_mem < q->max_page_in_mem ? q->mmap_pages_in_mem : q->max_page_in_mem;
+    }
+    release(&q->lock);
+  }
+  int room = ws_target() - used;
+  return room > WS_MIN_PAGES ? room : WS_MIN_PAGES;
+}
+
+/**
+ * @brief 压缩空闲进程的预算，为 p 腾出至少 need 页
+ * @return 腾出的页数
+ * @note 两个窗口以上没有从用户态进入过内核的自动调整进程视为空闲，预算降到其工作集估计的一半；
+ *       它们睡眠时不会自己更新估计，只能由需要内存的进程代为压缩
+ */
+static int ws_shrink_idle(struct proc *p, int need)
+{
+  int freed = 0;
+
+  for (struct proc *q = proc; q < &proc[NPROC] && freed < need; q++) {
+    if (q == p) {
+      continue;
+    }
+    acquire(&q->lock);
+    if ((q->state == SLEEPING || q->state == RUNNABLE) && q->ws_auto &&
+        ticks - q->ws_window >= 2 * WS_WINDOW_TICKS && q->max_page_in_mem > WS_MIN_PAGES) {
+      int budget = q->ws_estimate / 2 > WS_MIN_PAGES ? q->ws_estimate / 2 : WS_MIN_PAGES;
+      int res = q->mmap_pages_in_mem;
+      int before = res < q->max_page_in_mem ? res : q->max_page_in_mem;
+      int after = res < budget ? res : budget;
+      if (budget < q->max_page_in_mem) {
+        q->max_page_in_mem = budget;
+        q->ws_estimate = budget;
+        freed += before - after;
+      }
+    }
+    release(&q->lock);
+  }
+  return freed;
+}
+
+/**
+ * @brief 一个估计窗口结束时，更新进程的工作集估计并据此调整 mmap 驻留预算
+ * @param p 当前进程，预算由系统自动调整
+ * @note 估计值为窗口内访问过的驻留页数加上换入次数：被挤出去又要回来的页也属于工作集。
+ *       预算取估计值再留 1/4 余量。窗口内有换入说明预算不够，立即增长到位，但受全局目标限制，
+ *       不够时先压缩空闲进程；没有换入时每个窗口向目标收缩一半，多出的驻留页在之后的缺页中分批换出
+ */
+static void ws_adjust(struct proc *p)
+{
+  int est = sample_access(p) + p->ws_refaults;
+  int want = est + est / 4;
+
+  if (want < WS_MIN_PAGES) {
+    want = WS_MIN_PAGES;
+  }
+  p->ws_estimate = est;
+  if (p->ws_refaults > 0 && want > p->max_page_in_mem) {
+    int room = ws_room(p);
+    if (want > room) {
+      room += ws_shrink_idle(p, want - room);
+    }
+    if (want > room) {
+      want = room;
+    }
+    if (want > p->max_page_in_mem) {
+      p->max_page_in_mem = want;
+    }
+  } else if (want < p->max_page_in_mem) {
+    p->max_page_in_mem -= (p->max_page_in_mem - want + 1) / 2;
+  }
+  p->ws_faults = 0;
+  p->ws_refaults = 0;
+  p->ws_window = ticks;
+}
+
 /**
  * @brief 处理启用页面置换算法时的 VMA 缺页或换入请求。
  * @param p 触发缺页的进程
@@ -226,17 +445,16 @@ static int handle_vma_fault_with_algo(struct proc *p, struct vma *v, uint64 stva
   if (va_page_start < v->start || va_page_start >= v->end) {
     return -1;
   }
-  int page_index = (va_page_start - v->start) / PGSIZE;
-  if (page_index < 0 || page_index >= VMA_MAX_TRACKED_PAGES) {
-    return -1;
-  }
-  if (page_index >= v->page_count) {
-    return -1;
-  }
   if (v->pages == 0) {
     return -1;
   }
-  struct mmap_vpage* page = &v->pages[page_index];
+  struct mmap_vpage* page = vma_vpage(v, va_page_start, 1);
+  if (page == 0 && reclaim_direct() > 0)
+    page = vma_vpage(v, va_page_start, 1);
+  if (page == 0) {
+    printf("vma_handler(): out of memory\n");
+    return -2;
+  }
   if (page->state == VMA_PAGE_INMEM) {
     return 0;
   }
@@ -249,22 +467,33 @@ static int handle_vma_fault_with_algo(struct proc *p, struct vma *v, uint64 stva
   char* mem = 0;
   int from_swap = (page->state == VMA_PAGE_SWAPPED);
   if (from_swap) {
-    if (page->swap_data == 0) {
+    if (page->swap == 0) {
       return -1;
     }
-    mem = page->swap_data;
+    // 换入后换出位置即被释放；换入失败只可能是内存不足，此时换出位置保持不变
+    if ((mem = swap_in(page->swap)) == 0 && reclaim_direct() > 0)
+      mem = swap_in(page->swap);
+    if (mem == 0) {
+      printf("vma_handler(): swap-in failed\n");
+      return -2;
+    }
+    page->swap = 0;
   } else {
-    mem = kalloc();
+    mem = fault_alloc_page();
     if (mem == 0) {
       printf("vma_handler(): out of memory\n");
       return -2;
     }
-    memset(mem, 0, PGSIZE);
     if (v->vm_file) {
       elock(v->vm_file->ep);
       uint64 file_offset = v->offset + (va_page_start - v->start);
-      eread(v->vm_file->ep, 0, (uint64)mem, file_offset, PGSIZE);
+      int r = ereadpage(v->vm_file->ep, mem, file_offset);
       eunlock(v->vm_file->ep);
+      if (r < 0) {
+        kfree(mem);
+        printf("vma_handler(): read failed\n");
+        return -2;
+      }
     }
   }
 
@@ -273,31 +502,189 @@ static int handle_vma_fault_with_algo(struct proc *p, struct vma *v, uint64 stva
   if (v->prot & PROT_WRITE) pte_flags |= PTE_W;
   if (v->prot & PROT_EXEC)  pte_flags |= PTE_X;
 
-  if (mappages(p->pagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags) != 0) {
-    if (!from_swap) {
-      kfree(mem);
+  // 换出前写过的页换入后仍是脏页，否则 munmap 时不会被写回文件
+  int dirty = from_swap && page->dirty ? PTE_D : 0;
+  if (mappages(p->pagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags | dirty) != 0) {
+    kfree(mem);
+    if (from_swap) {
+      // 内容已随 mem 丢弃，进程随后被杀死
+      page->state = VMA_PAGE_UNUSED;
+      page->dirty = 0;
     }
     printf("vma_handler(): mappages failed\n");
     return -2;
   }
-  int kpte_flags = pte_flags & ~PTE_U;
-  if (mappages(p->kpagetable, va_page_start, PGSIZE, (uint64)mem, kpte_flags) != 0) {
-    vmunmap(p->pagetable, va_page_start, 1, 0);
-    if (!from_swap) {
-      kfree(mem);
-    }
-    printf("vma_handler(): kernel mappages failed\n");
-    return -2;
-  }
 
   if (from_swap) {
-    page->swap_data = 0;
+    page->dirty = 0;
   }
   page->state = VMA_PAGE_INMEM;
   uint64 ts = ticks;
   page->load_time = ts;
   page->last_access = ts;
   p->mmap_pages_in_mem++;
+  p->ws_faults++;
+  if (from_swap)
+    p->ws_refaults++;
+
+  // 预映射窗口内从未访问过的页，只使用驻留预算中的空闲额度，不为预取换出页面
+  uint64 start, end;
+  struct tlb_batch tb;
+  fault_around_window(p, va_page_start, v->start, v->end, &start, &end);
+  tlb_batch_init(&tb, p->pagetable);
+  if (v->vm_file)
+    elock(v->vm_file->ep);
+  for (uint64 a = start; a < end; a += PGSIZE) {
+    if (p->max_page_in_mem > 0 && p->mmap_pages_in_mem >= p->max_page_in_mem)
+      break;
+    struct mmap_vpage* np = vma_vpage(v, a, 1);
+    if (np == 0)
+      break;
+    if (a == va_page_start || np->state != VMA_PAGE_UNUSED)
+      continue;
+    char* m = kalloc_zeroed();
+    if (m == 0)
+      break;
+    if (v->vm_file && ereadpage(v->vm_file->ep, m, v->offset + (a - v->start)) < 0) {
+      kfree(m);
+      break;
+    }
+    if (mappages(p->pagetable, a, PGSIZE, (uint64)m, pte_flags) != 0) {
+      kfree(m);
+      break;
+    }
+    tlb_batch_add(&tb, a);
+    np->state = VMA_PAGE_INMEM;
+    np->load_time = ts;
+    np->last_access = ts;
+    p->mmap_pages_in_mem++;
+  }
+  if (v->vm_file)
+    eunlock(v->vm_file->ep);
+  tlb_batch_flush(&tb);
+  return 0;
+}
+#endif
+
+#ifndef ALGO
+/**
+ * @brief 取得要映射到 va 的一页
+ * @param v va 所在的 VMA，堆为 NULL；文件映射时调用者持有文件的锁
+ * @param va 页地址
+ * @param zero 是否映射共享零页
+ * @param cached 是否取页缓存中的共享页
+ * @param first 是否为缺页所在页。是则内存不足时先直接回收一批页再重试，否则只是预取，失败即放弃
+ * @return 物理页，0 表示内存不足或读文件出错
+ */
+static char*
+fault_page(struct vma *v, uint64 va, int zero, int cached, int first)
+{
+  struct file *f = v ? v->vm_file : 0;
+  uint off = f ? v->offset + (va - v->start) : 0;
+  char *mem;
+
+  if (zero)
+    return kzeropage();
+  if (cached) {
+    if ((mem = pagecache_get(f->ep, off)) == 0 && first && reclaim_direct() > 0)
+      mem = pagecache_get(f->ep, off);
+    return mem;
+  }
+  if ((mem = first ? fault_alloc_page() : kalloc_zeroed()) != 0 && f &&
+      ereadpage(f->ep, mem, off) < 0) {
+    kfree(mem);
+    return 0;
+  }
+  return mem;
+}
+
+/**
+ * @brief 为缺页地址所在页建立映射，并顺带映射预映射窗口内其余尚未映射的页
+ * @param p 进程
+ * @param va 缺页地址
+ * @param lo 窗口下界，一般为 VMA 起始地址
+ * @param hi 窗口上界（不含），一般为 VMA 结束地址
+ * @param v 缺页地址所在的 VMA，堆为 NULL
+ * @param pte_flags 用户页表项的权限位
+ * @param write 是否为写缺页
+ * @return 0 成功，-1 缺页所在页已映射或内存不足
+ * @note 缺页所在页最先映射；其余页只是预取，分配失败即停止。文件映射在一次加锁内读完整个窗口。
+ *       堆与匿名私有映射的读缺页把整个窗口映射到共享零页，不分配物理页，稀疏访问的大数组只为写过的页占用内存。
+ *       私有文件映射（包括 exec 映射的程序段）的读缺页映射页缓存中的页，映射同一文件的进程共用一份
+ */
+static int
+map_fault_around(struct proc *p, uint64 va, uint64 lo, uint64 hi, struct vma *v, int pte_flags, int write)
+{
+  uint64 va0 = PGROUNDDOWN(va), start, end, a;
+  struct file *f = v ? v->vm_file : 0;
+  int zero = !write && f == 0 && !(v && (v->flags & MAP_SHARED));
+  int cached = !write && f && !(v->flags & MAP_SHARED);
+  struct tlb_batch tb;
+  pte_t *pte;
+  char *mem;
+
+  if (zero || cached)
+    pte_flags = shared_pte_flags(pte_flags);
+
+  fault_around_window(p, va, lo, hi, &start, &end);
+  // 窗口在同一个 level-0 页表内，只查找一次
+  if ((pte = walk(p->pagetable, start, 1)) == 0)
+    return -1;
+  pte_t *fpte = pte + (va0 - start) / PGSIZE;
+  if (*fpte & PTE_V)
+    return -1;
+
+  if (f)
+    elock(f->ep);
+  if ((mem = fault_page(v, va0, zero, cached, 1)) == 0) {
+    if (f)
+      eunlock(f->ep);
+    return -1;
+  }
+  *fpte = PA2PTE(mem) | pte_flags | PTE_V;
+
+  tlb_batch_init(&tb, p->pagetable);
+  for (a = start; a < end; a += PGSIZE, pte++) {
+    if (a == va0 || (*pte & PTE_V))
+      continue;
+    if ((mem = fault_page(v, a, zero, cached, 0)) == 0)
+      break;
+    *pte = PA2PTE(mem) | pte_flags | PTE_V;
+    tlb_batch_add(&tb, a);
+  }
+  if (f)
+    eunlock(f->ep);
+  tlb_batch_flush(&tb);
+  return 0;
+}
+
+/**
+ * @brief 尝试用一个 2 MiB 大页满足匿名 mmap 区域的缺页
+ * @param p 进程
+ * @param v 缺页地址所在的 VMA
+ * @param stval 缺页地址
+ * @param pte_flags 用户页表项的权限位
+ * @return 0 已映射大页，-1 不满足条件或没有连续物理内存，调用者退回普通页
+ * @note 只有大页完全落在 VMA 内、且该区域在页表中还没有 level-0 页表时才使用
+ */
+static int
+vma_map_superpage(struct proc *p, struct vma *v, uint64 stval, int pte_flags)
+{
+  uint64 base = SUPERPGROUNDDOWN(stval);
+
+  if (v->vm_file || base < v->start || base + SUPERPGSIZE > v->end)
+    return -1;
+  if (!superpage_unmapped(p->pagetable, base))
+    return -1;
+
+  char *mem = kalloc_pages(SUPERPGORDER);
+  if (mem == 0)
+    return -1;
+  memset(mem, 0, SUPERPGSIZE);
+  if (mappages(p->pagetable, base, SUPERPGSIZE, (uint64)mem, pte_flags) != 0) {
+    kfree_pages(mem, SUPERPGORDER);
+    return -1;
+  }
   return 0;
 }
 #endif
@@ -312,13 +699,7 @@ static int handle_vma_fault_with_algo(struct proc *p, struct vma *v, uint64 stva
 static int
 vma_handler(struct proc *p, uint64 scause, uint64 stval)
 {
-  struct vma* v = 0;
-  for (int i = 0; i < NVMA; i++) {
-    if (p->vmas[i].valid && stval >= p->vmas[i].start && stval < p->vmas[i].end) {
-      v = &p->vmas[i];
-      break;
-    }
-  }
+  struct vma* v = vma_find(&p->vmas, stval);
 
   // 没有找到对应的 VMA，返回错误
   if (v == 0) {
@@ -336,6 +717,11 @@ vma_handler(struct proc *p, uint64 scause, uint64 stval)
     return 0;
   }
 
+  // 页已映射，只是硬件不自动维护 A/D 位：补上后返回。脏页写回依赖这里设置的 PTE_D
+  if (uvmmarkaccess(p->pagetable, stval, scause == 15) == 0) {
+    return 0;
+  }
+
   #ifdef ALGO
   int algo_ret = handle_vma_fault_with_algo(p, v, stval);
   if (algo_ret == -1) {
@@ -346,49 +732,21 @@ vma_handler(struct proc *p, uint64 scause, uint64 stval)
   }
   return 0;
   #else
-  // 以下处理由于 VMA 懒分配导致的缺页异常，按需分配物理页并映射到用户页表、内核页表
-  // 计算缺页地址所在的页的起始地址
-  uint64 va_page_start = PGROUNDDOWN(stval);
-  // 分配一页物理内存
-  char* mem = kalloc();
-  // 分配失败，返回错误
-  if (mem == 0) {
-    printf("vma_handler(): out of memory\n");
-    p->killed = 1;
-    return 0;
-  }
-  // 将新分配的页清零
-  memset(mem, 0, PGSIZE);
-
-  // 如果是文件映射，从文件中读取相应内容到新分配的页
-  if (v->vm_file) {
-    elock(v->vm_file->ep);
-    // 计算文件内的偏移量：VMA 文件偏移 + 页在 VMA 内的偏移
-    uint64 file_offset = v->offset + (va_page_start - v->start);
-    // 从文件读取一页内容到内核地址 mem
-    eread(v->vm_file->ep, 0, (uint64)mem, file_offset, PGSIZE);
-    eunlock(v->vm_file->ep);
-  }
-
   // 根据 VMA 的保护权限，设置页表项 PTE 的标志位
   int pte_flags = PTE_U; // PTE_U 表示用户态可访问
   if (v->prot & PROT_READ) pte_flags |= PTE_R;
   if (v->prot & PROT_WRITE) pte_flags |= PTE_W;
   if (v->prot & PROT_EXEC) pte_flags |= PTE_X;
 
-  // 调用 mappages 将物理页 mem 映射到用户虚拟地址 va_page_start
-  if (mappages(p->pagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags) != 0) {
-    // 映射失败，释放刚分配的页
-    kfree(mem);
-    printf("vma_handler(): mappages failed\n");
-    p->killed = 1;
+  // 匿名映射中完整覆盖了一个 2 MiB 对齐区域的部分，写缺页时优先整块映射为大页；读缺页映射共享零页
+  if (scause == 15 && vma_map_superpage(p, v, stval, pte_flags) == 0) {
     return 0;
   }
-  // 同样需要映射到内核页表
-  if (mappages(p->kpagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags & ~PTE_U) != 0) {
-    kfree(mem);
-    vmunmap(p->pagetable, va_page_start, 1, 1);
-    printf("vma_handler(): kernel mappages failed\n");
+
+  // 以下处理由于 VMA 懒分配导致的缺页异常，按需分配物理页并映射到用户页表，
+  // 文件映射从文件中读取相应内容；同时预映射 VMA 内缺页地址周围的页
+  if (map_fault_around(p, stval, v->start, v->end, v, pte_flags, scause == 15) != 0) {
+    printf("vma_handler(): out of memory\n");
     p->killed = 1;
     return 0;
   }
@@ -400,53 +758,58 @@ vma_handler(struct proc *p, uint64 scause, uint64 stval)
 /**
  * @brief 处理堆懒分配的缺页异常
  * @param p 进程
+ * @param scause 异常原因
  * @param stval 异常地址
  * @return 0 成功，-1 失败
+ * @note 读缺页映射共享零页，写缺页才分配私有页
  */
 static int
-lazy_handler(struct proc *p, uint64 stval)
+lazy_handler(struct proc *p, uint64 scause, uint64 stval)
 {
   // 地址超出堆上限地址或者 mmap 区上限地址，返回错误
   if (stval >= p->sz || stval >= MMAPBASE) {
     return -1;
   }
 
-  // 仿照 vma_handler 的逻辑，分配一页物理内存，并映射到用户页表、内核页表
+  // 仿照 vma_handler 的逻辑，分配一页物理内存，并映射到用户页表
   uint64 va_page_start = PGROUNDDOWN(stval);
-  pte_t* pte = walk(p->pagetable, va_page_start, 0);
-  // 如果查到有效 PTE，说明实际已经分配了物理页，直接返回错误
+  int level;
+  pte_t* pte = walkpte(p->pagetable, va_page_start, 0, 0, &level);
+  // 如果查到有效 PTE（包括大页），说明实际已经分配了物理页，直接返回错误
   if (pte && (*pte & PTE_V)) {
     return -1;
   }
 
-  // 分配一页物理内存
-  char* mem = kalloc();
-  // 分配失败，返回错误
-  if (mem == 0) {
-    printf("lazy_handler(): out of memory\n");
-    p->killed = 1;
-    return 0;
-  }
-  // 将新分配的页清零
-  memset(mem, 0, PGSIZE);
-
-  // 用户态页表项标志位
+  #ifdef ALGO
+  // 页面置换构建只在 vma_handler 中实现预映射，堆仍逐页分配
   int pte_flags = PTE_W | PTE_X | PTE_R | PTE_U;
-  if (mappages(p->pagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags) != 0) {
-    kfree(mem);
-    printf("lazy_handler(): mappages failed\n");
+  char* mem;
+  if (scause != 15) {
+    mem = kzeropage();
+    pte_flags = shared_pte_flags(pte_flags);
+  } else {
+    mem = fault_alloc_page();
+  }
+  if (mem == 0 || mappages(p->pagetable, va_page_start, PGSIZE, (uint64)mem, pte_flags) != 0) {
+    if (mem)
+      kfree(mem);
+    printf("lazy_handler(): out of memory\n");
     p->killed = 1;
-    return 0;
   }
-  // 内核态页表项标志位
-  int kpte_flags = pte_flags & ~PTE_U;
-  if (mappages(p->kpagetable, va_page_start, PGSIZE, (uint64)mem, kpte_flags) != 0) {
-    kfree(mem);
-    vmunmap(p->pagetable, va_page_start, 1, 1);
-    printf("lazy_handler(): kernel mappages failed\n");
+  #else
+  // 预映射窗口不超过堆顶，也不进入 mmap 区；exec 映射的程序段位于堆顶之下，窗口同样不能越过它们
+  uint64 lo = 0, hi = p->sz < MMAPBASE ? p->sz : MMAPBASE;
+  struct vma *next = vma_ceil(&p->vmas, stval);
+  struct vma *prev = next ? next->prev : p->vmas.last;
+  if (next && next->start < hi)
+    hi = next->start;
+  if (prev)
+    lo = prev->end;
+  if (map_fault_around(p, stval, lo, hi, 0, PTE_W | PTE_X | PTE_R | PTE_U, scause == 15) != 0) {
+    printf("lazy_handler(): out of memory\n");
     p->killed = 1;
-    return 0;
   }
+  #endif
 
   return 0;
 }
@@ -464,15 +827,64 @@ handle_user_page_fault(struct proc *p, uint64 scause, uint64 stval)
   if (cow_handler(p, scause, stval) == 0) {
     return 0;
   }
+  // 新建的映射只需刷新出错地址，清掉可能缓存的无效翻译
   if (vma_handler(p, scause, stval) == 0) {
+    uvmflushpage(p->pagetable, stval);
+    if (!p->killed)
+      p->minflt++;
     return 0;
   }
-  if (lazy_handler(p, stval) == 0) {
+  if (lazy_handler(p, scause, stval) == 0) {
+    uvmflushpage(p->pagetable, stval);
+    if (!p->killed)
+      p->minflt++;
     return 0;
   }
   return -1;
 }
 
+/**
+ * @brief 内核代替用户访问 va 之前，为其所在页补上映射，包括懒分配、文件映射与被回收的页
+ * @param va 用户虚拟地址
+ * @param write 是否为写访问
+ * @return 0 已映射，-1 地址无效、没有访问权限、内存不足，或调用者持有自旋锁而不能睡眠
+ * @note 没有相应权限的 VMA 直接失败，不像用户态访问那样杀死进程
+ */
+int
+fault_in_page(uint64 va, int write)
+{
+  struct proc *p = myproc();
+  struct vma *v = vma_find(&p->vmas, va);
+  int r;
+
+  if (intr_pushed())
+    return -1;
+  if (v && !(v->prot & (write ? PROT_WRITE : PROT_READ)))
+    return -1;
+  p->vm_busy++;
+  r = handle_user_page_fault(p, write ? 15 : 13, va);
+  p->vm_busy--;
+  return r == 0 && !p->killed ? 0 : -1;
+}
+
+/**
+ * @brief 为 [addr, addr + n) 中尚未映射的用户页补上映射，写访问时还复制 COW 页
+ * @param addr 用户虚拟地址
+ * @param n 长度
+ * @param write 是否为写访问
+ * @note 供随后要在持有自旋锁时拷贝用户数据的调用者（管道、控制台）在加锁之前调用。
+ *       遇到无效地址即停止，由随后的拷贝报错；页在加锁之后仍可能被回收，调用者需要自行处理
+ */
+void
+fault_in_range(uint64 addr, uint64 n, int write)
+{
+  pagetable_t pagetable = myproc()->pagetable;
+
+  for (uint64 va = PGROUNDDOWN(addr); va < addr + n; va += PGSIZE)
+    if (uvmcheck(pagetable, va, write) == 0 && fault_in_page(va, write) < 0)
+      break;
+}
+
 //
 // handle an interrupt, exception, or system call from user space.
 // called from trampoline.S
@@ -495,6 +907,19 @@ usertrap(void)
   // save user program counter.
   p->trapframe->epc = r_sepc();
 
+  #ifdef ALGO
+  // 预算自动调整的进程每个窗口估计一次工作集，从未用过 mmap 的进程跳过
+  if (p->ws_auto && ticks - p->ws_window >= WS_WINDOW_TICKS &&
+      (p->mmap_pages_in_mem > 0 || p->ws_faults > 0))
+    ws_adjust(p);
+  #endif
+  #ifdef ALGO_CLOCK
+  // 周期性采样访问位：距上次采样超过 CLOCK_SCAN_TICKS 后第一次从用户态进入内核时进行，
+  // 进程睡眠期间不访问内存，也就不需要采样
+  if (p->mmap_pages_in_mem > 0 && ticks - p->clock_scan >= CLOCK_SCAN_TICKS)
+    sample_access(p);
+  #endif
+
   // 系统调用，r_scause() == 8，即 syscall
   if (r_scause() == 8) {
     // system call
@@ -522,10 +947,15 @@ usertrap(void)
     // 15: Store/AMO page fault (写缺页)
     // 12: Instruction page fault (取指缺页)
     if (scause == 12 || scause == 13 || scause == 15) {
+      // 处理期间可能因读文件、换入换出而睡眠，标记 vm_busy 使页面回收跳过本进程
+      p->vm_busy++;
+      uint64 start = r_time();
       if (handle_user_page_fault(p, scause, stval) < 0) {
         printf("usertrap(): segfault pid=%d %s, va=%p\n", p->pid, p->name, stval);
         p->killed = 1;
       }
+      p->flttime += r_time() - start;
+      p->vm_busy--;
     }
     else {
       // 如果不是缺页异常，按原逻辑处理未知异常
@@ -573,7 +1003,7 @@ usertrapret(void)
 
   // set up trapframe values that uservec will need when
   // the process next re-enters the kernel.
-  p->trapframe->kernel_satp = r_satp();         // kernel page table
+  p->trapframe->kernel_satp = r_satp();         // same as the user satp since the kernel half is shared
   p->trapframe->kernel_sp = p->kstack + PGSIZE; // process's kernel stack
   p->trapframe->kernel_trap = (uint64)usertrap;
   p->trapframe->kernel_hartid = r_tp();         // hartid for cpuid()
@@ -592,7 +1022,7 @@ usertrapret(void)
 
   // tell trampoline.S the user page table to switch to.
   // printf("[usertrapret]p->pagetable: %p\n", p->pagetable);
-  uint64 satp = MAKE_SATP(p->pagetable);
+  uint64 satp = MAKE_SATP_ASID(p->pagetable, p->asid);
 
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
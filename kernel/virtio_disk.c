@@ -17,6 +17,7 @@
 #include "include/virtio.h"
 #include "include/proc.h"
 #include "include/vm.h"
+#include "include/kalloc.h"
 #include "include/string.h"
 #include "include/printf.h"
 
@@ -26,10 +27,9 @@
 
 static struct disk {
  // memory for virtio descriptors &c for queue 0.
- // this is a global instead of allocated because it must
- // be multiple contiguous pages, which kalloc()
- // doesn't support, and page aligned.
-  char pages[2*PGSIZE];
+ // must be 2 contiguous, page-aligned pages,
+ // allocated from the buddy allocator with kalloc_pages(1).
+  char *pages;
   struct VRingDesc *desc;
   uint16 *avail;
   struct UsedArea *used;
@@ -48,7 +48,7 @@ static struct disk {
   
   struct spinlock vdisk_lock;
   
-} __attribute__ ((aligned (PGSIZE))) disk;
+} disk;
 
 void
 virtio_disk_init(void)
@@ -99,7 +99,9 @@ virtio_disk_init(void)
   if(max < NUM)
     panic("virtio disk max queue too short");
   *R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
-  memset(disk.pages, 0, sizeof(disk.pages));
+  if((disk.pages = kalloc_pages(1)) == 0)
+    panic("virtio disk kalloc_pages");
+  memset(disk.pages, 0, 2*PGSIZE);
   *R(VIRTIO_MMIO_QUEUE_PFN) = ((uint64)disk.pages) >> PGSHIFT;
 
   // desc = pages -- num * VRingDesc
@@ -210,7 +212,7 @@ virtio_disk_rw(struct buf *b, int write)
 
   // buf0 is on a kernel stack, which is not direct mapped,
   // thus the call to kvmpa().
-  disk.desc[idx[0]].addr = (uint64) kwalkaddr(myproc()->kpagetable, (uint64) &buf0);
+  disk.desc[idx[0]].addr = (uint64) kvmpa((uint64) &buf0);
   disk.desc[idx[0]].len = sizeof(buf0);
   disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
   disk.desc[idx[0]].next = idx[1];
@@ -5,9 +5,14 @@
 #include "include/riscv.h"
 #include "include/vm.h"
 #include "include/kalloc.h"
+#include "include/slab.h"
 #include "include/proc.h"
 #include "include/printf.h"
 #include "include/string.h"
+#include "include/intr.h"
+#include "include/trap.h"
+#include "include/reclaim.h"
+#include "include/pagecache.h"
 
 /*
  * the kernel's page table.
@@ -16,17 +21,40 @@ pagetable_t kernel_pagetable;
 
 extern char etext[];  // kernel.ld sets this to end of kernel code.
 extern char trampoline[]; // trampoline.S
+
+/**
+ * @brief 统计页表占用的页表页数
+ * @param pagetable 第 level 级页表
+ * @param level 页表级别，根页表为 2
+ * @param nsuper 累加其中大页叶子的个数
+ * @return 页表页数（包括 pagetable 本身）
+ */
+static int
+pgtblcount(pagetable_t pagetable, int level, int *nsuper)
+{
+  int n = 1;
+  for(int i = 0; i < 512; i++){
+    pte_t pte = pagetable[i];
+    if((pte & PTE_V) == 0)
+      continue;
+    if(PTE_LEAF(pte)){
+      if(level == 1)
+        (*nsuper)++;
+      continue;
+    }
+    n += pgtblcount((pagetable_t)PTE2PA(pte), level - 1, nsuper);
+  }
+  return n;
+}
 /*
  * create a direct-map page table for the kernel.
  */
 void
 kvminit()
 {
-  kernel_pagetable = (pagetable_t) kalloc();
+  kernel_pagetable = (pagetable_t) kalloc_zeroed();
   // printf("kernel_pagetable: %p\n", kernel_pagetable);
 
-  memset(kernel_pagetable, 0, PGSIZE);
-
   // uart registers
   kvmmap(UART_V, UART, PGSIZE, PTE_R | PTE_W);
   
@@ -76,11 +104,17 @@ kvminit()
   // map kernel text executable and read-only.
   kvmmap(KERNBASE, KERNBASE, (uint64)etext - KERNBASE, PTE_R | PTE_X);
   // map kernel data and the physical RAM we'll make use of.
-  kvmmap((uint64)etext, (uint64)etext, PHYSTOP - (uint64)etext, PTE_R | PTE_W);
+  kvmmap((uint64)etext, (uint64)etext, phystop - (uint64)etext, PTE_R | PTE_W);
   // map the trampoline for trap entry/exit to
   // the highest virtual address in the kernel.
   kvmmap(TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
+  // 每个大页叶子都省下了一个 level-0 页表页
+  int nsuper = 0;
+  int npt = pgtblcount(kernel_pagetable, 2, &nsuper);
+  printf("kvminit: kernel page table uses %d pages (%d with 4 KiB pages only), %d megapages\n",
+         npt, npt + nsuper, nsuper);
+
   #ifdef DEBUG
   printf("kvminit\n");
   #endif
@@ -99,6 +133,268 @@ kvminithart()
   #endif
 }
 
+/*
+ * ASID 分配器。ASID 0 留给内核页表，其余按代号（generation）顺序分配：
+ * 进程的 asid_gen 与当前代号相同时沿用原 ASID；本代用完后代号加一，
+ * 所有 hart 在下一次切换地址空间时整体刷新一次 TLB，之后旧代的 ASID 全部作废。
+ */
+static struct {
+  struct spinlock lock;
+  int bits;        // 硬件实现的 ASID 位数，0 表示不支持
+  uint64 gen;      // 当前代号，从 1 开始，进程的 asid_gen 为 0 表示尚未分配
+  uint64 next;     // 本代下一个可分配的 ASID
+  uint64 max;      // ASID 上限（不含）
+  uint64 rollover; // 代号翻转次数
+} asids;
+
+/**
+ * @brief 探测硬件支持的 ASID 位数并初始化 ASID 分配器
+ * @note 在 hart 0 开启分页后调用；向 satp 的 ASID 字段写全 1，读回的值即为实现的位数
+ */
+void
+asidinit(void)
+{
+  uint64 satp = MAKE_SATP(kernel_pagetable);
+
+  w_satp(satp | (SATP_ASID_MASK << SATP_ASID_SHIFT));
+  uint64 mask = SATP2ASID(r_satp());
+  w_satp(satp);
+  sfence_vma();
+
+  initlock(&asids.lock, "asid");
+  asids.bits = 0;
+  while(mask & (1L << asids.bits))
+    asids.bits++;
+  asids.gen = 1;
+  asids.next = 1;
+  asids.max = 1L << asids.bits;
+  asids.rollover = 0;
+  printf("asidinit: %d ASID bits\n", asids.bits);
+}
+
+/**
+ * @brief 切换到进程 p 的地址空间，必要时为其分配新的 ASID
+ * @param p 即将运行的进程
+ * @note 只在以下情况刷新 TLB：代号翻转后的第一次切换（整体刷新），
+ *       地址空间上次运行在别的 hart 上（该 hart 错过了期间的局部刷新，按 ASID 刷新），
+ *       或硬件不支持 ASID（每次按 ASID 0 刷新非全局项）。内核映射带 PTE_G，不受影响
+ */
+void
+switchuvm(struct proc *p)
+{
+  struct cpu *c;
+  int id, full = 0, fresh = 0;
+
+  push_off();
+  c = mycpu();
+  id = cpuid();
+
+  acquire(&asids.lock);
+  if(asids.bits == 0){
+    p->asid = 0;
+  } else if(p->asid_gen != asids.gen){
+    if(asids.next >= asids.max){
+      asids.gen++;
+      asids.next = 1;
+      asids.rollover++;
+      for(int i = 0; i < NCPU; i++)
+        cpus[i].tlb_stale = 1;
+    }
+    p->asid = asids.next++;
+    p->asid_gen = asids.gen;
+    fresh = 1;
+  }
+  if(c->tlb_stale){
+    c->tlb_stale = 0;
+    full = 1;
+  }
+  release(&asids.lock);
+
+  w_satp(MAKE_SATP_ASID(p->pagetable, p->asid));
+  if(full){
+    sfence_vma();
+    c->nfullflush++;
+  } else if(asids.bits == 0 || (!fresh && p->asid_cpu != id)){
+    sfence_vma_asid(p->asid);
+    c->nasidflush++;
+  }
+  p->asid_cpu = id;
+  c->nswitch++;
+  pop_off();
+}
+
+/**
+ * @brief 切回内核页表（ASID 0）
+ * @note 内核页表只含 PTE_G 映射，且内核半部与所有用户页表共享，因此无需刷新 TLB。
+ *       调度器在进程让出 CPU 后仍需切回来，避免停在可能被其他 hart 释放的用户页表上
+ */
+void
+switchkvm(void)
+{
+  w_satp(MAKE_SATP(kernel_pagetable));
+}
+
+/**
+ * @brief 若 pagetable 正是当前 hart 使用的页表，返回其 ASID，否则返回 -1
+ */
+static int
+uvmasid(pagetable_t pagetable)
+{
+  uint64 satp = r_satp();
+  if(SATP2PA(satp) != (uint64)pagetable)
+    return -1;
+  return SATP2ASID(satp);
+}
+
+/**
+ * @brief 修改用户页表中 va 所在页的页表项后，刷新当前 hart 上该地址的 TLB 项
+ * @note 页表不在当前 hart 上使用时什么都不做：地址空间换 hart 运行时 switchuvm 会按 ASID 刷新
+ */
+void
+uvmflushpage(pagetable_t pagetable, uint64 va)
+{
+  int asid = uvmasid(pagetable);
+  if(asid >= 0){
+    sfence_vma_addr(PGROUNDDOWN(va), asid);
+    mycpu()->npageflush++;
+  }
+}
+
+/**
+ * @brief 刷新当前 hart 上 pagetable 对应 ASID 的全部非全局 TLB 项
+ */
+void
+uvmflushall(pagetable_t pagetable)
+{
+  int asid = uvmasid(pagetable);
+  if(asid >= 0){
+    sfence_vma_asid(asid);
+    mycpu()->nasidflush++;
+  }
+}
+
+/**
+ * @brief 开始一个 TLB 刷新批次
+ * @param tb 批次，一般放在调用者的栈上
+ * @param pagetable 本批次修改的用户页表
+ */
+void
+tlb_batch_init(struct tlb_batch *tb, pagetable_t pagetable)
+{
+  tb->pagetable = pagetable;
+  tb->n = 0;
+}
+
+/**
+ * @brief 记录一个页表项被修改或移除的用户地址
+ * @note 超过 TLB_BATCH_MAX 个地址后不再记录，结束时改为按 ASID 整体刷新；
+ *       大页只需记录其中任意一个地址，sfence.vma 会刷掉覆盖该地址的整个叶子
+ */
+void
+tlb_batch_add(struct tlb_batch *tb, uint64 va)
+{
+  if(tb->n < TLB_BATCH_MAX)
+    tb->va[tb->n] = PGROUNDDOWN(va);
+  tb->n++;
+}
+
+/**
+ * @brief 结束批次：地址不多时逐个按地址刷新，否则按 ASID 整体刷新
+ * @note 页表不在当前 hart 上使用时什么都不做，与 uvmflushpage 相同
+ */
+void
+tlb_batch_flush(struct tlb_batch *tb)
+{
+  int asid;
+
+  if(tb->n == 0 || (asid = uvmasid(tb->pagetable)) < 0){
+    tb->n = 0;
+    return;
+  }
+  if(tb->n > TLB_BATCH_MAX){
+    sfence_vma_asid(asid);
+    mycpu()->nasidflush++;
+  } else {
+    for(int i = 0; i < tb->n; i++)
+      sfence_vma_addr(tb->va[i], asid);
+    mycpu()->npageflush += tb->n;
+  }
+  tb->n = 0;
+}
+
+/**
+ * @brief 打印每个 hart 的地址空间切换与 TLB 刷新统计
+ */
+void
+tlbdump(void)
+{
+  printf("asid: %d bits, generation %d, next %d, %d rollovers\n",
+         asids.bits, (int)asids.gen, (int)asids.next, (int)asids.rollover);
+  for(int i = 0; i < NCPU; i++)
+    printf("  hart %d: %d switches, %d page flushes, %d asid flushes, %d full flushes\n",
+           i, (int)cpus[i].nswitch, (int)cpus[i].npageflush,
+           (int)cpus[i].nasidflush, (int)cpus[i].nfullflush);
+}
+
+/**
+ * @brief 从根页表向下查找 va 在第 target 级页表中的页表项
+ * @param pagetable 根页表
+ * @param va 虚拟地址
+ * @param alloc 非 0 时按需分配中间页表页
+ * @param target 目标级别，0 为普通页的页表项，1 为大页的页表项
+ * @param plevel 返回页表项所在的级别
+ * @return 页表项地址，NULL 表示中间页表不存在或分配失败
+ * @note 途中遇到更高一级的叶子（大页）时停下并返回该叶子，*plevel 大于 target；
+ *       返回 NULL 时 *plevel 为无效页表项所在的级别，其覆盖的 LEVELSIZE(*plevel) 范围内都没有映射。
+ *       alloc 为 0 时只查找不修改，适合只读取页表项的调用者；walk 则总是返回 level-0 页表项，途中会拆分大页
+ */
+pte_t *
+walkpte(pagetable_t pagetable, uint64 va, int alloc, int target, int *plevel)
+{
+  int level;
+
+  if(va >= MAXVA)
+    panic("walk");
+
+  for(level = 2; level > target; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      if(PTE_LEAF(*pte))
+        break;
+      pagetable = (pagetable_t)PTE2PA(*pte);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc_zeroed()) == NULL){
+        *plevel = level;
+        return NULL;
+      }
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  *plevel = level;
+  return &pagetable[PX(level, va)];
+}
+
+/**
+ * @brief 将一个大页叶子拆成指向 512 个普通页的 level-0 页表
+ * @param pte 大页的页表项
+ * @return 0 成功，-1 分配页表页失败
+ * @note 拆分前后映射完全相同，因此不需要刷新 TLB
+ */
+static int
+splitpage(pte_t *pte)
+{
+  pagetable_t pt = (pagetable_t)kalloc();
+  uint64 pa = PTE2PA(*pte);
+  uint64 flags = PTE_FLAGS(*pte);
+
+  if(pt == NULL)
+    return -1;
+  for(int i = 0; i < 512; i++)
+    pt[i] = PA2PTE(pa + (uint64)i * PGSIZE) | flags;
+  *pte = PA2PTE(pt) | PTE_V;
+  return 0;
+}
+
 // Return the address of the PTE in page table pagetable
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page-table pages.
@@ -111,25 +407,58 @@ kvminithart()
 //   21..29 -- 9 bits of level-1 index.
 //   12..20 -- 9 bits of level-0 index.
 //    0..11 -- 12 bits of byte offset within the page.
+//
+// Always returns a level-0 PTE: a megapage covering va is
+// split first, so callers may change the PTE of a single page.
+// Returns NULL if the split runs out of memory.
 pte_t *
 walk(pagetable_t pagetable, uint64 va, int alloc)
 {
-  
-  if(va >= MAXVA)
-    panic("walk");
+  int level;
+  pte_t *pte = walkpte(pagetable, va, alloc, 0, &level);
+
+  if(pte == NULL || level == 0)
+    return pte;
+  if(level != 1)
+    panic("walk: gigapage");
+  if(splitpage(pte) < 0)
+    return NULL;
+  return &((pagetable_t)PTE2PA(*pte))[PX(0, va)];
+}
 
-  for(int level = 2; level > 0; level--) {
-    pte_t *pte = &pagetable[PX(level, va)];
-    if(*pte & PTE_V) {
-      pagetable = (pagetable_t)PTE2PA(*pte);
-    } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == NULL)
-        return NULL;
-      memset(pagetable, 0, PGSIZE);
-      *pte = PA2PTE(pagetable) | PTE_V;
-    }
-  }
-  return &pagetable[PX(0, va)];
+/**
+ * @brief 拆分覆盖 va 的大页，使 va 两侧的页可以分别取消映射
+ * @param pagetable 根页表
+ * @param va 虚拟地址，页对齐
+ * @return 0 成功或不需要拆分，-1 分配页表页失败
+ * @note va 按 SUPERPGSIZE 对齐时任何大页都不会被它分开，不必拆分
+ */
+int
+splitsuperpage(pagetable_t pagetable, uint64 va)
+{
+  int level;
+  pte_t *pte;
+
+  if(va % SUPERPGSIZE == 0)
+    return 0;
+  pte = walkpte(pagetable, va, 0, 0, &level);
+  if(pte == NULL || level != 1 || (*pte & PTE_V) == 0)
+    return 0;
+  return splitpage(pte);
+}
+
+/**
+ * @brief 判断以 va 开始的 2 MiB 区域是否可以直接放一个大页
+ * @param pagetable 根页表
+ * @param va 虚拟地址，必须按 SUPERPGSIZE 对齐
+ * @return 1 表示该区域既没有大页也没有 level-0 页表，0 表示已有映射
+ */
+int
+superpage_unmapped(pagetable_t pagetable, uint64 va)
+{
+  int level;
+  pte_t *pte = walkpte(pagetable, va, 0, 1, &level);
+  return pte == NULL || (level == 1 && (*pte & PTE_V) == 0);
 }
 
 // Look up a virtual address, return the physical address,
@@ -140,11 +469,13 @@ walkaddr(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
   uint64 pa;
+  int level;
 
   if(va >= MAXVA)
     return NULL;
 
-  pte = walk(pagetable, va, 0);
+  // 只查找不修改，大页不拆分
+  pte = walkpte(pagetable, va, 0, 0, &level);
   if(pte == 0)
     return NULL;
   if((*pte & PTE_V) == 0)
@@ -152,16 +483,46 @@ walkaddr(pagetable_t pagetable, uint64 va)
   if((*pte & PTE_U) == 0)
     return NULL;
   pa = PTE2PA(*pte);
+  if(level > 0)
+    pa += PGROUNDDOWN(va & ((1L << PXSHIFT(level)) - 1));
   return pa;
 }
 
+/**
+ * @brief 检查内核能否经 sstatus.SUM 直接访问用户页
+ * @param pagetable 用户页表
+ * @param va 用户虚拟地址
+ * @param write 是否为写访问
+ * @return 1 可以直接访问；0 页未映射（包括被回收），或写访问遇到 COW 页，需要先补上映射；-1 没有访问权限
+ * @note 只查找不修改，大页不拆分
+ */
+int
+uvmcheck(pagetable_t pagetable, uint64 va, int write)
+{
+  pte_t *pte;
+  int level;
+
+  if(va >= MAXVA)
+    return -1;
+  pte = walkpte(pagetable, va, 0, 0, &level);
+  if(pte == NULL || (*pte & PTE_V) == 0)
+    return 0;
+  if((*pte & PTE_U) == 0)
+    return -1;
+  if(!write || (*pte & PTE_W))
+    return 1;
+  return (*pte & PTE_COW) ? 0 : -1;
+}
+
 // add a mapping to the kernel page table.
 // only used when booting.
 // does not flush TLB or enable paging.
+// kernel mappings are identical in every address space,
+// so they are marked global and survive ASID-scoped flushes.
 void
 kvmmap(uint64 va, uint64 pa, uint64 sz, int perm)
 {
-  if(mappages(kernel_pagetable, va, sz, pa, perm) != 0)
+  if(mappages(kernel_pagetable, va, sz, pa, perm | PTE_G) != 0)
     panic("kvmmap");
 }
 
@@ -178,44 +539,68 @@ kvmpa(uint64 va)
 uint64
 kwalkaddr(pagetable_t kpt, uint64 va)
 {
-  uint64 off = va % PGSIZE;
   pte_t *pte;
   uint64 pa;
+  int level;
   
-  pte = walk(kpt, va, 0);
+  pte = walkpte(kpt, va, 0, 0, &level);
   if(pte == 0)
     panic("kvmpa");
   if((*pte & PTE_V) == 0)
     panic("kvmpa");
   pa = PTE2PA(*pte);
-  return pa+off;
+  return pa + (va & ((1L << PXSHIFT(level)) - 1));
 }
 
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned. Returns 0 on success, -1 if walk() couldn't
 // allocate a needed page-table page.
+// Where va and pa are both 2 MiB aligned and the rest of the range
+// covers a whole megapage, a single level-1 leaf is installed instead
+// of a level-0 page-table page.
+// The tree is walked once per level-0 page-table page; the PTEs of a
+// contiguous run are then filled in without going back to the root.
 int
 mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
 {
   uint64 a, last;
   pte_t *pte;
+  int level;
 
   a = PGROUNDDOWN(va);
   last = PGROUNDDOWN(va + size - 1);
   
   for(;;){
+    if(a % SUPERPGSIZE == 0 && pa % SUPERPGSIZE == 0 && last - a >= SUPERPGSIZE - PGSIZE){
+      if((pte = walkpte(pagetable, a, 1, 1, &level)) == NULL)
+        return -1;
+      // 该 2 MiB 区域还没有 level-0 页表时才能放大页
+      if(level == 1 && (*pte & PTE_V) == 0){
+        *pte = PA2PTE(pa) | perm | PTE_V;
+        if(last - a == SUPERPGSIZE - PGSIZE)
+          break;
+        a += SUPERPGSIZE;
+        pa += SUPERPGSIZE;
+        continue;
+      }
+    }
     if((pte = walk(pagetable, a, 1)) == NULL)
       return -1;
-    if(*pte & PTE_V)
-      panic("remap");
-    *pte = PA2PTE(pa) | perm | PTE_V;
-    if(a == last)
-      break;
-    a += PGSIZE;
-    pa += PGSIZE;
+    for(;;){
+      if(*pte & PTE_V)
+        panic("remap");
+      *pte = PA2PTE(pa) | perm | PTE_V;
+      if(a == last)
+        return 0;
+      a += PGSIZE;
+      pa += PGSIZE;
+      pte++;
+      // 跨入下一个 level-0 页表，回到外层重新查找（并再次考虑大页）
+      if(a % SUPERPGSIZE == 0)
+        break;
+    }
   }
-  return 0;
 }
 
 /**
@@ -226,53 +611,101 @@ mappages(pagetable_t pagetable, uint64 va, uint64 size, uint64 pa, int perm)
  * @param do_free 如果为 1，则释放页面对应的物理内存；如果为 0，则只取消映射
  * @note 在原有基础上进行修改以支持懒加载（Lazy Allocation）
  * @note 如果一个页面因为从未被访问而尚未建立映射，本函数会静默地跳过，而不会触发 panic
+ * @note 每个 level-0 页表只从根查找一次，缺失的中间页表整段跳过；
+ *       移除的地址收集到一个 TLB 刷新批次中，最后统一刷新
  */
 void
 vmunmap(pagetable_t pagetable, uint64 va, uint64 npages, int do_free)
 {
-  uint64 a;
+  uint64 a, end;
   pte_t *pte;
+  int level;
+  struct tlb_batch tb;
 
   // 检查起始地址是否页对齐
   if ((va % PGSIZE) != 0)
     panic("vmunmap: not aligned");
 
-  // 遍历所有需要取消映射的页面地址
-  for (a = va; a < va + npages * PGSIZE; a += PGSIZE) {
+  tlb_batch_init(&tb, pagetable);
+  end = va + npages * PGSIZE;
+  a = va;
+  while (a < end) {
     // 尝试查找该虚拟地址对应的页表项(PTE)，不分配新的页目录（alloc=0）。
-    pte = walk(pagetable, a, 0);
+    pte = walkpte(pagetable, a, 0, 0, &level);
 
     // 懒加载时，mmap 区域直到被访问前，其页表项甚至中间的页目录都可能不存在
-    // 所以，如果 walk 返回 NULL，即页表项不存在（没创建），或者 PTE 的有效位为 0（页尚未映射），都是正常的
-    if (pte == 0 || (*pte & PTE_V) == 0) {
-      // 继续找下一个页面，忽略未映射的页面，不触发 panic
+    // 中间页表不存在时，它覆盖的整段地址都没有映射，直接跳过
+    if (pte == 0) {
+      a = LEVELROUNDDOWN(a, level) + LEVELSIZE(level);
       continue;
     }
-    // 页面被映射，但是不是叶子节点，说明页表结构有问题
-    if (PTE_FLAGS(*pte) == PTE_V) {
-      panic("vmunmap: not a leaf");
-    }
-    // 如果 do_free 标志被设置，则释放该页表项指向的物理内存
-    if (do_free) {
-      uint64 pa = PTE2PA(*pte);
-      kfree((void*)pa);
+    // 大页：整个被覆盖时一次性移除（块由 kalloc_pages 分配，用 kfree_pages 整块释放），否则先拆分再逐页处理
+    if (level == 1) {
+      if ((*pte & PTE_V) == 0) {
+        a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE;
+        continue;
+      }
+      if (a % SUPERPGSIZE == 0 && end - a >= SUPERPGSIZE) {
+        if (do_free)
+          kfree_pages((void*)PTE2PA(*pte), SUPERPGORDER);
+        *pte = 0;
+        tlb_batch_add(&tb, a);
+        a += SUPERPGSIZE;
+        continue;
+      }
+      if (splitpage(pte) < 0)
+        panic("vmunmap: split");
+      pte = &((pagetable_t)PTE2PA(*pte))[PX(0, a)];
+    } else if (level != 0) {
+      panic("vmunmap: gigapage");
     }
-
-    // 将页表项清零，使其无效，完成取消映射
-    *pte = 0;
+    // 在同一个 level-0 页表内顺序处理，直到页表末尾或区间结束
+    do {
+      // PTE 的有效位为 0（页尚未映射）是正常的，忽略未映射的页面，不触发 panic
+      if (*pte & PTE_V) {
+        // 页面被映射，但是不是叶子节点，说明页表结构有问题
+        if (PTE_FLAGS(*pte) == PTE_V) {
+          panic("vmunmap: not a leaf");
+        }
+        // 如果 do_free 标志被设置，则释放该页表项指向的物理内存
+        if (do_free) {
+          uint64 pa = PTE2PA(*pte);
+          kfree((void*)pa);
+        }
+        // 将页表项清零，使其无效，完成取消映射
+        *pte = 0;
+        tlb_batch_add(&tb, a);
+      }
+      pte++;
+      a += PGSIZE;
+    } while (a < end && a % SUPERPGSIZE != 0);
   }
+  tlb_batch_flush(&tb);
+}
+
+// 用户页表中与内核页表共享的根页表项：MAXUVA 以上除 TRAMPOLINE 所在项以外的全部
+// TRAMPOLINE 与每个进程自己的 TRAPFRAME 共用下级页表，因此这一项仍由每个进程单独建立
+static inline int
+kshared(int i)
+{
+  return i >= PX(2, MAXUVA) && i != PX(2, TRAMPOLINE);
 }
 
 // create an empty user page table.
 // returns 0 if out of memory.
+// The kernel half shares kernel_pagetable's lower-level page-table
+// pages, so the kernel keeps running on this page table while it
+// serves the process and reaches user memory with sstatus.SUM.
 pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kalloc_zeroed();
   if(pagetable == NULL)
     return NULL;
-  memset(pagetable, 0, PGSIZE);
+  for(int i = 0; i < 512; i++)
+    if(kshared(i))
+      pagetable[i] = kernel_pagetable[i];
   return pagetable;
 }
 
@@ -280,17 +713,15 @@ uvmcreate()
 // for the very first process.
 // sz must be less than a page.
 void
-uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
+uvminit(pagetable_t pagetable, uchar *src, uint sz)
 {
   char *mem;
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
+  mem = kalloc_zeroed();
   // printf("[uvminit]kalloc: %p\n", mem);
-  memset(mem, 0, PGSIZE);
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
-  mappages(kpagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X);
   memmove(mem, src, sz);
   // for (int i = 0; i < sz; i ++) {
   //   printf("[uvminit]mem: %p, %x\n", mem + i, mem[i]);
@@ -300,7 +731,7 @@ uvminit(pagetable_t pagetable, pagetable_t kpagetable, uchar *src, uint sz)
 // Allocate PTEs and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 uint64
-uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   char *mem;
   uint64 a;
@@ -309,24 +740,26 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
     return oldsz;
 
   oldsz = PGROUNDUP(oldsz);
-  for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
-    if(mem == NULL){
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
-      return 0;
-    }
-    memset(mem, 0, PGSIZE);
-    if (mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R|PTE_U) != 0) {
-      kfree(mem);
-      uvmdealloc(pagetable, kpagetable, a, oldsz);
-      return 0;
-    }
-    if (mappages(kpagetable, a, PGSIZE, (uint64)mem, PTE_W|PTE_X|PTE_R) != 0){
-      int npages = (a - oldsz) / PGSIZE;
-      vmunmap(pagetable, oldsz, npages + 1, 1);   // plus the page allocated above.
-      vmunmap(kpagetable, oldsz, npages, 0);
+  a = oldsz;
+  while(a < newsz){
+    // 每个 level-0 页表只查找一次，其中的页表项顺序填写
+    pte_t *pte = walk(pagetable, a, 1);
+    if(pte == NULL){
+      uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
+    do {
+      mem = kalloc_zeroed();
+      if(mem == NULL){
+        uvmdealloc(pagetable, a, oldsz);
+        return 0;
+      }
+      if(*pte & PTE_V)
+        panic("uvmalloc: remap");
+      *pte = PA2PTE(mem) | PTE_W|PTE_X|PTE_R|PTE_U|PTE_V;
+      pte++;
+      a += PGSIZE;
+    } while(a < newsz && a % SUPERPGSIZE != 0);
   }
   return newsz;
 }
@@ -336,14 +769,13 @@ uvmalloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 new
 // need to be less than oldsz.  oldsz can be larger than the actual
 // process size.  Returns the new process size.
 uint64
-uvmdealloc(pagetable_t pagetable, pagetable_t kpagetable, uint64 oldsz, uint64 newsz)
+uvmdealloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz)
 {
   if(newsz >= oldsz)
     return oldsz;
 
   if(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
     int npages = (PGROUNDUP(oldsz) - PGROUNDUP(newsz)) / PGSIZE;
-    vmunmap(kpagetable, PGROUNDUP(newsz), npages, 0);
     vmunmap(pagetable, PGROUNDUP(newsz), npages, 1);
   }
 
@@ -377,6 +809,10 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 {
   if(sz > 0)
     vmunmap(pagetable, 0, PGROUNDUP(sz)/PGSIZE, 1);
+  // 共享的内核部分属于 kernel_pagetable，先断开再释放
+  for(int i = 0; i < 512; i++)
+    if(kshared(i))
+      pagetable[i] = 0;
   freewalk(pagetable);
 }
 
@@ -388,14 +824,20 @@ uvmfree(pagetable_t pagetable, uint64 sz)
  */
 static void
 revert_cow(pagetable_t pagetable, uint64 upto) {
+  int level;
   for (uint64 va = 0; va < upto; va += PGSIZE) {
-    pte_t* pte = walk(pagetable, va, 0);
-    // 页表项不存在，跳过
-    if (pte == 0)
+    // 只查找不拆分：uvmcopy 共享之前已把大页拆开，剩下的大页都不是 COW 页
+    pte_t* pte = walkpte(pagetable, va, 0, 0, &level);
+    // 中间页表不存在，整段跳过
+    if (pte == 0) {
+      va = LEVELROUNDDOWN(va, level) + LEVELSIZE(level) - PGSIZE;
       continue;
-    // 页表项无效，跳过
-    if ((*pte & PTE_V) == 0)
+    }
+    // 页表项无效或是大页，跳过
+    if ((*pte & PTE_V) == 0 || level != 0) {
+      va = LEVELROUNDDOWN(va, level) + LEVELSIZE(level) - PGSIZE;
       continue;
+    }
     // 页表项不是 COW 页，跳过
     if ((*pte & PTE_COW) == 0)
       continue;
@@ -416,80 +858,100 @@ revert_cow(pagetable_t pagetable, uint64 upto) {
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
-uvmcopy(pagetable_t old, pagetable_t new, pagetable_t knew, uint64 sz)
+uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
-  uint64 pa, i = 0, ki = 0;
+  pte_t *pte, *cpte;
+  uint64 pa, i = 0;
   uint flags;
+  int level;
+  struct tlb_batch tb;
 
+  tlb_batch_init(&tb, old);
   while (i < sz){
-    if((pte = walk(old, i, 0)) == NULL)
-      panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
-      panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    uint64 child_flags = flags;
-    int need_cow = 0;
-
-    // 如果父页是可写或已经是 COW，说明需要共享页
-    // 已经是 COW 的情况：fork() 之后又有 fork()
-    if ((flags & PTE_W) || (flags & PTE_COW)) {
-      // 移除 PTE_W，增加 PTE_COW
-      child_flags &= ~PTE_W;
-      child_flags |= PTE_COW;
-      need_cow = 1;
-    }
-
-    // 将子用户页表项相应虚拟页映射到父进程对应页表项的物理页，权限为 child_flags
-    if (mappages(new, i, PGSIZE, pa, child_flags) != 0) {
-      goto err;
+    // 懒分配的堆中尚未访问过的页没有页表项。这里原先直接 panic，
+    // 懒分配构建中 fork 一个只访问了部分堆的进程就会触发；子进程同样按需分配即可。
+    // 中间页表不存在时整段跳过
+    if((pte = walkpte(old, i, 0, 0, &level)) == NULL){
+      i = LEVELROUNDDOWN(i, level) + LEVELSIZE(level);
+      continue;
     }
-    i += PGSIZE;
-
-    // 内核态页表项需要先移除 PTE_U 和 PTE_COW 标志
-    // PTE_COW 在内核态页表项中没有意义，发生写异常时是根据用户态页表项的 PTE_COW 位来决定是否触发写时复制
-    // 如果触发，会清除同一物理页的所有用户态页面 PTE_COW 位，并新分配物理页然后拷贝数据、更新内核态用户态页表项
-    uint64 kchild_flags = child_flags;
-    kchild_flags &= ~PTE_U;
-    kchild_flags &= ~PTE_COW;
-    if (mappages(knew, ki, PGSIZE, pa, kchild_flags) != 0) {
-      goto err;
+    if(level != 0){
+      if((*pte & PTE_V) == 0){
+        i = SUPERPGROUNDDOWN(i) + SUPERPGSIZE;
+        continue;
+      }
+      // 父进程中的大页先拆分，再按普通页共享
+      if((pte = walk(old, i, 0)) == NULL)
+        goto err;
     }
-    // 增加物理页引用计数
-    incref(pa);
+    // 子进程对应的 level-0 页表同样只查找一次
+    if((cpte = walk(new, i, 1)) == NULL)
+      goto err;
 
-    // 如果需要触发写时复制，则更新父页表项，设置权限与 child_flags 相同
-    // 即无 PTE_W，有 PTE_COW
-    if (need_cow) {
-      *pte = PA2PTE(pa) | child_flags;
-    }
-    ki += PGSIZE;
+    do {
+      if((*pte & PTE_V) == 0)
+        goto next;
+      pa = PTE2PA(*pte);
+      flags = PTE_FLAGS(*pte);
+      uint64 child_flags = flags;
+
+      // 如果父页是可写或已经是 COW，说明需要共享页
+      // 已经是 COW 的情况：fork() 之后又有 fork()
+      if ((flags & PTE_W) || (flags & PTE_COW)) {
+        // 移除 PTE_W，增加 PTE_COW
+        child_flags &= ~PTE_W;
+        child_flags |= PTE_COW;
+      }
+
+      // 将子用户页表项相应虚拟页映射到父进程对应页表项的物理页，权限为 child_flags
+      if (*cpte & PTE_V)
+        panic("uvmcopy: remap");
+      *cpte = PA2PTE(pa) | child_flags;
+
+      // 增加物理页引用计数
+      incref(pa);
+
+      // 如果父页原本可写，则更新父页表项，设置权限与 child_flags 相同
+      // 即无 PTE_W，有 PTE_COW，并记录下来等待刷新 TLB
+      if (flags & PTE_W) {
+        *pte = PA2PTE(pa) | child_flags;
+        tlb_batch_add(&tb, i);
+      }
+    next:
+      pte++;
+      cpte++;
+      i += PGSIZE;
+    } while (i < sz && i % SUPERPGSIZE != 0);
   }
 
-  // 刷新 TLB
-  sfence_vma();
+  // 父进程的可写页变为只读 COW，只需刷新父地址空间中改动过的 TLB 项
+  tlb_batch_flush(&tb);
   return 0;
 
  err:
-  vmunmap(knew, 0, ki / PGSIZE, 0);
-  vmunmap(new, 0, i / PGSIZE, 1);
+  vmunmap(new, 0, PGROUNDUP(i) / PGSIZE, 1);
   revert_cow(old, i);
-  sfence_vma();
+  tlb_batch_flush(&tb);
   return -1;
 }
 
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
-void
+// returns -1 if a megapage covering va cannot be split.
+int
 uvmclear(pagetable_t pagetable, uint64 va)
 {
   pte_t *pte;
-  
-  pte = walk(pagetable, va, 0);
-  if(pte == NULL)
+  int level;
+
+  pte = walkpte(pagetable, va, 0, 0, &level);
+  if(pte == NULL || (*pte & PTE_V) == 0)
     panic("uvmclear");
+  // 只改动一页的权限，覆盖它的大页才需要拆分
+  if(level != 0 && (pte = walk(pagetable, va, 0)) == NULL)
+    return -1;
   *pte &= ~PTE_U;
+  return 0;
 }
 
 // Copy from kernel to user.
@@ -518,7 +980,7 @@ copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 }
 
 /**
- * @brief 对给定虚拟地址所在的页，如果是 COW 页，则根据引用计数决定是直接恢复写权限还是复制一份新页，同时同步更新用户页表和内核页表。
+ * @brief 对给定虚拟地址所在的页，如果是 COW 页，则根据引用计数决定是直接恢复写权限还是复制一份新页。
  * @param p 进程
  * @param va 虚拟地址
  * @return 0 成功，-1 失败
@@ -528,13 +990,17 @@ cow_make_writable(struct proc *p, uint64 va)
 {
   pagetable_t pagetable = p->pagetable;
   uint64 va0 = PGROUNDDOWN(va);
-  pte_t* pte = walk(pagetable, va0, 0);
+  int level;
+  pte_t* pte = walkpte(pagetable, va0, 0, 0, &level);
   // 页表项不存在或无效，返回错误
   if (pte == 0 || (*pte & PTE_V) == 0)
     return -1;
   // 页表项不是 COW 页，直接返回
   if((*pte & PTE_COW) == 0)
     return 0;
+  // 只复制一页，COW 大页先拆分；拆分失败与分配新页失败一样是内存不足
+  if (level != 0 && (pte = walk(pagetable, va0, 0)) == 0)
+    return -1;
 
   // 获取物理页地址
   uint64 pa = PTE2PA(*pte);
@@ -549,64 +1015,88 @@ cow_make_writable(struct proc *p, uint64 va)
     // 直接恢复 PTE_W 位、移除 PTE_COW 位
     uint64 flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
     *pte = PA2PTE(pa) | flags;
-    // 类似地更新内核页表
-    pte_t* kpte = walk(p->kpagetable, va0, 0);
-    if(kpte == 0)
-      panic("cow_make_writable kpte");
-    uint64 kflags = (PTE_FLAGS(*kpte) | PTE_W) & ~PTE_COW;
-    *kpte = PA2PTE(pa) | kflags;
-    sfence_vma();
+    uvmflushpage(pagetable, va0);
     return 0;
   }
 
-  // 引用计数 > 1，触发写时复制，需要分配新页、复制数据、更新父进程和其内核页表
-  char* mem = kalloc();
-  if(mem == 0)
+  // 引用计数 > 1，触发写时复制，需要分配新页、复制数据、更新页表；内存不足时先直接回收一批页。
+  // 共享零页不必复制，直接换成一页清零的私有页
+  int zero = is_zeropage(pa);
+  void* (*alloc)(void) = zero ? kalloc_zeroed : kalloc;
+  char* mem = alloc();
+  if(mem == 0 && (reclaim_direct() == 0 || (mem = alloc()) == 0))
     return -1;
-  memmove(mem, (char*)pa, PGSIZE);
+  if (!zero)
+    copy_page(mem, (char*)pa);
   // 更新用户页表，设置 PTE_W 位、移除 PTE_COW 位
   uint64 flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
   *pte = PA2PTE((uint64)mem) | flags;
-  // 类似地更新内核页表
-  pte_t* kpte = walk(p->kpagetable, va0, 0);
-  if(kpte == 0)
-    panic("cow_make_writable kpte");
-  uint64 kflags = (PTE_FLAGS(*kpte) | PTE_W) & ~PTE_COW;
-  *kpte = PA2PTE((uint64)mem) | kflags;
-  sfence_vma();
+  uvmflushpage(pagetable, va0);
   kfree((void*)pa);
   return 0;
 }
 
+/**
+ * @brief 打开 sstatus.SUM，允许内核直接访问 PTE_U 页
+ * @note 关中断直到 user_access_end，避免在访问期间被调度到 SUM 未打开的另一个 hart 上；
+ *       因此调用者每次只应访问不超过一页的数据
+ */
+static inline void
+user_access_begin(void)
+{
+  push_off();
+  asm volatile("csrs sstatus, %0" : : "r" (SSTATUS_SUM));
+}
+
+static inline void
+user_access_end(void)
+{
+  asm volatile("csrc sstatus, %0" : : "r" (SSTATUS_SUM));
+  pop_off();
+}
+
 /**
  * @brief 将内核空间的数据拷贝到用户空间
  * @param dstva 目标虚拟地址
  * @param src 源数据
  * @param len 长度
  * @return 0 成功，-1 失败
+ * @note 内核运行在进程自己的页表上，经 sstatus.SUM 直接写用户虚拟地址
  */
 int
 copyout2(uint64 dstva, char *src, uint64 len)
 {
   struct proc *p = myproc();
   uint64 sz = p->sz;
+  int r;
   if (dstva + len > sz || dstva >= sz) {
     return -1;
   }
   // 这里原先是直接一个大的 memmove，但是我们现在要处理 COW，所以必须保证每次复制都在一个整页以内
   while (len > 0) {
     uint64 va0 = PGROUNDDOWN(dstva);
-    // 处理 COW，确保目标页可写
-    if (cow_make_writable(p, va0) < 0){
-      return -1;
-    }
     // 拷贝数据，初次拷贝可能非整页，而是复制了 [dstva, va0+PGSIZE) 之间的数据
     // 后续拷贝时，n 就是整页大小 PGSIZE
     // 最后一次拷贝时，n = len <= PGSIZE
     uint64 n = PGSIZE - (dstva - va0);
     if (n > len)
       n = len;
+    // 检查与拷贝都在关中断期间完成，进程一直在运行，页不会在两者之间被回收。
+    // 尚未映射的页（如未访问过的 .bss、被回收的页）与 COW 页先开中断按缺页处理，再回来重新检查；
+    // 持有自旋锁的调用者不能缺页，只能就地复制 COW 页
+    user_access_begin();
+    while ((r = uvmcheck(p->pagetable, va0, 1)) == 0) {
+      user_access_end();
+      if ((intr_pushed() ? cow_make_writable(p, va0) : fault_in_page(va0, 1)) < 0)
+        return -1;
+      user_access_begin();
+    }
+    if (r < 0) {
+      user_access_end();
+      return -1;
+    }
     memmove((void *)dstva, src, n);
+    user_access_end();
     len -= n;
     src += n;
     dstva = va0 + PGSIZE;
@@ -657,12 +1147,34 @@ copyin2(char *dst, uint64 srcva, uint64 len)
  * @param srcva 源地址（用户空间）
  * @param len 长度
  * @return 0 成功，-1 失败
- * @note 修复了 copyin2 的边界检查问题，即 sz 是堆的上边界（堆顶之后紧接着的第一个无效地址），但是我们可能会从 mmap 的映射区中进行数据读取，从而导致越界，所以这里直接改为 copyin 的简单封装
+ * @note 修复了 copyin2 的边界检查问题，即 sz 是堆的上边界（堆顶之后紧接着的第一个无效地址），但是我们可能会从 mmap 的映射区中进行数据读取，从而导致越界，
+ *       所以这里逐页用 walkaddr 确认用户页已映射，再经 sstatus.SUM 直接读用户虚拟地址。
+ *       尚未映射或已被回收的页先按缺页补上映射，持有自旋锁的调用者（如管道）则直接失败
  */
 int
 copyin2(char* dst, uint64 srcva, uint64 len) {
   pagetable_t pagetable = myproc()->pagetable;
-  return copyin(pagetable, dst, srcva, len);
+
+  while (len > 0) {
+    uint64 va0 = PGROUNDDOWN(srcva);
+    uint64 n = PGSIZE - (srcva - va0);
+    if (n > len)
+      n = len;
+    // 检查与拷贝都在关中断期间完成，进程一直在运行，页不会在两者之间被回收
+    user_access_begin();
+    while (walkaddr(pagetable, va0) == NULL) {
+      user_access_end();
+      if (fault_in_page(va0, 0) < 0)
+        return -1;
+      user_access_begin();
+    }
+    memmove(dst, (void *)srcva, n);
+    user_access_end();
+    len -= n;
+    dst += n;
+    srcva = va0 + PGSIZE;
+  }
+  return 0;
 }
 
 // Copy a null-terminated string from user to kernel.
@@ -712,19 +1224,41 @@ int
 copyinstr2(char *dst, uint64 srcva, uint64 max)
 {
   int got_null = 0;
-  uint64 sz = myproc()->sz;
-  while(srcva < sz && max > 0){
-    char *p = (char *)srcva;
-    if(*p == '\0'){
-      *dst = '\0';
-      got_null = 1;
-      break;
-    } else {
-      *dst = *p;
+  struct proc *p = myproc();
+  uint64 sz = p->sz;
+  while(got_null == 0 && srcva < sz && max > 0){
+    uint64 va0 = PGROUNDDOWN(srcva);
+    uint64 n = PGSIZE - (srcva - va0);
+    if(n > max)
+      n = max;
+    if(n > sz - srcva)
+      n = sz - srcva;
+
+    char *s = (char *)srcva;
+    // 与 copyin2 相同，检查与读取都在关中断期间完成，尚未映射的页（如未访问过的 .rodata）先按缺页补上
+    user_access_begin();
+    while(walkaddr(p->pagetable, va0) == NULL){
+      user_access_end();
+      if(fault_in_page(va0, 0) < 0)
+        return -1;
+      user_access_begin();
+    }
+    while(n > 0){
+      if(*s == '\0'){
+        *dst = '\0';
+        got_null = 1;
+        break;
+      } else {
+        *dst = *s;
+      }
+      --n;
+      --max;
+      s++;
+      dst++;
     }
-    --max;
-    srcva++;
-    dst++;
+    user_access_end();
+
+    srcva = va0 + PGSIZE;
   }
   if(got_null){
     return 0;
@@ -733,72 +1267,6 @@ copyinstr2(char *dst, uint64 srcva, uint64 max)
   }
 }
 
-// initialize kernel pagetable for each process.
-pagetable_t
-proc_kpagetable()
-{
-  pagetable_t kpt = (pagetable_t) kalloc();
-  if (kpt == NULL)
-    return NULL;
-  memmove(kpt, kernel_pagetable, PGSIZE);
-
-  // remap stack and trampoline, because they share the same page table of level 1 and 0
-  char *pstack = kalloc();
-  if(pstack == NULL)
-    goto fail;
-  if (mappages(kpt, VKSTACK, PGSIZE, (uint64)pstack, PTE_R | PTE_W) != 0)
-    goto fail;
-  
-  return kpt;
-
-fail:
-  kvmfree(kpt, 1);
-  return NULL;
-}
-
-// only free page table, not physical pages
-void
-kfreewalk(pagetable_t kpt)
-{
-  for (int i = 0; i < 512; i++) {
-    pte_t pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    } else if (pte & PTE_V) {
-      break;
-    }
-  }
-  kfree((void *) kpt);
-}
-
-void
-kvmfreeusr(pagetable_t kpt)
-{
-  pte_t pte;
-  for (int i = 0; i < PX(2, MAXUVA); i++) {
-    pte = kpt[i];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-      kpt[i] = 0;
-    }
-  }
-}
-
-void
-kvmfree(pagetable_t kpt, int stack_free)
-{
-  if (stack_free) {
-    vmunmap(kpt, VKSTACK, 1, 1);
-    pte_t pte = kpt[PX(2, VKSTACK)];
-    if ((pte & PTE_V) && (pte & (PTE_R|PTE_W|PTE_X)) == 0) {
-      kfreewalk((pagetable_t) PTE2PA(pte));
-    }
-  }
-  kvmfreeusr(kpt);
-  kfree(kpt);
-}
-
 void vmprint(pagetable_t pagetable)
 {
   const int capacity = 512;
@@ -808,12 +1276,16 @@ void vmprint(pagetable_t pagetable)
     {
       pagetable_t pt2 = (pagetable_t) PTE2PA(*pte); 
       printf("..%d: pte %p pa %p\n", pte - pagetable, *pte, pt2);
+      if (PTE_LEAF(*pte))
+        continue;
 
       for (pte_t *pte2 = (pte_t *) pt2; pte2 < pt2 + capacity; pte2++) {
         if (*pte2 & PTE_V)
         {
           pagetable_t pt3 = (pagetable_t) PTE2PA(*pte2);
           printf(".. ..%d: pte %p pa %p\n", pte2 - pt2, *pte2, pt3);
+          if (PTE_LEAF(*pte2))
+            continue;
 
           for (pte_t *pte3 = (pte_t *) pt3; pte3 < pt3 + capacity; pte3++)
             if (*pte3 & PTE_V)
@@ -827,142 +1299,452 @@ void vmprint(pagetable_t pagetable)
 
 
 /**
- * @brief 将 VMA 中的数据写回物理内存
+ * @brief 将共享可写文件映射中 [start, end) 范围内的脏页写回文件
  * @param p 进程 PCB 指针
  * @param v 要写回的 VMA 指针
+ * @param start 起始地址，页对齐，会被裁剪到 VMA 范围内
+ * @param end 结束地址（不含），页对齐，会被裁剪到 VMA 范围内
+ * @return 写回的页数
+ * @note 只写回 PTE_D 置位的页，并清除 PTE_D，之后再次写入才会被视为脏页；
+ *       整个范围只加一次文件锁，每个 level-0 页表只从根查找一次
  */
-void vma_writeback(struct proc* p, struct vma* v) {
-  if (v->valid == 0) {
-    return;
-  }
-
+int vma_sync(struct proc* p, struct vma* v, uint64 start, uint64 end) {
   if (!(v->flags & MAP_SHARED) || !(v->prot & PROT_WRITE) || !(v->vm_file)) {
-    return;
+    return 0;
   }
 
   if (v->vm_file->writable == 0) {
-    return;
+    return 0;
   }
 
-  for (uint64 va = v->start; va < v->end; va += PGSIZE) {
-    uint64 pa = walkaddr(p->pagetable, va);
-    if (pa == 0) {
+  if (start < v->start)
+    start = v->start;
+  if (end > v->end)
+    end = v->end;
+
+  struct tlb_batch tb;
+  int level, n = 0;
+  uint64 a = start;
+
+  tlb_batch_init(&tb, p->pagetable);
+  elock(v->vm_file->ep);
+  while (a < end) {
+    pte_t* pte = walkpte(p->pagetable, a, 0, 0, &level);
+    if (pte == 0) {
+      a = LEVELROUNDDOWN(a, level) + LEVELSIZE(level);
+      continue;
+    }
+    // 文件映射不使用大页，level-1 的项只可能是无效项
+    if (level != 0) {
+      if (*pte & PTE_V)
+        panic("vma_sync: superpage");
+      a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE;
+      continue;
+    }
+    do {
+      if ((*pte & PTE_V) && (*pte & PTE_D)) {
+        *pte &= ~PTE_D;
+        tlb_batch_add(&tb, a);
+        ewrite(v->vm_file->ep, 0, PTE2PA(*pte), v->offset + (a - v->start), PGSIZE);
+        n++;
+      }
+      pte++;
+      a += PGSIZE;
+    } while (a < end && a % SUPERPGSIZE != 0);
+  }
+  eunlock(v->vm_file->ep);
+  // 清除 PTE_D 后必须刷新 TLB，否则缓存中带 D 位的项会让之后的写入不再设置 PTE_D
+  tlb_batch_flush(&tb);
+
+  #ifdef ALGO
+  // 被换出的脏页不在页表中，只能从追踪信息里找到。先从交换区读出再写文件，
+  // 读交换文件时不能持有映射文件的锁
+  char* buf = 0;
+  for (a = start; v->pages && a < end; a += PGSIZE) {
+    struct mmap_vpage* page = vma_vpage(v, a, 0);
+    if (page == 0) {
+      // 整块未分配，跳到下一块
+      a = (VPAGE_CHUNKNO(a) + 1) * VPAGE_CHUNK * PGSIZE - PGSIZE;
+      continue;
+    }
+    if (page->state != VMA_PAGE_SWAPPED || !page->dirty || page->swap == 0) {
+      continue;
+    }
+    if (buf == 0 && (buf = kalloc()) == 0) {
+      break;
+    }
+    if (swap_read(page->swap, buf) < 0) {
       continue;
     }
-    uint64 file_offset = v->offset + (va - v->start);
     elock(v->vm_file->ep);
-    ewrite(v->vm_file->ep, 0, pa, file_offset, PGSIZE);
+    ewrite(v->vm_file->ep, 0, (uint64)buf, v->offset + (a - v->start), PGSIZE);
     eunlock(v->vm_file->ep);
+    page->dirty = 0;
+    n++;
+  }
+  if (buf) {
+    kfree(buf);
+  }
+  #endif
+  return n;
+}
+
+/**
+ * @brief 将 VMA 中的脏页写回文件，用于 munmap、exec 与进程退出
+ * @param p 进程 PCB 指针
+ * @param v 要写回的 VMA 指针
+ */
+void vma_writeback(struct proc* p, struct vma* v) {
+  vma_sync(p, v, v->start, v->end);
+}
+
+/**
+ * @brief 为已映射的用户页补上 PTE_A（写访问时还有 PTE_D）
+ * @param pagetable 用户页表
+ * @param va 访问地址
+ * @param write 是否为写访问
+ * @return 0 已更新，-1 页未映射或权限不允许
+ * @note 硬件不自动维护 A/D 位时，访问 A/D 未置位的页会触发缺页，由缺页处理调用本函数
+ */
+int uvmmarkaccess(pagetable_t pagetable, uint64 va, int write) {
+  int level;
+  pte_t* pte = walkpte(pagetable, PGROUNDDOWN(va), 0, 0, &level);
+
+  if (pte == 0 || (*pte & PTE_V) == 0 || (*pte & PTE_U) == 0 || !PTE_LEAF(*pte))
+    return -1;
+  if (write && (*pte & PTE_W) == 0)
+    return -1;
+  *pte |= PTE_A | (write ? PTE_D : 0);
+  uvmflushpage(pagetable, va);
+  return 0;
+}
+
+/**
+ * @brief 回收进程文件映射中的干净页，之后再访问时缺页处理会重新从文件读入
+ * @param p 目标进程，不在运行且没有在修改自己的地址空间，调用者持有 p->lock
+ * @param nr 最多回收的页数
+ * @param ncached 累加解除了映射、但仍由页缓存持有的页数，它们由 pagecache_shrink 释放
+ * @return 实际释放的页数
+ * @note 回收没有 PTE_D、不是 COW、也没有被其他页表共享的普通页，以及除本进程外只有页缓存引用的
+ *       缓存页：缓存页的内容始终与文件一致，即使作为 COW 映射也可以丢弃。带 PTE_A 的页只清除访问位，
+ *       给它第二次机会。修改页表项后不刷新 TLB，由调用者保证该地址空间下次运行前按 ASID 刷新
+ */
+int vma_reclaim_clean(struct proc* p, int nr, int* ncached) {
+  int level, n = 0, c = 0;
+
+  for (struct vma* v = p->vmas.first; v && n + c < nr; v = v->next) {
+    if (v->vm_file == 0) {
+      continue;
+    }
+    uint64 a = v->start;
+    while (a < v->end && n + c < nr) {
+      pte_t* pte = walkpte(p->pagetable, a, 0, 0, &level);
+      if (pte == 0) {
+        a = LEVELROUNDDOWN(a, level) + LEVELSIZE(level);
+        continue;
+      }
+      // 文件映射不使用大页，level-1 的项只可能是无效项
+      if (level != 0) {
+        a = SUPERPGROUNDDOWN(a) + SUPERPGSIZE;
+        continue;
+      }
+      do {
+        pte_t e = *pte;
+        int ref = (e & PTE_V) ? getref(PTE2PA(e)) : 0;
+        int cached = ref == 2 && pagecache_owns(PTE2PA(e));
+        if ((e & PTE_V) && (e & PTE_D) == 0 && ((ref == 1 && (e & PTE_COW) == 0) || cached)) {
+          if (e & PTE_A) {
+            *pte = e & ~PTE_A;
+          } else {
+            #ifdef ALGO
+            struct mmap_vpage* page = vma_vpage(v, a, 0);
+            if (page && page->state == VMA_PAGE_INMEM) {
+              page->state = VMA_PAGE_UNUSED;
+              page->load_time = 0;
+              page->last_access = 0;
+              if (p->mmap_pages_in_mem > 0) {
+                p->mmap_pages_in_mem--;
+              }
+            }
+            #endif
+            *pte = 0;
+            kfree((void*)PTE2PA(e));
+            if (cached) {
+              c++;
+            } else {
+              n++;
+            }
+          }
+        }
+        pte++;
+        a += PGSIZE;
+      } while (a < v->end && a % SUPERPGSIZE != 0 && n + c < nr);
+    }
   }
+  *ncached += c;
+  return n;
 }
 
 #ifdef ALGO
+// 目录不超过一页时从 kmalloc 分配，否则按页数向上取整到 2 的幂，从伙伴系统整块分配
+static int vpage_dir_order(int nchunk) {
+  int order = 0;
+  while ((PGSIZE << order) < nchunk * sizeof(struct mmap_vpage*))
+    order++;
+  return order;
+}
+
+/**
+ * @brief 为 VMA 分配页追踪块目录，块本身在第一次用到时才分配
+ * @param v 目标 VMA，start 与 end 必须已经设置
+ * @return 0 成功，-1 内存不足或映射过大
+ */
+int vma_pages_init(struct vma* v) {
+  int n = VPAGE_CHUNKNO(v->end - 1) - VPAGE_CHUNKNO(v->start) + 1;
+  uint64 size = n * sizeof(struct mmap_vpage*);
+  struct mmap_vpage** dir;
+
+  if (size <= PGSIZE) {
+    dir = (struct mmap_vpage**)kmalloc(size);
+  } else {
+    int order = vpage_dir_order(n);
+    dir = order > MAX_ORDER ? 0 : (struct mmap_vpage**)kalloc_pages(order);
+  }
+  if (dir == 0) {
+    return -1;
+  }
+  memset(dir, 0, size);
+  v->pages = dir;
+  v->nchunk = n;
+  return 0;
+}
+
+/**
+ * @brief 取得 VMA 中 va 所在页的追踪信息
+ * @param v 目标 VMA
+ * @param va VMA 内的地址
+ * @param alloc 所在块尚未分配时是否分配
+ * @return 追踪信息指针；块未分配且 alloc 为 0，或分配失败时返回 NULL，此时该页视为 VMA_PAGE_UNUSED
+ */
+struct mmap_vpage* vma_vpage(struct vma* v, uint64 va, int alloc) {
+  if (v->pages == 0 || va < v->start || va >= v->end) {
+    return 0;
+  }
+  int i = VPAGE_CHUNKNO(va) - VPAGE_CHUNKNO(v->start);
+  if (v->pages[i] == 0) {
+    if (!alloc || (v->pages[i] = (struct mmap_vpage*)kalloc_zeroed()) == 0) {
+      return 0;
+    }
+  }
+  return &v->pages[i][(va >> PGSHIFT) % VPAGE_CHUNK];
+}
+
 /**
  * @brief 重置并释放 VMA 的 mmap 页面追踪信息。
  * @param p 所属进程
  * @param v 目标 VMA
+ * @note 只检查已分配的块，块中不属于本 VMA 的项（拆分留下的）总是空的
  */
 void vma_reset_pages(struct proc* p, struct vma* v) {
-  if (p == 0 || v == 0) {
+  if (p == 0 || v == 0 || v->pages == 0) {
     return;
   }
-  if (v->pages == 0) {
-    v->page_count = 0;
-    return;
-  }
-  int page_cnt = v->page_count;
-  if (page_cnt <= 0) {
-    page_cnt = (v->end - v->start) / PGSIZE;
-  }
-  if (page_cnt > VMA_MAX_TRACKED_PAGES) {
-    page_cnt = VMA_MAX_TRACKED_PAGES;
-  }
-  for (int i = 0; i < page_cnt; i++) {
-    struct mmap_vpage* page = &v->pages[i];
-    if (page->state == VMA_PAGE_INMEM && p->mmap_pages_in_mem > 0) {
-      p->mmap_pages_in_mem--;
+  for (int i = 0; i < v->nchunk; i++) {
+    struct mmap_vpage* chunk = v->pages[i];
+    if (chunk == 0) {
+      continue;
     }
-    if (page->state == VMA_PAGE_SWAPPED && page->swap_data) {
-      kfree(page->swap_data);
+    for (int j = 0; j < VPAGE_CHUNK; j++) {
+      struct mmap_vpage* page = &chunk[j];
+      if (page->state == VMA_PAGE_INMEM && p->mmap_pages_in_mem > 0) {
+        p->mmap_pages_in_mem--;
+      }
+      if (page->state == VMA_PAGE_SWAPPED) {
+        swap_free(page->swap);
+      }
     }
-    page->state = VMA_PAGE_UNUSED;
-    page->load_time = 0;
-    page->last_access = 0;
-    page->swap_data = 0;
+    kfree(chunk);
+  }
+  if (v->nchunk * sizeof(struct mmap_vpage*) <= PGSIZE) {
+    kmfree(v->pages);
+  } else {
+    kfree_pages(v->pages, vpage_dir_order(v->nchunk));
   }
-  v->page_count = 0;
-  kfree((char*)v->pages);
   v->pages = 0;
+  v->nchunk = 0;
 }
 #endif
 
 
 /**
- * @brief 释放进程的 VMA
+ * @brief 移除一个 VMA：写回脏页、取消映射、关闭文件，并将其从索引中删除后释放
  * @param p 进程 PCB 指针
+ * @param v 要移除的 VMA
  */
-void vma_free(struct proc* p) {
-  for (int i = 0; i < NVMA; i++) {
-    struct vma* v = &p->vmas[i];
-    if (v->valid) {
-      // 将 VMA 中的数据写回物理内存
-      // 只有当 VMA 是共享映射，并且是可写，并且是文件映射时，才需要写回物理内存
-      vma_writeback(p, v);
-      // 取消映射并决定是否释放物理页
-      // 如果是共享映射(MAP_SHARED)，则不释放物理内存，
-      // 否则（私有或匿名映射）则释放。
-      int do_free = (v->flags & MAP_SHARED) ? 0 : 1;
-      vmunmap(p->pagetable, v->start, (v->end - v->start) / PGSIZE, do_free);
-
-      // 如果是文件映射，关闭文件
-      if (v->vm_file) {
-        fileclose(v->vm_file);
-        v->vm_file = NULL;
-      }
+void vma_unmap(struct proc* p, struct vma* v) {
+  // 将 VMA 中的数据写回文件
+  // 只有当 VMA 是共享映射，并且是可写，并且是文件映射时，才需要写回
+  vma_writeback(p, v);
+  // 取消映射并立即释放物理页。共享映射的页也是缺页时为本进程单独分配的，
+  // 脏页已写回文件，可以直接归还；被其他页表共享的页由引用计数保护
+  vmunmap(p->pagetable, v->start, (v->end - v->start) / PGSIZE, 1);
+
+  // 如果是文件映射，关闭文件
+  if (v->vm_file) {
+    fileclose(v->vm_file);
+    v->vm_file = NULL;
+  }
 
-      #ifdef ALGO
-      vma_reset_pages(p, v);
-      #endif
+  #ifdef ALGO
+  vma_reset_pages(p, v);
+  #endif
 
-      v->valid = 0;
+  vma_remove(&p->vmas, v);
+  vma_release(v);
+}
+
+/**
+ * @brief 在 addr 处把 VMA 一分为二，原 VMA 保留 [start, addr)，新 VMA 为 [addr, end)
+ * @param p 进程 PCB 指针
+ * @param v 要拆分的 VMA
+ * @param addr 拆分点，页对齐，且严格位于 VMA 内部
+ * @return 新的高地址 VMA，NULL 表示内存不足，此时 v 保持不变
+ * @note 新 VMA 继承权限、标志和文件引用，文件偏移随拆分点后移；ALGO 下页追踪块随之移交
+ */
+static struct vma* vma_split(struct proc* p, struct vma* v, uint64 addr) {
+  struct vma* n = vma_alloc();
+  if (n == NULL) {
+    return NULL;
+  }
+
+  n->start = addr;
+  n->end = v->end;
+
+  #ifdef ALGO
+  // 拆分点之后的整块直接移交给新 VMA；拆分点所在的块两边都要用，复制一份后各自清掉不属于自己的项
+  if (v->pages) {
+    int first = VPAGE_CHUNKNO(addr) - VPAGE_CHUNKNO(v->start);
+    int k = (addr >> PGSHIFT) % VPAGE_CHUNK;
+    struct mmap_vpage* copy = 0;
+    if (vma_pages_init(n) < 0) {
+      vma_release(n);
+      return NULL;
+    }
+    if (k != 0 && v->pages[first]) {
+      if ((copy = (struct mmap_vpage*)kalloc()) == 0) {
+        vma_reset_pages(p, n);
+        vma_release(n);
+        return NULL;
+      }
+      copy_page(copy, v->pages[first]);
+      memset(copy, 0, k * sizeof(struct mmap_vpage));
+      memset(v->pages[first] + k, 0, (VPAGE_CHUNK - k) * sizeof(struct mmap_vpage));
+    }
+    for (int i = 0; i < n->nchunk; i++) {
+      if (i == 0 && k != 0) {
+        n->pages[0] = copy;
+        continue;
+      }
+      n->pages[i] = v->pages[first + i];
+      v->pages[first + i] = 0;
     }
   }
+  #endif
+
+  n->prot = v->prot;
+  n->flags = v->flags;
+  n->offset = v->offset + (addr - v->start);
+  n->vm_file = v->vm_file ? filedup(v->vm_file) : NULL;
+
+  // 先缩小原 VMA，新 VMA 才能无重叠地插入，插入时会更新后继的间隙
+  v->end = addr;
+  vma_insert(&p->vmas, n);
+  return n;
 }
 
+/**
+ * @brief 取消 [start, end) 范围内的全部映射，范围可以只覆盖 VMA 的一部分或跨越多个 VMA
+ * @param p 进程 PCB 指针
+ * @param start 起始地址，页对齐
+ * @param end 结束地址（不含），页对齐
+ * @return 0 成功，-1 拆分 VMA 或大页时内存不足，此时地址空间保持不变
+ * @note 先拆分范围两端被分开的大页，vmunmap 之后不需要再拆分，不会因内存不足而失败；
+ *       再在范围两端拆分部分覆盖的 VMA，然后整体移除范围内的 VMA，
+ *       因此只有范围内的脏页被写回，物理页立即归还。范围内没有映射的部分直接忽略。
+ *       写回时可能睡眠，期间置 vm_busy，页面回收不会碰到修改到一半的 VMA
+ */
+int vma_unmap_range(struct proc* p, uint64 start, uint64 end) {
+  int r = -1;
+
+  p->vm_busy++;
+  if (splitsuperpage(p->pagetable, start) < 0 || splitsuperpage(p->pagetable, end) < 0) {
+    goto out;
+  }
+  struct vma* v = vma_find(&p->vmas, start);
+  if (v && v->start < start && vma_split(p, v, start) == NULL) {
+    goto out;
+  }
+  v = vma_find(&p->vmas, end);
+  if (v && v->start < end && vma_split(p, v, end) == NULL) {
+    goto out;
+  }
+
+  v = vma_ceil(&p->vmas, start);
+  while (v && v->start < end) {
+    struct vma* next = v->next;
+    vma_unmap(p, v);
+    v = next;
+  }
+  r = 0;
+
+out:
+  p->vm_busy--;
+  return r;
+}
+
+/**
+ * @brief 释放进程的全部 VMA
+ * @param p 进程 PCB 指针
+ * @note 与 vma_unmap_range 一样，期间置 vm_busy
+ */
+void vma_free(struct proc* p) {
+  p->vm_busy++;
+  while (p->vmas.first) {
+    vma_unmap(p, p->vmas.first);
+  }
+  p->vm_busy--;
+}
+
+
+/**
+ * @brief mmap 区域可用的最低地址，即堆顶（至少从第二页开始，地址 0 保留给空指针）
+ * @param p 进程 PCB 指针
+ */
+uint64 mmap_lowest(struct proc* p) {
+  uint64 lo = PGROUNDUP(p->sz);
+  return lo < PGSIZE ? PGSIZE : lo;
+}
 
 /**
  * @brief 在进程的地址空间中找到一个可用的地址，用于映射文件
  * @param p 进程 PCB 指针
+ * @param hint 用户建议的地址，页对齐，0 表示没有建议
  * @param len 需要映射的长度，是一个 PGSIZE=4096 的整倍数
  * @return 找到的地址，0 表示失败
- * @note 从 MMAPBASE 开始向下搜索，直到找到一个足够大的、不与现有 VMA 或堆栈冲突的空闲区域
+ * @note 建议的区域完全位于堆顶与 MMAPBASE 之间且空闲时直接采用；
+ *       否则取其间最高的、足够大的空闲区域，借助 VMA 索引中的间隙信息只需 O(log n)
  */
-uint64 mmap_find_addr(struct proc* p, uint64 len) {
-  uint64 addr = MMAPBASE;
+uint64 mmap_find_addr(struct proc* p, uint64 hint, uint64 len) {
+  uint64 lo = mmap_lowest(p);
 
   if (len % PGSIZE != 0) {
     return 0;
   }
-
-  while (1) {
-    addr -= len;
-
-    // 如果一直找到了和栈顶重叠，则返回失败
-    if (addr < p->sz) {
-      return 0;
-    }
-
-    int conflict = 0;
-    for (int i = 0; i < NVMA; i++) {
-      struct vma* v = &p->vmas[i];
-      if (v->valid && v->start <= addr && v->end >= addr) {
-        conflict = 1;
-        addr = v->start;
-        break;
-      }
-    }
-    if (!conflict) {
-      return addr;
+  if (hint >= lo && hint + len > hint && hint + len <= MMAPBASE) {
+    struct vma* v = vma_ceil(&p->vmas, hint);
+    if (v == NULL || v->start >= hint + len) {
+      return hint;
     }
   }
+  return vma_find_gap(&p->vmas, len, lo, MMAPBASE);
 }
\ No newline at end of file
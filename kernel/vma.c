@@ -0,0 +1,341 @@
+// Per-process index of virtual memory areas (VMAs).
+// VMAs are kept in an AVL tree ordered by start address and,
+// in the same order, on a doubly-linked list. Each VMA also
+// records the free gap below it; the largest gap in every
+// subtree lets mmap find free address space in O(log n).
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/slab.h"
+#include "include/vm.h"
+#include "include/string.h"
+#include "include/printf.h"
+
+static struct kmem_cache *vma_cache;
+
+void
+vmainit(void)
+{
+  if((vma_cache = kmem_cache_create("vma", sizeof(struct vma), 0)) == NULL)
+    panic("vmainit");
+}
+
+/**
+ * @brief 分配一个清零的 VMA
+ * @return VMA 指针，NULL 表示内存不足
+ */
+struct vma*
+vma_alloc(void)
+{
+  struct vma *v = (struct vma*)kmem_cache_alloc(vma_cache);
+  if(v)
+    memset(v, 0, sizeof(*v));
+  return v;
+}
+
+/**
+ * @brief 释放 vma_alloc 分配的 VMA，调用前必须已经从索引中移除
+ */
+void
+vma_release(struct vma *v)
+{
+  kmem_cache_free(vma_cache, v);
+}
+
+void
+vma_tree_init(struct vma_tree *t)
+{
+  t->root = t->first = t->last = NULL;
+  t->count = 0;
+}
+
+static inline int
+height(struct vma *v)
+{
+  return v ? v->height : 0;
+}
+
+static inline uint64
+maxgap(struct vma *v)
+{
+  return v ? v->max_gap : 0;
+}
+
+// 由孩子重新计算 v 的高度与子树最大间隙
+static void
+update(struct vma *v)
+{
+  int hl = height(v->left), hr = height(v->right);
+  uint64 g = v->gap;
+
+  v->height = 1 + (hl > hr ? hl : hr);
+  if(maxgap(v->left) > g)
+    g = maxgap(v->left);
+  if(maxgap(v->right) > g)
+    g = maxgap(v->right);
+  v->max_gap = g;
+}
+
+static struct vma*
+rotate_right(struct vma *y)
+{
+  struct vma *x = y->left;
+  y->left = x->right;
+  x->right = y;
+  update(y);
+  update(x);
+  return x;
+}
+
+static struct vma*
+rotate_left(struct vma *x)
+{
+  struct vma *y = x->right;
+  x->right = y->left;
+  y->left = x;
+  update(x);
+  update(y);
+  return y;
+}
+
+// 更新 v 并在左右子树高度差超过 1 时旋转，返回新的子树根
+static struct vma*
+rebalance(struct vma *v)
+{
+  update(v);
+  int bf = height(v->left) - height(v->right);
+  if(bf > 1){
+    if(height(v->left->left) < height(v->left->right))
+      v->left = rotate_left(v->left);
+    return rotate_right(v);
+  }
+  if(bf < -1){
+    if(height(v->right->right) < height(v->right->left))
+      v->right = rotate_right(v->right);
+    return rotate_left(v);
+  }
+  return v;
+}
+
+static struct vma*
+insert(struct vma *root, struct vma *v)
+{
+  if(root == NULL){
+    v->left = v->right = NULL;
+    update(v);
+    return v;
+  }
+  if(v->start < root->start)
+    root->left = insert(root->left, v);
+  else
+    root->right = insert(root->right, v);
+  return rebalance(root);
+}
+
+// 摘下子树中最左的节点放到 *min，返回剩余的子树
+static struct vma*
+remove_min(struct vma *root, struct vma **min)
+{
+  if(root->left == NULL){
+    *min = root;
+    return root->right;
+  }
+  root->left = remove_min(root->left, min);
+  return rebalance(root);
+}
+
+static struct vma*
+erase(struct vma *root, struct vma *v)
+{
+  if(root == NULL)
+    panic("vma_remove");
+  if(v->start < root->start)
+    root->left = erase(root->left, v);
+  else if(v->start > root->start)
+    root->right = erase(root->right, v);
+  else {
+    struct vma *r = root->right, *m;
+    if(r == NULL)
+      return root->left;
+    r = remove_min(r, &m);
+    m->left = root->left;
+    m->right = r;
+    return rebalance(m);
+  }
+  return rebalance(root);
+}
+
+// 某个节点的 gap 改变后，沿根到该节点（起始地址为 key）的路径重新计算 max_gap
+static void
+refresh(struct vma *root, uint64 key)
+{
+  if(root == NULL)
+    return;
+  if(key < root->start)
+    refresh(root->left, key);
+  else if(key > root->start)
+    refresh(root->right, key);
+  update(root);
+}
+
+/**
+ * @brief 查找起始地址小于 addr 的最后一个 VMA
+ */
+static struct vma*
+vma_lower(struct vma_tree *t, uint64 addr)
+{
+  struct vma *v = t->root, *best = NULL;
+  while(v){
+    if(v->start < addr){
+      best = v;
+      v = v->right;
+    } else {
+      v = v->left;
+    }
+  }
+  return best;
+}
+
+/**
+ * @brief 将 v 加入索引，v->start 与 v->end 必须已经设置好
+ * @return 0 成功，-1 与已有的 VMA 重叠
+ */
+int
+vma_insert(struct vma_tree *t, struct vma *v)
+{
+  struct vma *prev = vma_lower(t, v->start);
+  struct vma *next = prev ? prev->next : t->first;
+
+  if((prev && prev->end > v->start) || (next && next->start < v->end))
+    return -1;
+
+  v->prev = prev;
+  v->next = next;
+  if(prev)
+    prev->next = v;
+  else
+    t->first = v;
+  if(next)
+    next->prev = v;
+  else
+    t->last = v;
+
+  v->gap = v->start - (prev ? prev->end : 0);
+  t->root = insert(t->root, v);
+  if(next){
+    next->gap = next->start - v->end;
+    refresh(t->root, next->start);
+  }
+  t->count++;
+  return 0;
+}
+
+/**
+ * @brief 将 v 从索引中移除，不释放 v
+ */
+void
+vma_remove(struct vma_tree *t, struct vma *v)
+{
+  struct vma *prev = v->prev, *next = v->next;
+
+  t->root = erase(t->root, v);
+  if(prev)
+    prev->next = next;
+  else
+    t->first = next;
+  if(next)
+    next->prev = prev;
+  else
+    t->last = prev;
+  if(next){
+    next->gap = next->start - (prev ? prev->end : 0);
+    refresh(t->root, next->start);
+  }
+  v->left = v->right = v->prev = v->next = NULL;
+  t->count--;
+}
+
+/**
+ * @brief 查找包含 addr 的 VMA
+ * @return VMA 指针，NULL 表示 addr 不在任何 VMA 中
+ */
+struct vma*
+vma_find(struct vma_tree *t, uint64 addr)
+{
+  struct vma *v = t->root;
+  while(v){
+    if(addr < v->start)
+      v = v->left;
+    else if(addr < v->end)
+      return v;
+    else
+      v = v->right;
+  }
+  return NULL;
+}
+
+/**
+ * @brief 查找第一个结束地址大于 addr 的 VMA，即包含 addr 或位于 addr 之上的最低 VMA
+ * @return VMA 指针，NULL 表示不存在
+ */
+struct vma*
+vma_ceil(struct vma_tree *t, uint64 addr)
+{
+  struct vma *v = t->root, *best = NULL;
+  while(v){
+    if(v->end > addr){
+      best = v;
+      v = v->left;
+    } else {
+      v = v->right;
+    }
+  }
+  return best;
+}
+
+// 在子树中从高地址向低地址查找落在 [lo, hi) 内、长度至少为 len 的间隙，返回其中最高的可用地址
+static uint64
+gapsearch(struct vma *v, uint64 len, uint64 lo, uint64 hi)
+{
+  uint64 a, gs, ge;
+
+  if(v == NULL || v->max_gap < len)
+    return 0;
+  // 右子树的间隙都在 v->end 之上，v 已经不低于 hi 时可以跳过
+  if(v->start < hi && (a = gapsearch(v->right, len, lo, hi)) != 0)
+    return a;
+  gs = v->start - v->gap;
+  ge = v->start;
+  if(gs < lo)
+    gs = lo;
+  if(ge > hi)
+    ge = hi;
+  if(ge > gs && ge - gs >= len)
+    return ge - len;
+  // 左子树的间隙都在 v->start 之下
+  if(v->start > lo)
+    return gapsearch(v->left, len, lo, hi);
+  return 0;
+}
+
+/**
+ * @brief 在 [lo, hi) 中查找一段长度为 len 的空闲地址，优先返回最高的地址
+ * @param t VMA 索引
+ * @param len 需要的长度
+ * @param lo 下界，必须大于 0
+ * @param hi 上界（不含）
+ * @return 找到的起始地址，0 表示失败
+ */
+uint64
+vma_find_gap(struct vma_tree *t, uint64 len, uint64 lo, uint64 hi)
+{
+  // 最高的 VMA 之上的空闲区域不属于任何节点的 gap，单独检查
+  uint64 gs = t->last ? t->last->end : 0;
+  if(gs < lo)
+    gs = lo;
+  if(hi > gs && hi - gs >= len)
+    return hi - len;
+  return gapsearch(t->root, len, lo, hi);
+}
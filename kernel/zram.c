@@ -0,0 +1,346 @@
+// Compressed in-memory swap store.
+// Evicted pages are compressed with LZ4 and packed into
+// per-size-class "zspages" of one to four physical pages,
+// in the style of zsmalloc, so a page that compresses to
+// 600 bytes takes about 600 bytes. A page whose words are
+// all equal is kept as that one word. Pages that do not
+// compress well are refused and go to the swap file.
+
+#include "include/types.h"
+#include "include/param.h"
+#include "include/riscv.h"
+#include "include/spinlock.h"
+#include "include/proc.h"
+#include "include/intr.h"
+#include "include/kalloc.h"
+#include "include/lz4.h"
+#include "include/zram.h"
+#include "include/string.h"
+#include "include/printf.h"
+
+#define ZS_ALIGN      16                  // 对象大小按 16 字节分级
+#define ZS_MIN_SIZE   32                  // 最小的大小级别
+#define ZS_MAX_SIZE   (PGSIZE * 3 / 4)    // 最大的对象，压缩后更大的页视为压缩率太差
+#define ZS_NCLASS     ((ZS_MAX_SIZE - ZS_MIN_SIZE) / ZS_ALIGN + 1)
+#define ZS_MAX_ORDER  2                   // zspage 最多由 2^2 页组成
+#define ZS_NONE       0xffff              // 空闲对象链表的结尾
+#define ZRAM_HDR      2                   // 对象头：压缩后的长度，0 表示整页每个字都相同，其后只存这个字
+
+// zspage 开头的描述符，之后紧跟 nobj 个对象。对象可以跨越组成 zspage 的物理页，
+// 它们在直接映射中是连续的
+struct zspage {
+  struct zspage *next;    // 所在大小级别的未满 zspage 链表
+  struct zspage *prev;
+  ushort cls;             // 大小级别
+  ushort inuse;           // 已分配的对象数
+  ushort freeidx;         // 第一个空闲对象的下标，空闲对象的头两个字节是下一个空闲对象的下标
+};
+
+struct zs_class {
+  uint size;              // 对象大小
+  int order;              // 每个 zspage 的阶数，取浪费比例最小的
+  uint nobj;              // 每个 zspage 的对象数
+  struct zspage *partial; // 还有空闲对象的 zspage
+};
+
+static struct {
+  struct spinlock lock;   // 保护各大小级别的链表与以下计数
+  struct zs_class cls[ZS_NCLASS];
+  uint pages;             // zspage 占用的物理页数
+  uint limit;             // pages 的上限
+  uint64 stored;          // 当前保存的页数
+  uint64 same;            // 其中整页同一个字的页数
+  uint64 bytes;           // 当前保存的对象总字节数（不计大小级别的取整）
+  uint64 nstore;          // 累计保存的页数
+  uint64 nreject;         // 压缩率太差而拒绝的页数
+  uint64 nfull;           // 达到上限或没有内存而拒绝的页数
+} zram;
+
+// 每个 CPU 的压缩输出缓冲区与哈希表，只在关中断时由本 CPU 使用
+static uchar zbuf[NCPU][ZS_MAX_SIZE];
+static ushort ztable[NCPU][1 << LZ4_HASH_BITS];
+
+void
+zraminit(void)
+{
+  initlock(&zram.lock, "zram");
+  for (int c = 0; c < ZS_NCLASS; c++) {
+    struct zs_class *k = &zram.cls[c];
+    uint best = 0;
+    k->size = ZS_MIN_SIZE + c * ZS_ALIGN;
+    for (int o = 0; o <= ZS_MAX_ORDER; o++) {
+      uint span = PGSIZE << o;
+      uint nobj = (span - sizeof(struct zspage)) / k->size;
+      // 以千分比比较各阶的利用率，相同时取较小的阶
+      uint used = nobj * k->size * 1000 / span;
+      if (used > best) {
+        best = used;
+        k->order = o;
+        k->nobj = nobj;
+      }
+    }
+    k->partial = 0;
+  }
+  zram.limit = total_pages() * ZRAM_MAX_PERCENT / 100;
+}
+
+static inline uchar *
+zs_obj(struct zspage *zp, int idx)
+{
+  return (uchar *)zp + sizeof(struct zspage) + idx * zram.cls[zp->cls].size;
+}
+
+static inline int
+obj_next(uchar *obj)
+{
+  return obj[0] | (obj[1] << 8);
+}
+
+static inline void
+set_obj_next(uchar *obj, int idx)
+{
+  obj[0] = idx & 0xff;
+  obj[1] = idx >> 8;
+}
+
+static void
+zs_list_add(struct zs_class *k, struct zspage *zp)
+{
+  zp->prev = 0;
+  zp->next = k->partial;
+  if (k->partial)
+    k->partial->prev = zp;
+  k->partial = zp;
+}
+
+static void
+zs_list_del(struct zs_class *k, struct zspage *zp)
+{
+  if (zp->prev)
+    zp->prev->next = zp->next;
+  else
+    k->partial = zp->next;
+  if (zp->next)
+    zp->next->prev = zp->prev;
+}
+
+/**
+ * @brief 分配一个 size 字节的对象
+ * @return 对象句柄：zspage 地址的低 12 位存放对象下标，0 表示达到上限或内存不足
+ */
+static uint64
+zs_malloc(int size)
+{
+  int c = size <= ZS_MIN_SIZE ? 0 : (size - ZS_MIN_SIZE + ZS_ALIGN - 1) / ZS_ALIGN;
+  struct zs_class *k = &zram.cls[c];
+  struct zspage *zp;
+
+  acquire(&zram.lock);
+  if ((zp = k->partial) == 0) {
+    if (zram.pages + (1 << k->order) > zram.limit || (zp = kalloc_pages(k->order)) == 0) {
+      zram.nfull++;
+      release(&zram.lock);
+      return 0;
+    }
+    zram.pages += 1 << k->order;
+    zp->cls = c;
+    zp->inuse = 0;
+    zp->freeidx = 0;
+    for (int i = 0; i < k->nobj; i++)
+      set_obj_next(zs_obj(zp, i), i + 1 < k->nobj ? i + 1 : ZS_NONE);
+    zs_list_add(k, zp);
+  }
+  int idx = zp->freeidx;
+  zp->freeidx = obj_next(zs_obj(zp, idx));
+  zp->inuse++;
+  if (zp->freeidx == ZS_NONE)
+    zs_list_del(k, zp);
+  release(&zram.lock);
+  return (uint64)zp | idx;
+}
+
+static inline uchar *
+zs_map(uint64 handle)
+{
+  return zs_obj((struct zspage *)PGROUNDDOWN(handle), handle & (PGSIZE - 1));
+}
+
+/**
+ * @brief 释放一个对象，zspage 中最后一个对象释放时整个 zspage 归还伙伴系统
+ */
+static void
+zs_free(uint64 handle)
+{
+  struct zspage *zp = (struct zspage *)PGROUNDDOWN(handle);
+  int idx = handle & (PGSIZE - 1);
+  struct zs_class *k = &zram.cls[zp->cls];
+
+  acquire(&zram.lock);
+  set_obj_next(zs_obj(zp, idx), zp->freeidx);
+  if (zp->freeidx == ZS_NONE)
+    zs_list_add(k, zp);
+  zp->freeidx = idx;
+  if (--zp->inuse > 0) {
+    release(&zram.lock);
+    return;
+  }
+  zs_list_del(k, zp);
+  zram.pages -= 1 << k->order;
+  release(&zram.lock);
+  kfree_pages(zp, k->order);
+}
+
+// 对象的字节数，包括对象头
+static inline int
+obj_size(uchar *obj)
+{
+  int len = obj[0] | (obj[1] << 8);
+  return ZRAM_HDR + (len ? len : sizeof(uint64));
+}
+
+/**
+ * @brief 压缩保存一页
+ * @param page 要保存的页（内核地址）
+ * @param handle 返回对象句柄
+ * @return 0 成功，-1 压缩率太差、压缩区已满或内存不足，调用者改用其他方式保存
+ * @note 不会睡眠。压缩在本 CPU 的缓冲区中进行，期间关中断
+ */
+int
+zram_store(char *page, uint64 *handle)
+{
+  uint64 *w = (uint64 *)page;
+  uchar *src = (uchar *)page;
+  int len = 0, n = sizeof(uint64), i;
+
+  for (i = 1; i < PGSIZE / sizeof(uint64) && w[i] == w[0]; i++)
+    ;
+  push_off();
+  if (i < PGSIZE / sizeof(uint64)) {
+    int id = cpuid();
+    len = lz4_compress((uchar *)page, PGSIZE, zbuf[id], ZS_MAX_SIZE - ZRAM_HDR, ztable[id]);
+    if (len < 0) {
+      pop_off();
+      __atomic_fetch_add(&zram.nreject, 1, __ATOMIC_RELAXED);
+      return -1;
+    }
+    src = zbuf[id];
+    n = len;
+  }
+  uint64 h = zs_malloc(ZRAM_HDR + n);
+  if (h == 0) {
+    pop_off();
+    return -1;
+  }
+  uchar *obj = zs_map(h);
+  obj[0] = len & 0xff;
+  obj[1] = len >> 8;
+  memmove(obj + ZRAM_HDR, src, n);
+  pop_off();
+
+  acquire(&zram.lock);
+  zram.stored++;
+  zram.nstore++;
+  zram.bytes += ZRAM_HDR + n;
+  if (len == 0)
+    zram.same++;
+  release(&zram.lock);
+  *handle = h;
+  return 0;
+}
+
+/**
+ * @brief 读出一个对象保存的页，对象本身保持不变
+ * @param handle 对象句柄
+ * @param dst 目标页（内核地址）
+ * @return 0 成功，-1 数据损坏
+ */
+int
+zram_load(uint64 handle, char *dst)
+{
+  uchar *obj = zs_map(handle);
+  int len = obj[0] | (obj[1] << 8);
+
+  if (len == 0) {
+    uint64 v, *w = (uint64 *)dst;
+    memmove(&v, obj + ZRAM_HDR, sizeof(v));
+    for (int i = 0; i < PGSIZE / sizeof(uint64); i++)
+      w[i] = v;
+    return 0;
+  }
+  return lz4_decompress(obj + ZRAM_HDR, len, (uchar *)dst, PGSIZE) == PGSIZE ? 0 : -1;
+}
+
+/**
+ * @brief 为 fork 复制一个对象
+ * @return 新对象的句柄，0 表示压缩区已满或内存不足
+ * @note 直接复制压缩后的数据，不需要解压
+ */
+uint64
+zram_dup(uint64 handle)
+{
+  uchar *obj = zs_map(handle);
+  int size = obj_size(obj);
+  uint64 h = zs_malloc(size);
+
+  if (h == 0)
+    return 0;
+  memmove(zs_map(h), obj, size);
+  acquire(&zram.lock);
+  zram.stored++;
+  zram.bytes += size;
+  if (size == ZRAM_HDR + sizeof(uint64) && obj[0] == 0 && obj[1] == 0)
+    zram.same++;
+  release(&zram.lock);
+  return h;
+}
+
+/**
+ * @brief 丢弃一个对象
+ */
+void
+zram_free(uint64 handle)
+{
+  uchar *obj = zs_map(handle);
+  int size = obj_size(obj);
+  int same = obj[0] == 0 && obj[1] == 0;
+
+  acquire(&zram.lock);
+  zram.stored--;
+  zram.bytes -= size;
+  if (same)
+    zram.same--;
+  release(&zram.lock);
+  zs_free(handle);
+}
+
+/**
+ * @brief 压缩区还能再使用的物理页数
+ */
+int
+zram_room(void)
+{
+  int n;
+
+  acquire(&zram.lock);
+  n = zram.pages < zram.limit ? zram.limit - zram.pages : 0;
+  release(&zram.lock);
+  return n;
+}
+
+/**
+ * @brief 打印压缩区的使用情况
+ * @note 压缩率 = 保存的页数 / zspage 实际占用的物理页数，包括大小级别取整与未满 zspage 的浪费
+ */
+void
+zramdump(void)
+{
+  acquire(&zram.lock);
+  uint64 stored = zram.stored, pages = zram.pages;
+  int ratio = pages ? (int)(stored * 100 / pages) : 0;
+  printf("zram: %d pages stored (%d same-filled) in %d/%d pages, %d KiB compressed, ratio %d.%d%d\n",
+         (int)stored, (int)zram.same, (int)pages, (int)zram.limit, (int)(zram.bytes >> 10),
+         ratio / 100, ratio / 10 % 10, ratio % 10);
+  printf("zram: %d pages compressed in total, %d rejected as incompressible, %d rejected as full\n",
+         (int)zram.nstore, (int)zram.nreject, (int)zram.nfull);
+  release(&zram.lock);
+}
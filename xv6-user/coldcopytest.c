@@ -0,0 +1,76 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "xv6-user/user.h"
+
+// 系统调用访问尚未映射的用户页：exec 按需装入程序时，.rodata 与 .bss 的页在第一次访问前都没有映射。
+// 先用 .rodata 中从未访问过的一页里的路径名创建文件，再把文件与管道中的数据读进从未访问过的 .bss 页，
+// 最后让 wait 把退出状态写进另一页。内核需要在拷贝时按缺页补上映射，而不是让系统调用失败。
+// 两个数组都放在 PAD 页的中间，预映射窗口（16 页）不会从相邻被访问的页顺带映射到目标页
+
+#define PGSIZE          4096
+#define PAD             16
+#define MSG             "written into a cold page"
+
+static const char rodata[(2 * PAD + 1) * PGSIZE] __attribute__((aligned(PGSIZE))) = {
+  [PAD * PGSIZE] = 'c', 'o', 'l', 'd', 'c', 'o', 'p', 'y', '.', 't', 'm', 'p',
+};
+static char bss[(2 * PAD + 1) * PGSIZE] __attribute__((aligned(PGSIZE)));
+
+static int failed;
+
+static void
+report(char *name, int ok, int f0)
+{
+  printf("%s: %s%s\n", name, ok ? "ok" : "FAILED",
+         getminflt() == f0 ? " (page was already mapped)" : "");
+  if (!ok)
+    failed = 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = (char*)rodata + PAD * PGSIZE;
+  char *cold = bss + PAD * PGSIZE;
+  int fd, f0, n, fds[2];
+
+  faultaround(1);
+
+  // 路径名所在的 .rodata 页从未被访问过
+  f0 = getminflt();
+  fd = open(path, O_CREATE | O_RDWR);
+  report("open path in .rodata", fd >= 0, f0);
+  if (fd < 0)
+    exit(1);
+  write(fd, MSG, sizeof(MSG));
+  close(fd);
+
+  // 文件读入从未访问过的 .bss 页
+  fd = open(path, O_RDONLY);
+  f0 = getminflt();
+  n = read(fd, cold, sizeof(MSG));
+  close(fd);
+  report("read file into .bss", n == sizeof(MSG) && strcmp(cold, MSG) == 0, f0);
+  remove(path);
+
+  // 管道读入另一页：piperead 持有 pi->lock 拷贝，需要在加锁之前补上映射
+  if (pipe(fds) < 0)
+    exit(1);
+  write(fds[1], MSG, sizeof(MSG));
+  f0 = getminflt();
+  n = read(fds[0], cold + PGSIZE, sizeof(MSG));
+  report("read pipe into .bss", n == sizeof(MSG) && strcmp(cold + PGSIZE, MSG) == 0, f0);
+  close(fds[0]);
+  close(fds[1]);
+
+  // wait 写回的退出状态放在又一页
+  int *status = (int*)(cold + 2 * PGSIZE);
+  if (fork() == 0)
+    exit(3);
+  f0 = getminflt();
+  n = wait(status);
+  report("wait status into .bss", n > 0 && *status == (3 << 8), f0);
+
+  exit(failed);
+}
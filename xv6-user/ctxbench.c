@@ -0,0 +1,90 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/param.h"
+#include "xv6-user/user.h"
+
+// 上下文切换微基准：父子进程通过两根管道来回传递 1 字节（ping-pong），
+// 每次往返包含两次地址空间切换。每轮双方还各自读一遍 npages 页的工作集，
+// 用来体现切换后 TLB 项是否保留（按 ASID 区分地址空间后无需整体刷新）
+
+#define PGSIZE          4096
+#define ROUNDS          2000
+
+static int ws_pages[] = {0, 16, 64};
+
+// 依次读取工作集中每页的一个字节
+static int
+touch(char *mem, int npages)
+{
+  int sum = 0;
+  for (int i = 0; i < npages; i++)
+    sum += ((volatile char*)mem)[i * PGSIZE];
+  return sum;
+}
+
+// 以 npages 页的工作集做 ROUNDS 次往返，返回耗时（tick）
+static int
+bench(int npages)
+{
+  int ping[2], pong[2];
+  char c = 0;
+
+  char *mem = sbrk(npages * PGSIZE);
+  if (mem == (char*)-1) {
+    printf("ctxbench: sbrk failed\n");
+    exit(1);
+  }
+  for (int i = 0; i < npages; i++)
+    mem[i * PGSIZE] = (char)i;
+
+  if (pipe(ping) < 0 || pipe(pong) < 0) {
+    printf("ctxbench: pipe failed\n");
+    exit(1);
+  }
+  int pid = fork();
+  if (pid < 0) {
+    printf("ctxbench: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(ping[1]);
+    close(pong[0]);
+    while (read(ping[0], &c, 1) == 1) {
+      c += touch(mem, npages);
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  int start = uptime();
+  for (int i = 0; i < ROUNDS; i++) {
+    c += touch(mem, npages);
+    if (write(ping[1], &c, 1) != 1 || read(pong[0], &c, 1) != 1) {
+      printf("ctxbench: ping-pong failed\n");
+      exit(1);
+    }
+  }
+  int elapsed = uptime() - start;
+
+  close(ping[1]);
+  close(pong[0]);
+  wait(0);
+  sbrk(-npages * PGSIZE);
+  return elapsed;
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("pages\trounds\tticks\tus/round-trip\n");
+  for (int i = 0; i < sizeof(ws_pages) / sizeof(ws_pages[0]); i++) {
+    int ticks = bench(ws_pages[i]);
+    printf("%d\t%d\t%d\t%d\n", ws_pages[i], ROUNDS, ticks,
+           ticks * (1000000 / TICKS_PER_SECOND) / ROUNDS);
+  }
+  // 切换与刷新次数见 memstat 输出的 asid 统计
+  memstat();
+  exit(0);
+}
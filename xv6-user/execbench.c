@@ -0,0 +1,64 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// exec 按需装入与页缓存共享的效果：依次启动 NINST 个执行本程序的实例，每个实例启动后经管道通知
+// 父进程，然后睡眠到全部实例启动完毕。打印每个实例从 fork 到就绪的耗时与增加的物理页数：
+// 程序段的页在实例之间共享，从第二个实例开始只增加页表、栈与写过的私有页
+
+#define NINST   8
+#define SLEEP   50
+
+int
+main(int argc, char *argv[])
+{
+  // 被启动的实例：argv[2] 是管道的写端
+  if (argc > 2) {
+    write(atoi(argv[2]), "x", 1);
+    sleep(SLEEP);
+    exit(0);
+  }
+
+  int fds[2];
+  char wfd[8], c;
+  char *args[] = { "execbench", "-", wfd, 0 };
+
+  if (pipe(fds) < 0) {
+    printf("execbench: pipe failed\n");
+    exit(1);
+  }
+  // 把写端编号写成十进制参数
+  int n = fds[1], len = 0;
+  char tmp[8];
+  do {
+    tmp[len++] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  for (int i = 0; i < len; i++)
+    wfd[i] = tmp[len - 1 - i];
+  wfd[len] = 0;
+
+  for (int i = 0; i < NINST; i++) {
+    int pages = getpgcnt();
+    int t0 = uptime();
+    int pid = fork();
+    if (pid < 0) {
+      printf("execbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0) {
+      exec(args[0], args);
+      printf("execbench: exec failed\n");
+      exit(1);
+    }
+    if (read(fds[0], &c, 1) != 1) {
+      printf("execbench: instance %d did not start\n", i);
+      exit(1);
+    }
+    printf("instance %d: ready in %d ticks, +%d pages\n", i, uptime() - t0, getpgcnt() - pages);
+  }
+  for (int i = 0; i < NINST; i++)
+    wait(0);
+  memstat();
+  exit(0);
+}
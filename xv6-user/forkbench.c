@@ -0,0 +1,118 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/param.h"
+#include "kernel/include/sysinfo.h"
+#include "xv6-user/user.h"
+
+// fork 微基准：每个 forker 进程持有 1、8、64 MiB 已写入的堆内存，测量 fork + 子进程退出 + wait 的平均耗时。
+// 先只运行一个 forker，再让两个 forker 同时在两个 hart 上 fork，页引用计数的修改在两者之间争用。
+// 与 make REFLOCK=1 构建（引用计数经过一把全局锁）的结果对比即为改用原子操作前后的差别。
+// 物理内存放不下的规模会被跳过（需要留出页表与子进程的余量）
+
+#define PGSIZE          4096
+#define ROUNDS          50
+#define MAXFORKERS      2
+
+static int sizes_mb[] = {1, 8, 64};
+
+// 持有 size 字节的堆，准备好后通知父进程，收到开始信号后 fork ROUNDS 次，把用去的 tick 数写回父进程
+static void
+forker(uint64 size, int ready, int go, int result)
+{
+  char *mem = sbrk(size);
+  if (mem == (char*)-1)
+    exit(1);
+  // 逐页写入，确保每页都真正分配（懒分配时也一样）
+  for (uint64 off = 0; off < size; off += PGSIZE)
+    mem[off] = (char)off;
+
+  char c;
+  write(ready, "r", 1);
+  if (read(go, &c, 1) != 1)
+    exit(1);
+  int start = uptime();
+  for (int i = 0; i < ROUNDS; i++) {
+    int pid = fork();
+    if (pid < 0)
+      exit(1);
+    if (pid == 0)
+      exit(0);
+    wait(0);
+  }
+  int elapsed = uptime() - start;
+  write(result, &elapsed, sizeof(elapsed));
+  exit(0);
+}
+
+// 让 n 个 forker 同时运行，返回其中最慢者用去的 tick 数，-1 表示内存不足跳过
+static int
+bench(int mb, int n)
+{
+  struct sysinfo info;
+  uint64 size = (uint64)mb << 20;
+  int ready[2], go[2], result[2];
+
+  if (sysinfo(&info) < 0) {
+    printf("forkbench: sysinfo failed\n");
+    exit(1);
+  }
+  // 每个 forker 预留 1/8 的余量给父子进程的页表
+  if (info.freemem < n * (size + size / 8 + 64 * PGSIZE))
+    return -1;
+  if (pipe(ready) < 0 || pipe(go) < 0 || pipe(result) < 0) {
+    printf("forkbench: pipe failed\n");
+    exit(1);
+  }
+
+  for (int i = 0; i < n; i++) {
+    int pid = fork();
+    if (pid < 0) {
+      printf("forkbench: fork failed\n");
+      exit(1);
+    }
+    if (pid == 0)
+      forker(size, ready[1], go[0], result[1]);
+  }
+  // 全部 forker 写完内存后同时开始
+  char c;
+  for (int i = 0; i < n; i++)
+    read(ready[0], &c, 1);
+  for (int i = 0; i < n; i++)
+    write(go[1], "g", 1);
+
+  int slowest = 0, failed = 0, status;
+  for (int i = 0; i < n; i++) {
+    wait(&status);
+    failed |= status != 0;
+  }
+  close(result[1]);
+  for (int i = 0, t; i < n && read(result[0], &t, sizeof(t)) == sizeof(t); i++)
+    if (t > slowest)
+      slowest = t;
+  close(ready[0]); close(ready[1]);
+  close(go[0]); close(go[1]);
+  close(result[0]);
+  if (failed) {
+    printf("forkbench: forker failed\n");
+    exit(1);
+  }
+  return slowest;
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("size\tforkers\trounds\tticks\tus/fork\n");
+  for (int n = 1; n <= MAXFORKERS; n++) {
+    for (int i = 0; i < sizeof(sizes_mb) / sizeof(sizes_mb[0]); i++) {
+      int ticks = bench(sizes_mb[i], n);
+      if (ticks < 0) {
+        printf("%dM\t%d\tskipped (not enough memory)\n", sizes_mb[i], n);
+        continue;
+      }
+      printf("%dM\t%d\t%d\t%d\t%d\n", sizes_mb[i], n, ROUNDS, ticks,
+             ticks * (1000000 / TICKS_PER_SECOND) / ROUNDS);
+    }
+  }
+  exit(0);
+}
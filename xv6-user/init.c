@@ -269,6 +269,9 @@ void print_test_program(const char* program_name) {
 #elif defined(ALGO_LRU)  
   printf("LRU");
   order = "2";
+#elif defined(ALGO_CLOCK)
+  // CLOCK 没有评分测例，order 保持 "0"
+  printf("CLOCK (no graded test)");
 #else
   printf("Unknown");
 #endif
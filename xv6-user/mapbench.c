@@ -0,0 +1,142 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/param.h"
+#include "kernel/include/sysinfo.h"
+#include "xv6-user/user.h"
+
+// 映射/解除映射微基准：反复建立并拆除 16 MiB 的区域，分别测量建立（含逐页写入）与拆除的耗时。
+// 堆区域通过 sbrk 增长与收缩，匿名映射通过 mmap/munmap；物理内存放不下时跳过。
+// partial 以 64 KiB 为单位先拆除奇数块、再拆除偶数块，检验部分 munmap 的拆分与物理页回收
+
+#define PGSIZE          4096
+#define REGION          (16 << 20)
+#define ROUNDS          20
+#define CHUNK           (64 << 10)
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+// 逐页写入，确保每页都真正建立映射（懒分配时也一样）
+static void
+touch(char *mem)
+{
+  for (int off = 0; off < REGION; off += PGSIZE)
+    mem[off] = (char)off;
+}
+
+// 打印一行结果
+static void
+report(char *name, int map_ticks, int unmap_ticks)
+{
+  printf("%s\t%d\t%d\t%d\t%d\t%d\n", name, ROUNDS, map_ticks, unmap_ticks,
+         map_ticks * (1000000 / TICKS_PER_SECOND) / ROUNDS,
+         unmap_ticks * (1000000 / TICKS_PER_SECOND) / ROUNDS);
+}
+
+// sbrk 增长 + 写入，再 sbrk 收缩
+static int
+bench_heap(int *map_ticks, int *unmap_ticks)
+{
+  *map_ticks = *unmap_ticks = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    int t0 = uptime();
+    char *mem = sbrk(REGION);
+    if (mem == (char*)-1)
+      return -1;
+    touch(mem);
+    int t1 = uptime();
+    sbrk(-REGION);
+    int t2 = uptime();
+    *map_ticks += t1 - t0;
+    *unmap_ticks += t2 - t1;
+  }
+  return 0;
+}
+
+// 匿名 mmap + 写入，再 munmap
+static int
+bench_mmap(int *map_ticks, int *unmap_ticks)
+{
+  *map_ticks = *unmap_ticks = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    int t0 = uptime();
+    uint64 addr = mmap(0, REGION, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == (uint64)-1)
+      return -1;
+    touch((char*)addr);
+    int t1 = uptime();
+    if (munmap(addr, REGION) < 0)
+      return -1;
+    int t2 = uptime();
+    *map_ticks += t1 - t0;
+    *unmap_ticks += t2 - t1;
+  }
+  return 0;
+}
+
+// 匿名 mmap + 写入，再分块 munmap，每轮中间会把区域拆成许多 VMA
+static int
+bench_partial(int *map_ticks, int *unmap_ticks)
+{
+  *map_ticks = *unmap_ticks = 0;
+  for (int i = 0; i < ROUNDS; i++) {
+    int t0 = uptime();
+    uint64 addr = mmap(0, REGION, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == (uint64)-1)
+      return -1;
+    touch((char*)addr);
+    int t1 = uptime();
+    for (int pass = 1; pass >= 0; pass--)
+      for (int off = pass * CHUNK; off < REGION; off += 2 * CHUNK)
+        if (munmap(addr + off, CHUNK) < 0)
+          return -1;
+    int t2 = uptime();
+    *map_ticks += t1 - t0;
+    *unmap_ticks += t2 - t1;
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct sysinfo info;
+  int map_ticks, unmap_ticks;
+
+  if (sysinfo(&info) < 0) {
+    printf("mapbench: sysinfo failed\n");
+    exit(1);
+  }
+  printf("region\trounds\tmap\tunmap\tus/map\tus/unmap\n");
+  // 预留 1/8 的余量给页表
+  if (info.freemem < REGION + REGION / 8) {
+    printf("16M\tskipped (not enough memory)\n");
+    exit(0);
+  }
+  if (bench_heap(&map_ticks, &unmap_ticks) < 0)
+    printf("heap\tfailed\n");
+  else
+    report("heap", map_ticks, unmap_ticks);
+  if (bench_mmap(&map_ticks, &unmap_ticks) < 0)
+    printf("mmap\tfailed\n");
+  else
+    report("mmap", map_ticks, unmap_ticks);
+  if (sysinfo(&info) < 0)
+    exit(1);
+  uint64 before = info.freemem;
+  if (bench_partial(&map_ticks, &unmap_ticks) < 0)
+    printf("partial\tfailed\n");
+  else
+    report("partial", map_ticks, unmap_ticks);
+  // munmap 立即归还物理页，拆除后空闲内存应回到开始时的水平；
+  // 页表页和 slab 缓存会留下少量占用，只报告超过区域 1/64 的差额
+  if (sysinfo(&info) == 0 && info.freemem + REGION / 64 < before)
+    printf("partial\tleaked %d KiB\n", (int)((before - info.freemem) >> 10));
+  // TLB 刷新次数见 memstat 输出的 asid 统计
+  memstat();
+  exit(0);
+}
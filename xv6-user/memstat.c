@@ -0,0 +1,13 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// 打印内核物理内存分配器的统计信息（输出由内核直接写到控制台）
+int main()
+{
+    if (memstat() < 0) {
+        printf("memstat fail!\n");
+        exit(1);
+    }
+    exit(0);
+}
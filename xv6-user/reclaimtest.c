@@ -0,0 +1,121 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "kernel/include/sysinfo.h"
+#include "xv6-user/user.h"
+
+// 全局页面回收测试：一个子进程把文件整个映射进来读一遍后睡眠，另一个子进程再申请比剩余空闲内存
+// 多出一半文件大小的匿名内存。只有回收了前者的干净文件页，后者才不会因内存不足被杀死；
+// 之后前者重新读一遍映射，检查被回收的页能从文件中正确读回
+
+#define PGSIZE          4096
+#define MAXFILE         (4 << 20)
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+#define MAP_SHARED      0x4
+
+static char buf[PGSIZE];
+
+// 第 i 页的每个字节都是 i 的低 8 位
+static int
+make_file(char *path, int size)
+{
+  int fd = open(path, O_CREATE | O_RDWR | O_TRUNC);
+  if (fd < 0)
+    return -1;
+  for (int i = 0; i < size / PGSIZE; i++) {
+    memset(buf, i & 0xff, PGSIZE);
+    if (write(fd, buf, PGSIZE) != PGSIZE) {
+      close(fd);
+      return -1;
+    }
+  }
+  close(fd);
+  return 0;
+}
+
+// 读遍映射，返回内容不符的页数
+static int
+check(char *mem, int size)
+{
+  int bad = 0;
+  for (int off = 0; off < size; off += PGSIZE)
+    if (mem[off] != (char)(off / PGSIZE) || mem[off + PGSIZE - 1] != (char)(off / PGSIZE))
+      bad++;
+  return bad;
+}
+
+// 映射文件并读一遍，通知父进程后等待，再读一遍检查内容
+static void
+holder(char *path, int size, int ready, int go)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    exit(1);
+  char *mem = (char*)mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (mem == (char*)-1)
+    exit(1);
+  int bad = check(mem, size);
+  write(ready, "x", 1);
+  read(go, buf, 1);
+  bad += check(mem, size);
+  exit(bad ? 2 : 0);
+}
+
+// 申请并写遍 size 字节的匿名内存
+static void
+hog(uint64 size)
+{
+  char *mem = (char*)mmap(0, (int)size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == (char*)-1)
+    exit(1);
+  for (uint64 off = 0; off < size; off += PGSIZE)
+    mem[off] = 1;
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *path = "reclaim.tmp";
+  struct sysinfo info;
+  int ready[2], go[2], status;
+
+  if (sysinfo(&info) < 0 || pipe(ready) < 0 || pipe(go) < 0) {
+    printf("reclaimtest: setup failed\n");
+    exit(1);
+  }
+  int size = info.freemem / 2 < MAXFILE ? (int)(info.freemem / 2) & ~(PGSIZE - 1) : MAXFILE;
+  if (make_file(path, size) < 0) {
+    printf("reclaimtest: cannot create %s\n", path);
+    exit(1);
+  }
+
+  int pid1 = fork();
+  if (pid1 == 0)
+    holder(path, size, ready[1], go[0]);
+  if (read(ready[0], buf, 1) != 1) {
+    printf("reclaimtest: holder failed\n");
+    exit(1);
+  }
+
+  sysinfo(&info);
+  uint64 want = info.freemem + size / 2;
+  printf("file %d KiB mapped, %d KiB free, allocating %d KiB\n",
+         size >> 10, (int)(info.freemem >> 10), (int)(want >> 10));
+  int pid2 = fork();
+  if (pid2 == 0)
+    hog(want);
+  wait(&status);
+  printf("hog: %s\n", status == 0 ? "ok" : "failed");
+
+  write(go[1], "x", 1);
+  wait(&status);
+  printf("holder: %s\n", status == 0 ? "ok" : status == (2 << 8) ? "bad data" : "failed");
+  remove(path);
+  memstat();
+  exit(0);
+}
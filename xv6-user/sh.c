@@ -306,6 +306,15 @@ main(void)
         free(cmd);
         continue;
       }
+      else if(cmd->type == EXEC || cmd->type == REDIR){
+        // 简单命令用 vfork，子进程借用 shell 的地址空间直接 exec，开销与 shell 的大小无关。
+        // 必须在这里直接调用：子进程从 fork1 这样的包装函数返回会破坏父进程的栈
+        int pid = vfork();
+        if(pid == -1)
+          panic("vfork");
+        if(pid == 0)
+          runcmd(cmd);
+      }
       else if(fork1() == 0) 
         runcmd(cmd);
       wait(0);
@@ -0,0 +1,112 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "xv6-user/user.h"
+
+// 缺页路径上写交换文件：启用交换文件后在 BUDGET 页的驻留预算下写遍 NPAGES 页 mmap 内存，
+// 页的内容是伪随机数，压缩区不会接收，换出都要同步写交换文件。之后读回校验，
+// 再 fork 一个子进程校验共享的交换槽位。写交换文件时持有自旋锁会在 swap_out 中 panic，
+// 换出与换入的次数由结束时的 memstat 打印
+
+#define PGSIZE          4096
+#define BUDGET          8
+#define NPAGES          64
+#define SWAPFILE        "swapfault.swp"
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+#ifdef ALGO
+int set_max_page_in_mem(int);
+int get_swap_count(void);
+
+static char zero[PGSIZE];
+
+// 创建并启用 NPAGES 页的交换文件；已经启用过交换文件时沿用它
+static void
+enable_swap(void)
+{
+  int fd = open(SWAPFILE, O_CREATE | O_RDWR | O_TRUNC);
+  if (fd < 0) {
+    printf("swapfaulttest: cannot create %s\n", SWAPFILE);
+    exit(1);
+  }
+  for (int i = 0; i < NPAGES; i++) {
+    if (write(fd, zero, PGSIZE) != PGSIZE) {
+      printf("swapfaulttest: write %s failed\n", SWAPFILE);
+      exit(1);
+    }
+  }
+  close(fd);
+  if (swapon(SWAPFILE) < 0) {
+    printf("swapfaulttest: swap file already active, using it\n");
+    remove(SWAPFILE);
+  }
+}
+
+// 写入或校验全部页，返回内容不符的页数
+static int
+pass(char *mem, int check)
+{
+  uint seed = 1;
+  int bad = 0;
+
+  for (int i = 0; i < NPAGES; i++) {
+    uint *pg = (uint*)(mem + i * PGSIZE);
+    int ok = 1;
+    for (int j = 0; j < PGSIZE / sizeof(uint); j++) {
+      seed = seed * 1103515245 + 12345;
+      if (!check)
+        pg[j] = seed;
+      else if (pg[j] != seed)
+        ok = 0;
+    }
+    bad += !ok;
+  }
+  return bad;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+  #ifdef ALGO
+  int status;
+
+  enable_swap();
+  set_max_page_in_mem(BUDGET);
+  char *mem = (char*)mmap(0, NPAGES * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == (char*)-1) {
+    printf("swapfaulttest: mmap failed\n");
+    exit(1);
+  }
+
+  pass(mem, 0);
+  int swaps = get_swap_count();
+  int bad = pass(mem, 1);
+  printf("write: %d swaps (want >= %d), read back: %d bad pages\n", swaps, NPAGES - BUDGET, bad);
+
+  int pid = fork();
+  if (pid < 0) {
+    printf("swapfaulttest: fork failed\n");
+    exit(1);
+  }
+  if (pid == 0)
+    exit(pass(mem, 1) ? 2 : 0);
+  wait(&status);
+  int pbad = pass(mem, 1);
+  printf("fork: child %s, parent %d bad pages\n",
+         status == 0 ? "ok" : status == (2 << 8) ? "bad data" : "failed", pbad);
+
+  munmap((uint64)mem, NPAGES * PGSIZE);
+  memstat();
+  int ok = swaps >= NPAGES - BUDGET && bad == 0 && status == 0 && pbad == 0;
+  printf("swapfaulttest: %s\n", ok ? "ok" : "FAILED");
+  exit(ok ? 0 : 1);
+  #else
+  printf("swapfaulttest: build with ALGO=FIFO, ALGO=LRU or ALGO=CLOCK\n");
+  exit(0);
+  #endif
+}
@@ -0,0 +1,44 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/fcntl.h"
+#include "xv6-user/user.h"
+
+// 启用交换文件。给出大小（MiB）时先创建文件并写满零，预先分配好全部簇；
+// 否则使用已有的文件，文件原有内容会被覆盖
+
+static char zero[4096];
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2) {
+        fprintf(2, "Usage: swapon file [MiB]\n");
+        exit(1);
+    }
+
+    if (argc >= 3) {
+        int mib = atoi(argv[2]);
+        if (mib <= 0) {
+            fprintf(2, "swapon: bad size %s\n", argv[2]);
+            exit(1);
+        }
+        int fd = open(argv[1], O_CREATE | O_RDWR | O_TRUNC);
+        if (fd < 0) {
+            fprintf(2, "swapon: cannot create %s\n", argv[1]);
+            exit(1);
+        }
+        for (int i = 0; i < mib * (1 << 20) / sizeof(zero); i++) {
+            if (write(fd, zero, sizeof(zero)) != sizeof(zero)) {
+                fprintf(2, "swapon: write %s failed\n", argv[1]);
+                close(fd);
+                exit(1);
+            }
+        }
+        close(fd);
+    }
+
+    if (swapon(argv[1]) < 0) {
+        fprintf(2, "swapon: cannot use %s\n", argv[1]);
+        exit(1);
+    }
+    exit(0);
+}
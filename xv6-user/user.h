@@ -8,6 +8,7 @@ struct sysinfo;
 
 // system calls
 int fork(void);
+int vfork(void);
 int exit(int) __attribute__((noreturn));
 int wait(int*);
 int pipe(int*);
@@ -40,6 +41,15 @@ int set_priority(int);
 int get_priority(void);
 int getprocsz(void);
 int getpgcnt(void);
+int memstat(void);
+int faultaround(int);
+int getminflt(void);
+uint64 getflttime(void);
+int strbench(void);
+uint64 mmap(uint64 addr, int length, int prot, int flags, int fd, int offset);
+int munmap(uint64 addr, int length);
+int msync(uint64 addr, int length, int flags);
+int swapon(const char *path);
 int sem_p(int);
 int sem_v(int);
 int sem_create(int);
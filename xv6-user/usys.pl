@@ -16,6 +16,7 @@ sub entry {
 }
 	
 entry("fork");
+entry("vfork");
 entry("exit");
 entry("wait");
 entry("pipe");
@@ -48,10 +49,18 @@ entry("set_priority");
 entry("get_priority");
 entry("getprocsz");
 entry("getpgcnt");
+entry("memstat");
+entry("faultaround");
+entry("getminflt");
+entry("getflttime");
+entry("strbench");
 entry("mmap");
 entry("munmap");
+entry("msync");
+entry("swapon");
 entry("set_max_page_in_mem");
 entry("get_swap_count");
+entry("get_ws_info");
 entry("lru_access_notify");
 entry("sem_v");
 entry("sem_p");
@@ -0,0 +1,56 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// fork+exec 与 vfork+exec 的开销对比：父进程的堆依次增长到 0、1、2、4 MiB 并写遍，
+// 每种大小下各创建 NITER 个立即 exec 的子进程。fork 的耗时随父进程大小增长，
+// vfork 不复制页表，应与父进程大小无关
+
+#define PGSIZE          4096
+#define NITER           20
+#define MAXMB           4
+
+static char *child[] = { "vforkbench", "-", 0 };
+
+static int
+run(int use_vfork)
+{
+  int t0 = uptime();
+  for (int i = 0; i < NITER; i++) {
+    int pid = use_vfork ? vfork() : fork();
+    if (pid < 0) {
+      printf("vforkbench: %s failed\n", use_vfork ? "vfork" : "fork");
+      exit(1);
+    }
+    if (pid == 0) {
+      exec(child[0], child);
+      exit(1);
+    }
+    wait(0);
+  }
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  // exec 进来的子进程
+  if (argc > 1)
+    exit(0);
+
+  int mb = 0;
+  for (int target = 0; target <= MAXMB; target = target ? target * 2 : 1) {
+    char *p = sbrk((target - mb) << 20);
+    if (p == (char*)-1) {
+      printf("vforkbench: sbrk failed\n");
+      exit(1);
+    }
+    for (int off = 0; off < ((target - mb) << 20); off += PGSIZE)
+      p[off] = 1;
+    mb = target;
+    int tf = run(0);
+    int tv = run(1);
+    printf("heap %d MiB: %d fork+exec %d ticks, %d vfork+exec %d ticks\n", mb, NITER, tf, NITER, tv);
+  }
+  exit(0);
+}
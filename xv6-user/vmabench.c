@@ -0,0 +1,107 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/param.h"
+#include "xv6-user/user.h"
+
+// VMA 查找开销：建立 n 个单页匿名映射，逐页触发缺页后再逐个解除映射，
+// 统计每次 mmap、缺页与 munmap 的平均耗时。映射数增大时各项耗时应基本不变。
+// fixed 先保留一段连续区域，再用 MAP_FIXED 逐页覆盖成 n 个相邻映射，检验覆盖时的 VMA 拆分
+
+#define PGSIZE          4096
+#define MAXMAPS         512
+#define ROUNDS          8
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+#define MAP_FIXED       0x8
+
+static int counts[] = {16, 128, 512};
+static uint64 addrs[MAXMAPS];
+
+// 以 ROUNDS 轮建立、访问、解除 n 个映射，打印三个阶段每次操作的平均纳秒数
+static void
+run(int n)
+{
+  int tmap = 0, tfault = 0, tunmap = 0;
+  int done = 0;
+
+  for (int r = 0; r < ROUNDS; r++) {
+    int t0 = uptime();
+    for (int i = 0; i < n; i++) {
+      addrs[i] = mmap(0, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (addrs[i] == (uint64)-1) {
+        printf("vmabench: mmap %d failed\n", i);
+        for (int j = 0; j < i; j++)
+          munmap(addrs[j], PGSIZE);
+        return;
+      }
+    }
+    int t1 = uptime();
+    for (int i = 0; i < n; i++)
+      *(char*)addrs[i] = (char)i;
+    int t2 = uptime();
+    for (int i = 0; i < n; i++)
+      munmap(addrs[i], PGSIZE);
+    int t3 = uptime();
+    tmap += t1 - t0;
+    tfault += t2 - t1;
+    tunmap += t3 - t2;
+    done += n;
+  }
+
+  uint64 ns = 1000000000 / TICKS_PER_SECOND;
+  printf("%d\t%d\t%d\t%d\n", n,
+         (int)(tmap * ns / done), (int)(tfault * ns / done), (int)(tunmap * ns / done));
+}
+
+// 在保留区域内用 MAP_FIXED 逐页建立 n 个相邻映射，打印与 run 相同格式的一行
+static void
+run_fixed(int n)
+{
+  int tmap = 0, tfault = 0, tunmap = 0;
+  int done = 0;
+
+  for (int r = 0; r < ROUNDS; r++) {
+    uint64 base = mmap(0, (uint64)n * PGSIZE, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == (uint64)-1) {
+      printf("vmabench: reserve failed\n");
+      return;
+    }
+    int t0 = uptime();
+    for (int i = 0; i < n; i++) {
+      uint64 a = base + (uint64)i * PGSIZE;
+      if (mmap(a, PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != a) {
+        printf("vmabench: MAP_FIXED %d failed\n", i);
+        munmap(base, n * PGSIZE);
+        return;
+      }
+    }
+    int t1 = uptime();
+    for (int i = 0; i < n; i++)
+      *(char*)(base + (uint64)i * PGSIZE) = (char)i;
+    int t2 = uptime();
+    munmap(base, n * PGSIZE);
+    int t3 = uptime();
+    tmap += t1 - t0;
+    tfault += t2 - t1;
+    tunmap += t3 - t2;
+    done += n;
+  }
+
+  uint64 ns = 1000000000 / TICKS_PER_SECOND;
+  printf("%d fixed\t%d\t%d\t%d\n", n,
+         (int)(tmap * ns / done), (int)(tfault * ns / done), (int)(tunmap * ns / done));
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("maps\tmmap_ns\tfault_ns\tmunmap_ns\n");
+  for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    run(counts[i]);
+  for (int i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+    run_fixed(counts[i]);
+  exit(0);
+}
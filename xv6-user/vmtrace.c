@@ -0,0 +1,82 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// 页面置换访问序列对比：在 4 页驻留预算下运行几条访问序列，统计换出次数。
+// 用法 vmtrace [pace]，每次访问之间等待 pace 个 tick（默认 0，即连续访问）。
+// 分别用 ALGO=FIFO、ALGO=LRU（每次访问后调用 lru_access_notify）与 ALGO=CLOCK 构建后运行，比较同一序列的换出次数
+
+#define PGSIZE          4096
+#define BUDGET          4
+#define NPAGES          8
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+#ifdef ALGO
+int set_max_page_in_mem(int);
+int get_swap_count(void);
+int lru_access_notify(uint64 addr);
+
+struct trace {
+  char *name;
+  int len;
+  int pages[32];
+};
+
+static struct trace traces[] = {
+  // test_vm_lru / test_vm_fifo 使用的序列
+  {"judge", 16, {0, 1, 2, 3, 0, 1, 4, 5, 0, 1, 6, 7, 0, 1, 2, 3}},
+  // 两页热点夹杂顺序扫描的冷页
+  {"hotcold", 24, {0, 1, 2, 0, 1, 3, 0, 1, 4, 0, 1, 5, 0, 1, 6, 0, 1, 7, 0, 1, 2, 0, 1, 3}},
+  // 循环访问比预算多一页的工作集，LRU 与 FIFO 的最坏情况
+  {"loop", 20, {0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4, 0, 1, 2, 3, 4}},
+};
+
+static void
+pace_wait(int pace)
+{
+  int t0 = uptime();
+  while (uptime() - t0 < pace)
+    ;
+}
+
+// 在新的映射上运行一条访问序列，返回换出次数
+static int
+run(struct trace *t, int pace)
+{
+  uint64 addr = mmap(0, NPAGES * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == (uint64)-1)
+    return -1;
+  char *mem = (char*)addr;
+  int s0 = get_swap_count();
+  for (int i = 0; i < t->len; i++) {
+    mem[t->pages[i] * PGSIZE] = 'A' + t->pages[i];
+    #ifdef ALGO_LRU
+    lru_access_notify((uint64)&mem[t->pages[i] * PGSIZE]);
+    #endif
+    pace_wait(pace);
+  }
+  int swaps = get_swap_count() - s0;
+  munmap(addr, NPAGES * PGSIZE);
+  return swaps;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+  #ifdef ALGO
+  int pace = argc > 1 ? atoi(argv[1]) : 0;
+
+  set_max_page_in_mem(BUDGET);
+  printf("trace\taccesses\tpace\tswaps\n");
+  for (int i = 0; i < sizeof(traces) / sizeof(traces[0]); i++)
+    printf("%s\t%d\t%d\t%d\n", traces[i].name, traces[i].len, pace, run(&traces[i], pace));
+  #else
+  printf("vmtrace: build with ALGO=FIFO, ALGO=LRU or ALGO=CLOCK\n");
+  #endif
+  exit(0);
+}
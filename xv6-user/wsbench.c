@@ -0,0 +1,71 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "kernel/include/sysinfo.h"
+#include "xv6-user/user.h"
+
+// 驻留预算自动调整演示：子进程先循环访问 LARGE 页，再只访问 SMALL 页，
+// 父进程定期打印它的预算、驻留页数、工作集估计与换出次数。
+// 预算应先随换入增长到接近 LARGE，工作集变小后逐窗口收缩到 SMALL 附近，换出次数随之停止增长
+
+#define PGSIZE          4096
+#define LARGE           256
+#define SMALL           32
+#define PHASE_TICKS     200
+#define SAMPLES         8
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+#ifdef ALGO
+int get_ws_info(struct wsinfo *, int);
+
+static struct wsinfo info[64];
+
+// 在 ticks 个 tick 内反复写遍前 npages 页
+static void
+touch(char *mem, int npages, int ticks)
+{
+  int t0 = uptime();
+  while (uptime() - t0 < ticks)
+    for (int i = 0; i < npages; i++)
+      mem[i * PGSIZE]++;
+}
+
+static void
+worker(void)
+{
+  char *mem = (char*)mmap(0, LARGE * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == (char*)-1)
+    exit(1);
+  touch(mem, LARGE, PHASE_TICKS);
+  touch(mem, SMALL, PHASE_TICKS);
+  exit(0);
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+  #ifdef ALGO
+  int pid = fork();
+  if (pid == 0)
+    worker();
+
+  printf("tick\tbudget\tresident\testimate\tswaps\tauto\n");
+  int t0 = uptime();
+  for (int s = 0; s < SAMPLES; s++) {
+    sleep(2 * PHASE_TICKS / SAMPLES);
+    int n = get_ws_info(info, sizeof(info) / sizeof(info[0]));
+    for (int i = 0; i < n; i++)
+      if (info[i].pid == pid)
+        printf("%d\t%d\t%d\t%d\t%d\t%d\n", uptime() - t0, info[i].budget, info[i].resident,
+               info[i].estimate, info[i].swaps, info[i].automatic);
+  }
+  wait(0);
+  #else
+  printf("wsbench: build with ALGO=FIFO, ALGO=LRU or ALGO=CLOCK\n");
+  #endif
+  exit(0);
+}
@@ -0,0 +1,57 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// 共享零页效果：在堆和匿名 mmap 上各建一个稀疏大数组，先读遍每一页，再每 STRIDE 页写一个字节，
+// 每一步后用 getpgcnt 统计新增的物理页（含页表页）。read 列即读缺页所占的物理页，
+// 与读缺页分配私有页的内核对比才能得出共享零页节省的内存
+
+#define PGSIZE          4096
+#define SIZE            (4 << 20)
+#define STRIDE          64
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+static void
+run(char *name, char *mem)
+{
+  int base = getpgcnt();
+  int sum = 0;
+
+  for (int off = 0; off < SIZE; off += PGSIZE)
+    sum += mem[off];
+  int after_read = getpgcnt() - base;
+  for (int off = 0; off < SIZE; off += STRIDE * PGSIZE)
+    mem[off] = 1;
+  int after_write = getpgcnt() - base;
+  for (int off = 0; off < SIZE; off += PGSIZE)
+    sum += mem[off];
+  printf("%s\t%d\t%d\t%d\t%s\n", name, SIZE / PGSIZE, after_read, after_write,
+         sum == SIZE / PGSIZE / STRIDE ? "ok" : "bad data");
+}
+
+int
+main(int argc, char *argv[])
+{
+  printf("region\tpages\tread\twrite 1/%d\tcheck\n", STRIDE);
+
+  char *heap = sbrk(SIZE);
+  if (heap == (char*)-1) {
+    printf("zerobench: sbrk failed\n");
+    exit(1);
+  }
+  run("heap", heap);
+
+  char *anon = (char*)mmap(0, SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (anon == (char*)-1) {
+    printf("zerobench: mmap failed\n");
+    exit(1);
+  }
+  run("mmap", anon);
+  munmap((uint64)anon, SIZE);
+  memstat();
+  exit(0);
+}
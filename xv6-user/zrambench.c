@@ -0,0 +1,93 @@
+#include "kernel/include/types.h"
+#include "kernel/include/stat.h"
+#include "xv6-user/user.h"
+
+// 压缩换出测试：在 16 页驻留预算下写遍 NPAGES 页 mmap 内存，页的内容轮流为全 0、重复的文本
+// 与伪随机数，再读回校验。结束时 memstat 打印压缩区保存与拒绝的页数、压缩率，
+// 以及压缩区、交换文件各自的平均换入耗时，各页实际去向以这些计数为准
+
+#define PGSIZE          4096
+#define BUDGET          16
+#define NPAGES          192
+
+#define PROT_READ       0x1
+#define PROT_WRITE      0x2
+#define MAP_PRIVATE     0x1
+#define MAP_ANONYMOUS   0x2
+
+#ifdef ALGO
+int set_max_page_in_mem(int);
+int get_swap_count(void);
+
+static uint seed;
+
+static uint
+rand(void)
+{
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+// 第 i 页第 j 字节的内容
+static char
+pattern(int i, int j)
+{
+  static char text[] = "the quick brown fox jumps over the lazy dog. ";
+
+  switch (i % 3) {
+  case 0:
+    return 0;
+  case 1:
+    return text[(i + j) % (sizeof(text) - 1)];
+  default:
+    return rand() & 0xff;
+  }
+}
+
+// 写入或校验全部页，返回内容不符的页数
+static int
+pass(char *mem, int check)
+{
+  int bad = 0;
+
+  seed = 1;
+  for (int i = 0; i < NPAGES; i++) {
+    char *pg = mem + i * PGSIZE;
+    int ok = 1;
+    for (int j = 0; j < PGSIZE; j++) {
+      char c = pattern(i, j);
+      if (!check)
+        pg[j] = c;
+      else if (pg[j] != c)
+        ok = 0;
+    }
+    bad += !ok;
+  }
+  return bad;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+  #ifdef ALGO
+  set_max_page_in_mem(BUDGET);
+  char *mem = (char*)mmap(0, NPAGES * PGSIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == (char*)-1) {
+    printf("zrambench: mmap failed\n");
+    exit(1);
+  }
+  int t0 = uptime();
+  pass(mem, 0);
+  int t1 = uptime();
+  int bad = pass(mem, 1);
+  int t2 = uptime();
+  printf("%d pages, budget %d: write %d ticks, read back %d ticks, %d swaps, %d bad pages\n",
+         NPAGES, BUDGET, t1 - t0, t2 - t1, get_swap_count(), bad);
+  munmap((uint64)mem, NPAGES * PGSIZE);
+  memstat();
+  #else
+  printf("zrambench: build with ALGO=FIFO, ALGO=LRU or ALGO=CLOCK\n");
+  #endif
+  exit(0);
+}